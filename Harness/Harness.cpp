@@ -0,0 +1,74 @@
+// Harness.cpp : Defines the entry point for the console application.
+// Headless runs of the decoding pipeline for measurements and regression checks, one mode per run.
+//
+
+#include "stdafx.h"
+
+#include "harness.h"
+
+#include <stdlib.h>
+#include <exception>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+namespace {
+
+const struct
+{
+    const TCHAR* name;
+    HarnessMode run;
+    size_t minArgs;
+    const char* usage;
+} modes[] =
+{
+    // The CMake build has the portable decoder core only, for the sanitizers
+#ifndef HARNESS_CORE_ONLY
+    { _T("compare"), RunCompare, 3, "compare <reference> <distorted> <csv>" },
+    { _T("seeks"), RunSeeks, 2, "seeks <corpus dir> <report.json> [<baseline.json>]" },
+    { _T("read"), RunRead, 1, "read <file>" },
+    { _T("http"), RunHttp, 0, "http" },
+#endif
+    { _T("stress"), RunStress, 1, "stress <file> [<seconds>] [<seed>]" },
+    { _T("pacing"), RunPacing, 1, "pacing <file> [<seconds>]" },
+#ifndef HARNESS_CORE_ONLY
+    { _T("bench"), RunBench, 0, "bench [<report.json>]" },
+    { _T("audio"), RunAudio, 0, "audio [<report.json>]" },
+    { _T("governor"), RunGovernor, 0, "governor" },
+    { _T("analyze"), RunAnalyze, 1, "analyze <file>" },
+#endif
+};
+
+} // namespace
+
+int _tmain(int argc, TCHAR *argv[])
+{
+    if (argc >= 2)
+    {
+        for (const auto& mode : modes)
+        {
+            if (_tcsicmp(argv[1], mode.name) == 0 && static_cast<size_t>(argc - 2) >= mode.minArgs)
+            {
+                try
+                {
+                    return mode.run(std::vector<PathType>(argv + 2, argv + argc));
+                }
+                catch (const std::exception& ex)
+                {
+                    std::cerr << ex.what() << '\n';
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+    }
+
+    std::cerr << "Usage:\n";
+    for (const auto& mode : modes)
+    {
+        std::cerr << "  Harness " << mode.usage << '\n';
+    }
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,93 @@
+#include "stdafx.h"
+
+#include "harness.h"
+#include "headless.h"
+
+#include <boost/chrono.hpp>
+#include <boost/filesystem.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+enum { ANALYSIS_TIMEOUT_SECS = 600, FRAMES_TIMEOUT_SECS = 10 };
+
+struct AnalysisRun
+{
+    bool analyzed = false;
+    bool played = false;
+    double seconds = 0;
+    std::vector<std::string> properties;
+};
+
+// The scan runs on its own thread while the file plays
+AnalysisRun Analyze(const PathType& file)
+{
+    AnalysisRun run;
+
+    HeadlessListener listener;
+    auto decoder = GetFrameDecoder(std::make_unique<NullAudioPlayer>());
+    decoder->setFrameListener(&listener);
+    decoder->setDecoderListener(&listener);
+    if (!decoder->openFile(file))
+    {
+        return run;
+    }
+
+    const auto startTime = boost::chrono::steady_clock::now();
+    decoder->analyzeStream();
+    decoder->play();
+    run.played = listener.waitForFrames(1, FRAMES_TIMEOUT_SECS);
+    run.analyzed = listener.waitForAnalysis(ANALYSIS_TIMEOUT_SECS);
+    run.seconds = boost::chrono::duration<double>(boost::chrono::steady_clock::now() - startTime).count();
+    run.properties = decoder->getProperties();
+
+    decoder->close();
+    return run;
+}
+
+} // namespace
+
+// analyze <file>: the packet scan behind the keyframe, bitrate and timestamp findings, run twice on a playing
+// decoder. The first one reads the file, the second one is answered from the cache.
+int RunAnalyze(const std::vector<PathType>& args)
+{
+    int failures = 0;
+    const auto check = [&failures](bool ok, const std::string& what)
+    {
+        std::cout << (ok ? "ok      " : "FAILED  ") << what << '\n';
+        failures += ok ? 0 : 1;
+    };
+
+    const auto first = Analyze(args[0]);
+    check(first.analyzed, "analysis finished");
+    if (!first.analyzed)
+    {
+        return EXIT_FAILURE;
+    }
+    check(first.played, "frames presented meanwhile");
+
+    const double megabytes = boost::filesystem::file_size(args[0]) / (1024. * 1024.);
+    printf("Scanned %.1f MB in %.2f s, %.1f MB/s\n", megabytes, first.seconds, megabytes / first.seconds);
+    for (const auto& property : first.properties)
+    {
+        printf("    %s\n", property.c_str());
+    }
+
+    bool hasBitrate = false;
+    for (const auto& property : first.properties)
+    {
+        hasBitrate = hasBitrate || property.compare(0, 8, "Bitrate:") == 0;
+    }
+    check(hasBitrate, "bitrate reported");
+
+    const auto second = Analyze(args[0]);
+    printf("Again from the cache in %.2f s\n", second.seconds);
+    check(second.analyzed && second.properties == first.properties, "cached result matches");
+
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
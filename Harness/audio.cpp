@@ -0,0 +1,223 @@
+#include "stdafx.h"
+
+#include "harness.h"
+#include "headless.h"
+
+#include "../Player/AudioPitchDecorator.h"
+
+#include <boost/chrono.hpp>
+#include <boost/filesystem.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+const int CHANNELS[] = { 1, 2, 6, 8 };
+const int SAMPLE_RATES[] = { 44100, 48000, 96000, 192000 };
+const float PITCH_SHIFTS[] = { 1.f, 0.5f, 0.75f, 1.25f, 1.5f, 2.f };
+
+enum { TONE_SECONDS = 10, END_TIMEOUT_SECS = 300 };
+
+const double MAX_SOUND_LOST = 0.1;
+
+struct AudioResult
+{
+    int channels;
+    int sampleRate;
+    float pitchShift;
+    double written;
+    double elapsed;
+    // The decoder's own figures, negative when it did not report them
+    double decodePercent = -1;
+    double resamplePercent = -1;
+    double pitchShiftPercent = -1;
+    double realTime = -1;
+};
+
+void PutLittleEndian(std::vector<uint8_t>& data, uint32_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+    {
+        data.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+}
+
+// 16 bit PCM, a tone of its own on every channel
+bool WriteTone(const boost::filesystem::path& file, int channels, int sampleRate)
+{
+    const uint32_t samples = static_cast<uint32_t>(TONE_SECONDS * sampleRate);
+    const uint32_t dataSize = samples * channels * 2;
+
+    std::vector<uint8_t> data;
+    data.reserve(44 + dataSize);
+    data.insert(data.end(), { 'R', 'I', 'F', 'F' });
+    PutLittleEndian(data, 36 + dataSize, 4);
+    data.insert(data.end(), { 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ' });
+    PutLittleEndian(data, 16, 4);
+    PutLittleEndian(data, 1, 2); // PCM
+    PutLittleEndian(data, channels, 2);
+    PutLittleEndian(data, sampleRate, 4);
+    PutLittleEndian(data, sampleRate * channels * 2, 4);
+    PutLittleEndian(data, channels * 2, 2);
+    PutLittleEndian(data, 16, 2);
+    data.insert(data.end(), { 'd', 'a', 't', 'a' });
+    PutLittleEndian(data, dataSize, 4);
+    for (uint32_t i = 0; i < samples; ++i)
+    {
+        for (int channel = 0; channel < channels; ++channel)
+        {
+            const double value = 0.3 * sin(2 * 3.14159265 * 220 * (channel + 1) * i / sampleRate);
+            PutLittleEndian(data, static_cast<uint16_t>(static_cast<int16_t>(value * 32767)), 2);
+        }
+    }
+
+    FILE* out =
+#ifdef _WIN32
+        _wfopen(file.c_str(), L"wb");
+#else
+        fopen(file.c_str(), "wb");
+#endif
+    if (out == nullptr)
+    {
+        return false;
+    }
+    const bool ok = fwrite(data.data(), 1, data.size(), out) == data.size();
+    return (fclose(out) == 0) && ok;
+}
+
+// The decoder's own account of the audio cost, as the properties dialog shows it
+std::string AudioCost(IFrameDecoder& decoder, AudioResult& result)
+{
+    for (const auto& property : decoder.getProperties())
+    {
+        int channels = 0;
+        int sampleRate = 0;
+        if (sscanf(property.c_str(),
+            "Audio %d ch %d Hz: decode %lf%%, resample %lf%%, pitch shift %lf%%, %lfx real time",
+            &channels, &sampleRate, &result.decodePercent, &result.resamplePercent,
+            &result.pitchShiftPercent, &result.realTime) == 6)
+        {
+            return property;
+        }
+    }
+    return "no audio cost reported";
+}
+
+std::string ToJson(const std::vector<AudioResult>& results)
+{
+    std::string result = "{\"audio\": [";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const AudioResult& r = results[i];
+        char buffer[400];
+        snprintf(buffer, sizeof(buffer),
+            "%s\n  {\"channels\": %d, \"sampleRate\": %d, \"pitchShift\": %.2f, \"soundSeconds\": %.3f, "
+            "\"elapsed\": %.3f, \"decodePercent\": %.3f, \"resamplePercent\": %.3f, "
+            "\"pitchShiftPercent\": %.3f, \"realTime\": %.1f}",
+            (i == 0) ? "" : ",", r.channels, r.sampleRate, r.pitchShift, r.written, r.elapsed,
+            r.decodePercent, r.resamplePercent, r.pitchShiftPercent, r.realTime);
+        result += buffer;
+    }
+    result += "\n]}\n";
+    return result;
+}
+
+} // namespace
+
+// audio [<report.json>]: audio only playback into a null sink, as fast as decoding, resampling and pitch
+// shifting go. Generated tones cover mono to 7.1 at 44.1 to 192 kHz, each played as it is and pitch shifted
+// an octave down to an octave up.
+int RunAudio(const std::vector<PathType>& args)
+{
+    const auto directory = boost::filesystem::temp_directory_path()
+        / boost::filesystem::unique_path("ffplayer-audio-%%%%-%%%%");
+    boost::filesystem::create_directory(directory);
+
+    std::vector<AudioResult> results;
+    int failures = 0;
+    for (int channels : CHANNELS)
+    {
+        for (int sampleRate : SAMPLE_RATES)
+        {
+            const auto file = directory
+                / ("tone_" + std::to_string(channels) + "ch_" + std::to_string(sampleRate) + ".wav");
+            if (!WriteTone(file, channels, sampleRate))
+            {
+                std::cerr << "Unable to write " << file.string() << '\n';
+                boost::filesystem::remove_all(directory);
+                return EXIT_FAILURE;
+            }
+
+            for (float pitchShift : PITCH_SHIFTS)
+            {
+                HeadlessListener listener;
+                auto nullPlayer = std::make_unique<NullAudioPlayer>();
+                const NullAudioPlayer& sink = *nullPlayer;
+                auto decoder = GetFrameDecoder(std::make_unique<AudioPitchDecorator>(
+                    std::move(nullPlayer), [pitchShift] { return pitchShift; }));
+                decoder->setFrameListener(&listener);
+                decoder->setDecoderListener(&listener);
+
+                printf("%d ch %6d Hz, pitch %.2f: ", channels, sampleRate, pitchShift);
+                if (!decoder->openFile(file.native()))
+                {
+                    printf("FAILED to open\n");
+                    ++failures;
+                    continue;
+                }
+
+                const auto startTime = boost::chrono::steady_clock::now();
+                decoder->play();
+                if (!listener.waitForEndOfStream(END_TIMEOUT_SECS))
+                {
+                    printf("FAILED to finish\n");
+                    ++failures;
+                    decoder->close();
+                    continue;
+                }
+                const double elapsed = boost::chrono::duration<double>(
+                    boost::chrono::steady_clock::now() - startTime).count();
+
+                // End to end, the wait for the end of the file included
+                AudioResult result{ channels, sampleRate, pitchShift, sink.secondsWritten(), elapsed };
+                const double written = result.written;
+                printf("%.2f s of sound in %.2f s\n    %s\n", written, elapsed, AudioCost(*decoder, result).c_str());
+                results.push_back(result);
+                if (std::abs(written - TONE_SECONDS) > MAX_SOUND_LOST)
+                {
+                    printf("    FAILED, sound lost or added\n");
+                    ++failures;
+                }
+                decoder->close();
+            }
+        }
+    }
+
+    boost::filesystem::remove_all(directory);
+
+    if (!args.empty())
+    {
+        FILE* out =
+#ifdef _WIN32
+            _wfopen(args[0].c_str(), L"w");
+#else
+            fopen(args[0].c_str(), "w");
+#endif
+        if (out == nullptr)
+        {
+            fprintf(stderr, "Unable to write %s\n", ToUtf8(args[0]).c_str());
+            return EXIT_FAILURE;
+        }
+        fputs(ToJson(results).c_str(), out);
+        fclose(out);
+    }
+
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,375 @@
+#include "stdafx.h"
+
+#include "harness.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+#include "fqueue.h"
+#include "interlockedadd.h"
+#include "primitivetimer.h"
+#include "timesource.h"
+#include "videoframe.h"
+#include "vqueue.h"
+
+#include "../Player/CopyAndConvert.h"
+#include "../Player/smbPitchShift.h"
+
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// As the decoder has them
+enum { MAX_QUEUE_SIZE = 15 * 1024 * 1024, MAX_FRAMES = 500 };
+
+enum
+{
+    QUEUE_PACKETS = 1000000,
+    ATOMIC_ADDS = 10000000,
+    CLOCK_READS = 10000000,
+    SAMPLE_RATE = 48000,
+    PITCH_SECONDS = 10,
+    PITCH_BUFFER_SAMPLES = 1024,
+    PITCH_OVERSAMPLING = 16, // as AudioPitchDecorator does it
+    FRAME_WIDTH = 1920,
+    FRAME_HEIGHT = 1080,
+    HANDOFF_FRAMES = 100000,
+    SWAPPED_FRAMES = 1000000,
+    CONVERTED_FRAMES = 200,
+};
+
+const long FFT_SIZES[] = { 512, 1024, 2048, 4096 };
+
+struct BenchResult
+{
+    std::string name;
+    double nsPerOp;
+    std::string unit;
+    int64_t iterations;
+};
+
+double Seconds(boost::chrono::steady_clock::time_point startTime)
+{
+    return boost::chrono::duration<double>(boost::chrono::steady_clock::now() - startTime).count();
+}
+
+// A video packet now and then among audio ones, sizes as found in a typical 1080p file
+std::vector<int> PacketSizes()
+{
+    std::mt19937 random(1);
+    std::uniform_int_distribution<int> videoSize(5 * 1024, 60 * 1024);
+    std::uniform_int_distribution<int> audioSize(300, 1500);
+    std::vector<int> sizes(QUEUE_PACKETS);
+    for (int i = 0; i < QUEUE_PACKETS; ++i)
+    {
+        sizes[i] = (i % 3 == 0) ? videoSize(random) : audioSize(random);
+    }
+    return sizes;
+}
+
+// Sizes only, the queue never looks at the data
+AVPacket MakePacket(int size)
+{
+    AVPacket packet{};
+    packet.size = size;
+    return packet;
+}
+
+double QueueUncontended(const std::vector<int>& sizes)
+{
+    FQueue<MAX_QUEUE_SIZE, MAX_FRAMES> queue;
+    const auto startTime = boost::chrono::steady_clock::now();
+    for (int size : sizes)
+    {
+        queue.push(MakePacket(size), [] { return false; });
+        AVPacket packet;
+        queue.pop(packet);
+    }
+    return Seconds(startTime);
+}
+
+// The demuxer feeding one decoding thread
+double QueueOneToOne(const std::vector<int>& sizes)
+{
+    FQueue<MAX_QUEUE_SIZE, MAX_FRAMES> queue;
+    const auto startTime = boost::chrono::steady_clock::now();
+    boost::thread consumer([&queue, &sizes] {
+        AVPacket packet;
+        for (size_t i = 0; i < sizes.size(); ++i)
+        {
+            queue.pop(packet);
+        }
+    });
+    for (int size : sizes)
+    {
+        queue.push(MakePacket(size), [] { return false; });
+    }
+    consumer.join();
+    return Seconds(startTime);
+}
+
+double AtomicAdds(int threads)
+{
+    boost::atomic<double> clock(0.);
+    const auto startTime = boost::chrono::steady_clock::now();
+    boost::thread_group adders;
+    for (int i = 0; i < threads; ++i)
+    {
+        adders.create_thread([&clock, threads] {
+            for (int j = 0; j < ATOMIC_ADDS / threads; ++j)
+            {
+                InterlockedAdd(clock, 0.001);
+            }
+        });
+    }
+    adders.join_all();
+    return Seconds(startTime);
+}
+
+// What FFmpegDecoder::GetHiResTime() costs: the time source call and the conversion to seconds
+double ClockReads(ITimeSource& timeSource)
+{
+    double sum = 0;
+    const auto startTime = boost::chrono::steady_clock::now();
+    for (int i = 0; i < CLOCK_READS; ++i)
+    {
+        sum += boost::chrono::duration_cast<boost::chrono::microseconds>(
+            timeSource.now().time_since_epoch()).count() / 1000000.;
+    }
+    const double seconds = Seconds(startTime);
+    return (sum != 0) ? seconds : 0; // keeps the loop from being optimized away
+}
+
+const int PITCH_BUFFERS = PITCH_SECONDS * SAMPLE_RATE / PITCH_BUFFER_SAMPLES;
+
+double PitchShift(long fftFrameSize)
+{
+    const auto shifter = std::make_unique<CSmbPitchShift>();
+    std::vector<float> buffer(PITCH_BUFFER_SAMPLES);
+
+    const auto startTime = boost::chrono::steady_clock::now();
+    for (int i = 0; i < PITCH_BUFFERS; ++i)
+    {
+        for (int j = 0; j < PITCH_BUFFER_SAMPLES; ++j)
+        {
+            const double time = static_cast<double>(i * PITCH_BUFFER_SAMPLES + j) / SAMPLE_RATE;
+            buffer[j] = 0.5f * static_cast<float>(sin(2 * 3.14159265 * 440 * time));
+        }
+        shifter->smbPitchShift(1.25f, PITCH_BUFFER_SAMPLES, fftFrameSize, PITCH_OVERSAMPLING, SAMPLE_RATE,
+            buffer.data(), buffer.data());
+    }
+    return Seconds(startTime);
+}
+
+// A 1080p frame as the decoder hands them out, luma and chroma ramps
+AVFramePtr MakeFrame()
+{
+    AVFramePtr frame(av_frame_alloc());
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = FRAME_WIDTH;
+    frame->height = FRAME_HEIGHT;
+    av_frame_get_buffer(frame.get(), 64);
+    for (int plane = 0; plane < 3; ++plane)
+    {
+        const int height = (plane == 0) ? FRAME_HEIGHT : FRAME_HEIGHT / 2;
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < frame->linesize[plane]; ++x)
+            {
+                frame->data[plane][y * frame->linesize[plane] + x] = static_cast<uint8_t>(x + y + plane * 64);
+            }
+        }
+    }
+    return frame;
+}
+
+// Video parsing thread to display thread, locked and signalled the way FFmpegDecoder does it
+// with m_videoFramesMutex and m_videoFramesCV; frames arrive in the display format already.
+double FrameHandoff()
+{
+    VQueue queue;
+    boost::mutex mutex;
+    boost::condition_variable condVar;
+    SwsContext* convertContext = nullptr;
+    auto decoded = MakeFrame();
+    double displayed = 0;
+
+    const auto startTime = boost::chrono::steady_clock::now();
+    boost::thread display([&] {
+        for (int i = 0; i < HANDOFF_FRAMES; ++i)
+        {
+            {
+                boost::unique_lock<boost::mutex> locker(mutex);
+                condVar.wait(locker, [&queue] { return queue.canPop(); });
+            }
+            displayed += queue.front().m_pts;
+            {
+                boost::lock_guard<boost::mutex> locker(mutex);
+                queue.popFront();
+            }
+            condVar.notify_all();
+        }
+    });
+    for (int i = 0; i < HANDOFF_FRAMES; ++i)
+    {
+        {
+            boost::unique_lock<boost::mutex> locker(mutex);
+            condVar.wait(locker, [&queue] { return queue.canPush(); });
+        }
+        VideoFrame& frame = queue.back();
+        frameToImage(frame, decoded, convertContext, AV_PIX_FMT_YUV420P);
+        frame.m_pts = i / 25.;
+        {
+            boost::lock_guard<boost::mutex> locker(mutex);
+            queue.pushBack();
+        }
+        condVar.notify_all();
+    }
+    display.join();
+    const double seconds = Seconds(startTime);
+
+    sws_freeContext(convertContext);
+    return (displayed != 0) ? seconds : 0;
+}
+
+double FrameToImage(AVPixelFormat pixelFormat, int frames)
+{
+    VideoFrame frame;
+    SwsContext* convertContext = nullptr;
+    auto decoded = MakeFrame();
+
+    const auto startTime = boost::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i)
+    {
+        frameToImage(frame, decoded, convertContext, pixelFormat);
+    }
+    const double seconds = Seconds(startTime);
+
+    sws_freeContext(convertContext);
+    return seconds;
+}
+
+// YUV420P to the YUY2 surface, row pair by row pair as CPlayerView::updateFrame() does it
+double CopyAndConvertFrames()
+{
+    const auto source = MakeFrame();
+    VideoFrame target;
+    target.realloc(AV_PIX_FMT_YUYV422, FRAME_WIDTH, FRAME_HEIGHT);
+    const AVFrame& image = *target.m_image;
+
+    const auto startTime = boost::chrono::steady_clock::now();
+    for (int frame = 0; frame < CONVERTED_FRAMES; ++frame)
+    {
+        for (int i = 0; i < FRAME_HEIGHT / 2; ++i)
+        {
+            CopyAndConvert(
+                (uint32_t*)(image.data[0] + image.linesize[0] * 2 * i),
+                (uint32_t*)(image.data[0] + image.linesize[0] * (2 * i + 1)),
+                source->data[0] + source->linesize[0] * 2 * i,
+                source->data[0] + source->linesize[0] * (2 * i + 1),
+                source->data[1] + source->linesize[1] * i,
+                source->data[2] + source->linesize[2] * i,
+                FRAME_WIDTH / 2);
+        }
+    }
+    return Seconds(startTime);
+}
+
+#ifdef PRIMITIVE_TIMING
+const bool PRIMITIVE_TIMING_ON = true;
+#else
+const bool PRIMITIVE_TIMING_ON = false;
+#endif
+
+std::string ToJson(const std::vector<BenchResult>& results)
+{
+    std::string result = std::string("{\"primitiveTiming\": ") + (PRIMITIVE_TIMING_ON ? "true" : "false")
+        + ", \"bench\": [";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        char buffer[200];
+        snprintf(buffer, sizeof(buffer),
+            "%s\n  {\"name\": \"%s\", \"ns\": %.3f, \"per\": \"%s\", \"iterations\": %lld}",
+            (i == 0) ? "" : ",", results[i].name.c_str(), results[i].nsPerOp, results[i].unit.c_str(),
+            static_cast<long long>(results[i].iterations));
+        result += buffer;
+    }
+    result += "\n]}\n";
+    return result;
+}
+
+} // namespace
+
+// bench [<report.json>]: the primitives the pipeline is built of, each timed in isolation.
+// PRIMITIVE_TIMING is off as the player ships, and then no clock reads are added to what is measured.
+int RunBench(const std::vector<PathType>& args)
+{
+    printf(PRIMITIVE_TIMING_ON
+        ? "PRIMITIVE_TIMING is on, the queue and frame figures include its clock reads\n"
+        : "PRIMITIVE_TIMING is off, as in a release build\n");
+
+    std::vector<BenchResult> results;
+    const auto add = [&results](const std::string& name, double seconds, int64_t count, const char* unit)
+    {
+        results.push_back({ name, seconds * 1e9 / count, unit, count });
+        printf("%-28s %12.1f ns per %s, %lld timed\n", name.c_str(), results.back().nsPerOp, unit,
+            static_cast<long long>(count));
+    };
+
+    const auto sizes = PacketSizes();
+    add("fqueue uncontended", QueueUncontended(sizes), QUEUE_PACKETS, "packet");
+    add("fqueue 1:1", QueueOneToOne(sizes), QUEUE_PACKETS, "packet");
+
+    add("InterlockedAdd uncontended", AtomicAdds(1), ATOMIC_ADDS, "add");
+    add("InterlockedAdd 2 threads", AtomicAdds(2), ATOMIC_ADDS, "add");
+
+    add("GetHiResTime", ClockReads(*GetSystemTimeSource()), CLOCK_READS, "read");
+
+    for (long fftFrameSize : FFT_SIZES)
+    {
+        const double seconds = PitchShift(fftFrameSize);
+        add("smbPitchShift fft " + std::to_string(fftFrameSize), seconds,
+            PITCH_BUFFERS * PITCH_BUFFER_SAMPLES, "sample");
+        printf("%-28s %12.1fx real time\n", "", PITCH_SECONDS / seconds);
+    }
+
+    add("VQueue hand-off 1080p", FrameHandoff(), HANDOFF_FRAMES, "frame");
+    add("frameToImage 1080p as is", FrameToImage(AV_PIX_FMT_YUV420P, SWAPPED_FRAMES), SWAPPED_FRAMES, "frame");
+    add("frameToImage 1080p to YUYV", FrameToImage(AV_PIX_FMT_YUYV422, CONVERTED_FRAMES), CONVERTED_FRAMES,
+        "frame");
+    add("CopyAndConvert 1080p", CopyAndConvertFrames(), CONVERTED_FRAMES, "frame");
+
+    if (!args.empty())
+    {
+        FILE* out =
+#ifdef _WIN32
+            _wfopen(args[0].c_str(), L"w");
+#else
+            fopen(args[0].c_str(), "w");
+#endif
+        if (out == nullptr)
+        {
+            fprintf(stderr, "Unable to write %s\n", ToUtf8(args[0]).c_str());
+            return EXIT_FAILURE;
+        }
+        fputs(ToJson(results).c_str(), out);
+        fclose(out);
+    }
+
+    return EXIT_SUCCESS;
+}
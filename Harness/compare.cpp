@@ -0,0 +1,24 @@
+#include "stdafx.h"
+
+#include "harness.h"
+
+#include "framecomparator.h"
+
+#include <iostream>
+
+// compare <reference> <distorted> <csv>: per frame luma PSNR and 8x8 block SSIM of an encode against its source
+int RunCompare(const std::vector<PathType>& args)
+{
+    FrameComparator comparator;
+    if (!comparator.open(ToUtf8(args[0]), ToUtf8(args[1])))
+    {
+        std::cerr << "Unable to open the sources\n";
+        return EXIT_FAILURE;
+    }
+    if (!comparator.writeCsv(args[2]))
+    {
+        std::cerr << "Unable to write the CSV file\n";
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
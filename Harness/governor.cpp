@@ -0,0 +1,105 @@
+#include "stdafx.h"
+
+#include "harness.h"
+
+#include "decodegovernor.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace {
+
+// Longer than the governor waits between two changes
+const double STEP = 1.1;
+const double START_TIME = 1000.;
+
+enum { BUSY_STEPS = 10, CALM_STEPS = 40 };
+
+const double BUSY_LOAD = 0.95;
+const double CALM_LOAD = 0.3;
+const double DROPPING = 0.1;
+
+} // namespace
+
+// governor: two players, one focused and one in the background, as the processes they would be:
+// each attaches its own DecodeGovernor to one shared table. The clock is simulated.
+int RunGovernor(const std::vector<PathType>& /*args*/)
+{
+    int failures = 0;
+    const auto check = [&failures](bool ok, const std::string& what)
+    {
+        std::cout << (ok ? "ok      " : "FAILED  ") << what << '\n';
+        failures += ok ? 0 : 1;
+    };
+
+    // Not the player's table, players running meanwhile are left alone
+    const std::string sharedName = "FFPlayerHarnessGovernor" + std::to_string(std::random_device()());
+    int focused = -1;
+    int background = -1;
+    {
+        DecodeGovernor focusedProcess(sharedName.c_str());
+        DecodeGovernor backgroundProcess(sharedName.c_str());
+
+        focused = focusedProcess.registerDecoder();
+        background = backgroundProcess.registerDecoder();
+        check(focused >= 0 && background >= 0 && focused != background, "both clients registered");
+
+        focusedProcess.setPriority(focused, 1);
+        check(backgroundProcess.priority(focused) == 1, "priority visible to the other process");
+
+        double now = START_TIME;
+        DecodeQuality focusedQuality = DECODE_QUALITY_FULL;
+        DecodeQuality backgroundQuality = DECODE_QUALITY_FULL;
+        const auto step = [&](double focusedLoad, double focusedLag, double backgroundLoad)
+        {
+            now += STEP;
+            focusedQuality = focusedProcess.report(focused, focusedLoad, focusedLag, now);
+            backgroundQuality = backgroundProcess.report(background, backgroundLoad, 0, now + 0.01);
+        };
+
+        // Both busy, the focused one keeps up
+        for (int i = 0; i < BUSY_STEPS; ++i)
+        {
+            step(BUSY_LOAD, 0, BUSY_LOAD);
+        }
+        printf("Busy: focused %s, background %s\n",
+            DecodeQualityName(focusedQuality), DecodeQualityName(backgroundQuality));
+        check(backgroundQuality == DECODE_QUALITY_KEYFRAMES_ONLY, "background degraded to keyframes only");
+        check(focusedQuality == DECODE_QUALITY_FULL, "focused kept at full quality");
+
+        // The focused one drops frames, the background has nothing left to give
+        for (int i = 0; i < BUSY_STEPS; ++i)
+        {
+            step(BUSY_LOAD, DROPPING, BUSY_LOAD);
+        }
+        printf("Dropping: focused %s, background %s\n",
+            DecodeQualityName(focusedQuality), DecodeQualityName(backgroundQuality));
+        check(focusedQuality == DECODE_QUALITY_NO_NONREF, "focused degraded, but not to keyframes only");
+
+        // Calm again, quality comes back to the focused one first
+        bool focusedFirst = true;
+        for (int i = 0; i < CALM_STEPS; ++i)
+        {
+            const DecodeQuality backgroundBefore = backgroundQuality;
+            step(CALM_LOAD, 0, CALM_LOAD);
+            if (backgroundQuality < backgroundBefore && focusedQuality != DECODE_QUALITY_FULL)
+            {
+                focusedFirst = false;
+            }
+        }
+        printf("Calm: focused %s, background %s\n",
+            DecodeQualityName(focusedQuality), DecodeQualityName(backgroundQuality));
+        check(focusedFirst, "focused restored before the background");
+        check(focusedQuality == DECODE_QUALITY_FULL && backgroundQuality == DECODE_QUALITY_FULL,
+            "both restored to full quality");
+
+        focusedProcess.unregisterDecoder(focused);
+        backgroundProcess.unregisterDecoder(background);
+    }
+    DecodeGovernor::Remove(sharedName.c_str());
+
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "decoderinterface.h"
+#include "utf8.h"
+
+#include <string>
+#include <vector>
+
+// Each mode gets the arguments following its name, at least the required ones, and returns the exit code
+typedef int (*HarnessMode)(const std::vector<PathType>& args);
+
+int RunCompare(const std::vector<PathType>& args);
+int RunSeeks(const std::vector<PathType>& args);
+int RunRead(const std::vector<PathType>& args);
+int RunHttp(const std::vector<PathType>& args);
+int RunStress(const std::vector<PathType>& args);
+int RunPacing(const std::vector<PathType>& args);
+int RunBench(const std::vector<PathType>& args);
+int RunAudio(const std::vector<PathType>& args);
+int RunGovernor(const std::vector<PathType>& args);
+int RunAnalyze(const std::vector<PathType>& args);
@@ -0,0 +1,145 @@
+#include "stdafx.h"
+
+#include "headless.h"
+
+#include "interlockedadd.h"
+#include "timesource.h"
+
+#include <algorithm>
+
+namespace {
+
+boost::chrono::duration<double> ToDuration(double seconds)
+{
+    return boost::chrono::duration<double>(seconds);
+}
+
+} // namespace
+
+NullAudioPlayer::NullAudioPlayer(std::shared_ptr<ITimeSource> timeSource)
+    : m_timeSource(std::move(timeSource))
+    , m_bufferedUntil(boost::chrono::high_resolution_clock::duration::zero())
+{
+}
+
+void NullAudioPlayer::WaveOutReset()
+{
+    m_bufferedUntil = boost::chrono::high_resolution_clock::duration::zero();
+}
+
+bool NullAudioPlayer::Open(int bytesPerSample, int channels, int* samplesPerSec)
+{
+    m_frameSize = bytesPerSample * channels;
+    m_samplesPerSec = *samplesPerSec;
+    m_bufferedUntil = boost::chrono::high_resolution_clock::duration::zero();
+    return m_frameSize > 0 && m_samplesPerSec > 0;
+}
+
+void NullAudioPlayer::Reset()
+{
+    WaveOutReset();
+}
+
+bool NullAudioPlayer::WriteAudio(uint8_t* /*write_data*/, int64_t write_size)
+{
+    const int64_t frames = (m_frameSize > 0) ? write_size / m_frameSize : 0;
+    if (frames == 0)
+    {
+        return true;
+    }
+    const double seconds = static_cast<double>(frames) / m_samplesPerSec;
+
+    if (m_timeSource)
+    {
+        // Like a device buffer draining: the next write waits for the previous one to be played
+        const auto now = m_timeSource->now().time_since_epoch();
+        const auto bufferedUntil = std::max(m_bufferedUntil.load(), now)
+            + boost::chrono::duration_cast<boost::chrono::high_resolution_clock::duration>(ToDuration(seconds));
+        m_bufferedUntil = bufferedUntil;
+        m_timeSource->sleepFor(bufferedUntil - now);
+    }
+
+    if (m_callback != nullptr)
+    {
+        m_callback->AppendFrameClock(seconds);
+    }
+    InterlockedAdd(m_secondsWritten, seconds);
+    return true;
+}
+
+void HeadlessListener::drawFrame(IFrameDecoder* decoder, unsigned int generation)
+{
+    ++m_framesDrawn;
+    {
+        boost::lock_guard<boost::mutex> locker(m_mutex);
+        if (m_seekState == SEEK_POSITIONED)
+        {
+            m_seekState = SEEK_PRESENTED;
+        }
+    }
+    m_condVar.notify_all();
+
+    decoder->finishedDisplayingFrame(generation);
+}
+
+void HeadlessListener::changedFramePosition(long long /*start*/, long long /*frame*/, long long /*total*/)
+{
+    boost::lock_guard<boost::mutex> locker(m_mutex);
+    if (m_seekState == SEEK_REQUESTED)
+    {
+        m_seekState = SEEK_POSITIONED; // frames before this are from the old position
+    }
+}
+
+void HeadlessListener::onEndOfStream()
+{
+    {
+        boost::lock_guard<boost::mutex> locker(m_mutex);
+        m_endOfStream = true;
+    }
+    m_condVar.notify_all();
+}
+
+void HeadlessListener::streamAnalyzed()
+{
+    {
+        boost::lock_guard<boost::mutex> locker(m_mutex);
+        m_streamAnalyzed = true;
+    }
+    m_condVar.notify_all();
+}
+
+void HeadlessListener::expectSeek()
+{
+    boost::lock_guard<boost::mutex> locker(m_mutex);
+    m_seekState = SEEK_REQUESTED;
+    m_endOfStream = false;
+}
+
+bool HeadlessListener::waitForSeek(double timeoutSecs)
+{
+    boost::unique_lock<boost::mutex> locker(m_mutex);
+    const bool presented = m_condVar.wait_for(locker, ToDuration(timeoutSecs),
+        [this] { return m_seekState == SEEK_PRESENTED; });
+    m_seekState = SEEK_NONE;
+    return presented;
+}
+
+bool HeadlessListener::waitForFrames(int64_t count, double timeoutSecs)
+{
+    boost::unique_lock<boost::mutex> locker(m_mutex);
+    return m_condVar.wait_for(locker, ToDuration(timeoutSecs),
+        [this, count] { return m_framesDrawn >= count; });
+}
+
+bool HeadlessListener::waitForEndOfStream(double timeoutSecs)
+{
+    boost::unique_lock<boost::mutex> locker(m_mutex);
+    return m_condVar.wait_for(locker, ToDuration(timeoutSecs), [this] { return m_endOfStream.load(); });
+}
+
+bool HeadlessListener::waitForAnalysis(double timeoutSecs)
+{
+    boost::unique_lock<boost::mutex> locker(m_mutex);
+    return m_condVar.wait_for(locker, ToDuration(timeoutSecs), [this] { return m_streamAnalyzed.load(); });
+}
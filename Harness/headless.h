@@ -0,0 +1,85 @@
+#pragma once
+
+#include "audioplayer.h"
+#include "decoderinterface.h"
+
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <memory>
+
+struct ITimeSource;
+
+// Stands in for the sound card: takes samples at the pace of the time source, or at once without one
+class NullAudioPlayer : public IAudioPlayer
+{
+public:
+    explicit NullAudioPlayer(std::shared_ptr<ITimeSource> timeSource = nullptr);
+
+    void SetCallback(IAudioPlayerCallback* callback) override { m_callback = callback; }
+
+    void InitializeThread() override {}
+    void DeinitializeThread() override {}
+
+    void WaveOutReset() override;
+    void Close() override {}
+    bool Open(int bytesPerSample, int channels, int* samplesPerSec) override;
+    void Reset() override;
+
+    void SetVolume(double volume) override { m_volume = volume; }
+    double GetVolume() const override { return m_volume; }
+
+    void WaveOutPause() override {}
+    void WaveOutRestart() override {}
+
+    bool WriteAudio(uint8_t* write_data, int64_t write_size) override;
+
+    // Sound taken so far
+    double secondsWritten() const { return m_secondsWritten; }
+
+private:
+    std::shared_ptr<ITimeSource> m_timeSource;
+    IAudioPlayerCallback* m_callback = nullptr;
+    int m_frameSize = 0;
+    int m_samplesPerSec = 0;
+    boost::atomic<double> m_volume{ 1. };
+    boost::atomic<double> m_secondsWritten{ 0. };
+    boost::atomic<boost::chrono::high_resolution_clock::duration> m_bufferedUntil; // keeps pacing from drifting
+};
+
+// Presents frames as soon as they are due, for the view and the document both
+class HeadlessListener : public IFrameListener, public FrameDecoderListener
+{
+public:
+    void updateFrame() override {}
+    void drawFrame(IFrameDecoder* decoder, unsigned int generation) override;
+    void decoderClosing() override {}
+
+    void changedFramePosition(long long start, long long frame, long long total) override;
+    void onEndOfStream() override;
+    void streamAnalyzed() override;
+
+    // Call before the seek, waitForSeek() then returns once a frame after the new position is presented
+    void expectSeek();
+    bool waitForSeek(double timeoutSecs);
+
+    // False on timeout
+    bool waitForFrames(int64_t count, double timeoutSecs);
+    bool waitForEndOfStream(double timeoutSecs);
+    bool waitForAnalysis(double timeoutSecs);
+
+    int64_t framesDrawn() const { return m_framesDrawn; }
+    bool endOfStream() const { return m_endOfStream; }
+
+private:
+    enum SeekState { SEEK_NONE, SEEK_REQUESTED, SEEK_POSITIONED, SEEK_PRESENTED };
+
+    boost::mutex m_mutex;
+    boost::condition_variable m_condVar;
+    SeekState m_seekState = SEEK_NONE;
+    boost::atomic_int64_t m_framesDrawn{ 0 };
+    boost::atomic_bool m_endOfStream{ false };
+    boost::atomic_bool m_streamAnalyzed{ false };
+};
@@ -0,0 +1,379 @@
+#include "stdafx.h"
+
+#include "harness.h"
+
+#include "http_client.h"
+
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#pragma comment(lib, "Ws2_32")
+
+namespace {
+
+enum
+{
+    BODY_SIZE = 1024 * 1024,
+    SEQUENTIAL_REQUESTS = 20,
+    CLIENT_THREADS = 8,
+    REQUESTS_PER_THREAD = 10,
+    ASYNC_REQUESTS = 8 * HttpClient::ASYNC_THREADS,
+    ASYNC_RANGE_SIZE = 1000,
+};
+
+// Serves one fixed body on the loopback interface: GET, HEAD and single byte ranges, keeping connections alive
+class StandInServer
+{
+public:
+    explicit StandInServer(std::string body) : m_body(std::move(body)) {}
+    ~StandInServer();
+    StandInServer(const StandInServer&) = delete;
+    StandInServer& operator=(const StandInServer&) = delete;
+
+    bool start();
+
+    unsigned short port() const { return m_port; }
+    // Accepted so far, requests on kept alive connections do not add to it
+    int connections() const { return m_connections; }
+
+private:
+    void acceptRunnable();
+    void serve(SOCKET client);
+    bool respond(SOCKET client, const std::string& request);
+
+    const std::string m_body;
+    SOCKET m_listener = INVALID_SOCKET;
+    unsigned short m_port = 0;
+    std::atomic<int> m_connections{ 0 };
+
+    std::unique_ptr<boost::thread> m_acceptThread;
+    std::mutex m_mutex;
+    std::vector<SOCKET> m_clients;
+    boost::thread_group m_clientThreads;
+};
+
+StandInServer::~StandInServer()
+{
+    // Blocked accept() and recv() calls return once their sockets are gone
+    if (m_listener != INVALID_SOCKET)
+    {
+        closesocket(m_listener);
+    }
+    if (m_acceptThread)
+    {
+        m_acceptThread->join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (SOCKET client : m_clients)
+        {
+            shutdown(client, SD_BOTH);
+        }
+    }
+    m_clientThreads.join_all();
+}
+
+bool StandInServer::start()
+{
+    m_listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (m_listener == INVALID_SOCKET)
+    {
+        return false;
+    }
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0; // any free one
+    int length = sizeof(address);
+    if (bind(m_listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+        || listen(m_listener, SOMAXCONN) != 0
+        || getsockname(m_listener, reinterpret_cast<sockaddr*>(&address), &length) != 0)
+    {
+        return false;
+    }
+    m_port = ntohs(address.sin_port);
+
+    m_acceptThread = std::make_unique<boost::thread>(&StandInServer::acceptRunnable, this);
+    return true;
+}
+
+void StandInServer::acceptRunnable()
+{
+    for (;;)
+    {
+        const SOCKET client = accept(m_listener, nullptr, nullptr);
+        if (client == INVALID_SOCKET)
+        {
+            return;
+        }
+        ++m_connections;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_clients.push_back(client);
+        }
+        m_clientThreads.create_thread([this, client] { serve(client); });
+    }
+}
+
+void StandInServer::serve(SOCKET client)
+{
+    std::string received;
+    char buffer[4096];
+    for (;;)
+    {
+        const size_t end = received.find("\r\n\r\n");
+        if (end != std::string::npos)
+        {
+            // Requests carry no body
+            const std::string request = received.substr(0, end);
+            received.erase(0, end + 4);
+            if (!respond(client, request))
+            {
+                break;
+            }
+            continue;
+        }
+
+        const int length = recv(client, buffer, sizeof(buffer), 0);
+        if (length <= 0)
+        {
+            break;
+        }
+        received.append(buffer, length);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_clients.erase(std::find(m_clients.begin(), m_clients.end(), client));
+    closesocket(client);
+}
+
+bool StandInServer::respond(SOCKET client, const std::string& request)
+{
+    const bool head = request.compare(0, 5, "HEAD ") == 0;
+    const size_t pathBegin = request.find(' ') + 1;
+    const std::string path = request.substr(pathBegin, request.find(' ', pathBegin) - pathBegin);
+
+    std::string lowered(request);
+    std::transform(lowered.begin(), lowered.end(), lowered.begin(),
+        [](char ch) { return static_cast<char>(tolower(static_cast<unsigned char>(ch))); });
+    const size_t range = lowered.find("\r\nrange: bytes=");
+
+    std::string headers;
+    size_t begin = 0;
+    size_t end = m_body.size();
+    if (path != "/media")
+    {
+        headers = "HTTP/1.1 404 Not Found\r\n";
+        end = 0;
+    }
+    else if (range != std::string::npos)
+    {
+        const char* spec = request.c_str() + range + strlen("\r\nrange: bytes=");
+        char* next = nullptr;
+        begin = strtoul(spec, &next, 10);
+        if (*next == '-' && isdigit(static_cast<unsigned char>(next[1])))
+        {
+            end = std::min<size_t>(strtoul(next + 1, nullptr, 10) + 1, m_body.size());
+        }
+        if (begin >= end)
+        {
+            headers = "HTTP/1.1 416 Range Not Satisfiable\r\n";
+            begin = end = 0;
+        }
+        else
+        {
+            headers = "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes " + std::to_string(begin) + '-'
+                + std::to_string(end - 1) + '/' + std::to_string(m_body.size()) + "\r\n";
+        }
+    }
+    else
+    {
+        headers = "HTTP/1.1 200 OK\r\n";
+    }
+    headers += "Content-Length: " + std::to_string(end - begin) + "\r\nAccept-Ranges: bytes\r\n\r\n";
+
+    std::string response = headers;
+    if (!head)
+    {
+        response.append(m_body, begin, end - begin);
+    }
+    for (size_t sent = 0; sent < response.size();)
+    {
+        const int length = send(client, response.c_str() + sent,
+            static_cast<int>(std::min<size_t>(response.size() - sent, 1 << 20)), 0);
+        if (length <= 0)
+        {
+            return false;
+        }
+        sent += length;
+    }
+    return true;
+}
+
+// A port nobody listens on, as far as this process can tell
+unsigned short GetClosedPort()
+{
+    const SOCKET probe = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int length = sizeof(address);
+    bind(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    getsockname(probe, reinterpret_cast<sockaddr*>(&address), &length);
+    closesocket(probe);
+    return ntohs(address.sin_port);
+}
+
+} // namespace
+
+// http: HttpClient against a stand-in server on the loopback interface, no network needed
+int RunHttp(const std::vector<PathType>& /*args*/)
+{
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    {
+        std::cerr << "Winsock is not available\n";
+        return EXIT_FAILURE;
+    }
+
+    std::string body(BODY_SIZE, '\0');
+    for (size_t i = 0; i < body.size(); ++i)
+    {
+        body[i] = static_cast<char>(i * 31 % 251);
+    }
+
+    int failures = 0;
+    const auto check = [&failures](bool ok, const char* what)
+    {
+        std::cout << (ok ? "ok      " : "FAILED  ") << what << '\n';
+        failures += ok ? 0 : 1;
+    };
+
+    {
+        StandInServer server(body);
+        if (!server.start())
+        {
+            std::cerr << "Unable to start the stand-in server\n";
+            WSACleanup();
+            return EXIT_FAILURE;
+        }
+
+        HttpClient& client = HttpClient::Instance();
+        const auto urlOf = [](const StandInServer& host)
+        {
+            return "http://127.0.0.1:" + std::to_string(host.port()) + "/media";
+        };
+        const std::string url = urlOf(server);
+
+        const auto response = client.get(url);
+        check(response.status == 200 && response.contentLength == BODY_SIZE && response.body == body,
+            "GET returns the whole body");
+
+        const auto headResponse = client.head(url);
+        check(headResponse.status == 200 && headResponse.contentLength == BODY_SIZE && headResponse.body.empty(),
+            "HEAD returns the length only");
+
+        HttpRequest request;
+        request.url = url;
+        request.rangeBegin = 1000;
+        request.rangeEnd = 1999;
+        const auto rangeResponse = client.send(request);
+        check(rangeResponse.status == 206 && rangeResponse.body == body.substr(1000, 1000),
+            "Closed range returns the bytes asked for");
+
+        request.rangeBegin = BODY_SIZE - 100;
+        request.rangeEnd = -1;
+        const auto tailResponse = client.send(request);
+        check(tailResponse.status == 206 && tailResponse.body == body.substr(BODY_SIZE - 100),
+            "Open ended range returns the tail");
+
+        check(client.get("http://127.0.0.1:" + std::to_string(server.port()) + "/missing").status == 404,
+            "Missing resource returns 404");
+
+        size_t streamed = 0;
+        HttpRequest streamRequest;
+        streamRequest.url = url;
+        streamRequest.onData = [&streamed](const char*, size_t size) { streamed += size; return false; };
+        const auto streamResponse = client.send(streamRequest);
+        check(streamResponse.status == 200 && streamed > 0 && streamed < BODY_SIZE && streamResponse.body.empty(),
+            "Data callback stops the transfer");
+
+        // Connections go back to the pool once a body is read to the end
+        const int connectionsBefore = server.connections();
+        bool sequentialOk = true;
+        for (int i = 0; i < SEQUENTIAL_REQUESTS; ++i)
+        {
+            sequentialOk = client.get(url).body == body && sequentialOk;
+        }
+        check(sequentialOk && server.connections() - connectionsBefore <= 1,
+            "Sequential requests share a kept alive connection");
+
+        std::atomic<int> concurrentFailures{ 0 };
+        boost::thread_group clients;
+        for (int i = 0; i < CLIENT_THREADS; ++i)
+        {
+            clients.create_thread([&] {
+                for (int j = 0; j < REQUESTS_PER_THREAD; ++j)
+                {
+                    if (HttpClient::Instance().get(url).body != body)
+                    {
+                        ++concurrentFailures;
+                    }
+                }
+            });
+        }
+        clients.join_all();
+        check(concurrentFailures == 0, "Concurrent requests from several threads");
+
+        // Queued all at once, far more than there are worker threads
+        std::vector<std::future<HttpResponse>> futures;
+        for (int i = 0; i < ASYNC_REQUESTS; ++i)
+        {
+            HttpRequest asyncRequest;
+            asyncRequest.url = url;
+            asyncRequest.rangeBegin = i * ASYNC_RANGE_SIZE;
+            asyncRequest.rangeEnd = (i + 1) * ASYNC_RANGE_SIZE - 1;
+            futures.push_back(client.sendAsync(std::move(asyncRequest)));
+        }
+        bool asyncOk = true;
+        for (int i = 0; i < ASYNC_REQUESTS; ++i)
+        {
+            const auto asyncResponse = futures[i].get();
+            asyncOk = asyncResponse.status == 206
+                && asyncResponse.body == body.substr(i * ASYNC_RANGE_SIZE, ASYNC_RANGE_SIZE) && asyncOk;
+        }
+        check(asyncOk, "Concurrent futures complete on the worker pool");
+
+        // One host more than the pool keeps, the least recently used one is dropped
+        std::vector<std::unique_ptr<StandInServer>> hosts;
+        bool hostsOk = true;
+        for (int i = 0; i <= HttpClient::MAX_CONNECTIONS; ++i)
+        {
+            hosts.push_back(std::make_unique<StandInServer>(body));
+            hostsOk = hosts.back()->start() && client.head(urlOf(*hosts.back())).status == 200 && hostsOk;
+        }
+        check(hostsOk && client.connections() == HttpClient::MAX_CONNECTIONS, "Connection pool is capped");
+        check(client.get(url).body == body, "Dropped host is connected again");
+    }
+
+    check(HttpClient::Instance().get("http://127.0.0.1:" + std::to_string(GetClosedPort()) + "/media").status == 0,
+        "Refused connection returns status 0");
+
+    WSACleanup();
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,129 @@
+#include "stdafx.h"
+
+#include "harness.h"
+#include "headless.h"
+
+#include "timesource.h"
+
+#include <boost/thread/thread.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace {
+
+// Display and video decoding threads, the one driving the simulation, the audio one if any
+enum { PACING_THREADS = 3, RUNS = 2, STALL_TIMEOUT_SECS = 60 };
+
+// Off any frame boundary, so that nothing else is due at the very moment the run ends
+const auto RUN_END_OFFSET = boost::chrono::microseconds(500);
+
+const double MAX_POSITION_DRIFT = 0.25;
+
+struct PacingResult
+{
+    bool completed = false;
+    int64_t framesDrawn = 0;
+    int lateFrames = -1;
+    double position = 0;
+};
+
+PacingResult Play(const PathType& file, double seconds)
+{
+    PacingResult result;
+
+    auto timeSource = std::make_shared<SimulatedTimeSource>();
+    HeadlessListener listener;
+    auto decoder = GetFrameDecoder(std::make_unique<NullAudioPlayer>(timeSource), timeSource);
+    decoder->setFrameListener(&listener);
+    decoder->setDecoderListener(&listener);
+    if (!decoder->openFile(file))
+    {
+        return result;
+    }
+    timeSource->setParticipants(PACING_THREADS + ((decoder->getNumAudioTracks() > 0) ? 1 : 0));
+
+    boost::mutex mutex;
+    boost::condition_variable condVar;
+    bool done = false;
+    boost::thread driver([&] {
+        timeSource->sleepFor(boost::chrono::duration_cast<ITimeSource::Duration>(
+            boost::chrono::duration<double>(seconds)) + RUN_END_OFFSET);
+        {
+            boost::lock_guard<boost::mutex> locker(mutex);
+            done = true;
+        }
+        condVar.notify_all();
+    });
+
+    decoder->play();
+    {
+        // A participant blocked for good holds the simulated clock, and the end of the file does that too
+        boost::unique_lock<boost::mutex> locker(mutex);
+        result.completed = condVar.wait_for(locker, boost::chrono::seconds(STALL_TIMEOUT_SECS),
+            [&done] { return done; });
+    }
+
+    // The clock stands still from here on, nothing is due any more
+    result.framesDrawn = listener.framesDrawn();
+    for (const auto& property : decoder->getProperties())
+    {
+        sscanf(property.c_str(), "Late frames: %d", &result.lateFrames);
+    }
+    const auto position = decoder->getPlaybackPosition();
+    result.position = decoder->getDurationSecs(position.frame - position.start);
+
+    decoder->close();
+    driver.interrupt();
+    driver.join();
+    return result;
+}
+
+} // namespace
+
+// pacing <file> [<seconds>]: plays on a simulated clock, which jumps ahead whenever all pacing threads wait.
+// However slow the machine, nothing is late and the outcome is the same on every run.
+int RunPacing(const std::vector<PathType>& args)
+{
+    const double seconds = (args.size() > 1) ? std::stod(args[1]) : 10.;
+
+    int failures = 0;
+    const auto check = [&failures](bool ok, const std::string& what)
+    {
+        std::cout << (ok ? "ok      " : "FAILED  ") << what << '\n';
+        failures += ok ? 0 : 1;
+    };
+
+    PacingResult first;
+    for (int run = 0; run < RUNS; ++run)
+    {
+        const auto result = Play(args[0], seconds);
+        const std::string label = "Run " + std::to_string(run + 1) + ": ";
+        if (!result.completed)
+        {
+            check(false, label + "simulated playback stalled or the file is shorter than the run");
+            return EXIT_FAILURE;
+        }
+
+        std::cout << label << result.framesDrawn << " frames presented in " << seconds
+            << " simulated s, position " << result.position << " s\n";
+        check(result.framesDrawn > 0, label + "frames are presented");
+        check(result.lateFrames == 0, label + "no frame is late or dropped");
+        check(std::abs(result.position - seconds) < MAX_POSITION_DRIFT, label + "position follows the clock");
+
+        if (run == 0)
+        {
+            first = result;
+        }
+        else
+        {
+            check(result.framesDrawn == first.framesDrawn && result.lateFrames == first.lateFrames,
+                label + "same frames as the first run");
+        }
+    }
+
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
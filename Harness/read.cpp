@@ -0,0 +1,153 @@
+#include "stdafx.h"
+
+#include "harness.h"
+
+#include "filereader.h"
+
+#include <boost/chrono.hpp>
+
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#ifdef _WIN32
+#include <share.h>
+#endif
+
+namespace {
+
+// What the player's AVIO context asks for at a time
+enum { READ_SIZE = 64 * 1024 };
+
+// A probe read after a seek, as the demuxer does when it resyncs
+enum { SEEKS = 2000, SEEK_READ_SIZE = 4096 };
+
+// Bytes per second, negative on a read error
+double MeasureThroughput(FileReader& reader)
+{
+    std::vector<uint8_t> buffer(READ_SIZE);
+    int64_t total = 0;
+
+    const auto startTime = boost::chrono::steady_clock::now();
+    for (int length; (length = reader.read(buffer.data(), READ_SIZE)) != 0; total += length)
+    {
+        if (length < 0)
+        {
+            return -1;
+        }
+    }
+    const double elapsed = boost::chrono::duration<double>(boost::chrono::steady_clock::now() - startTime).count();
+
+    return (elapsed > 0) ? total / elapsed : 0;
+}
+
+// Up to size bytes, reads that come back short at a chunk boundary are continued
+int ReadFully(FileReader& reader, uint8_t* buf, int size)
+{
+    int total = 0;
+    for (int length; total < size && (length = reader.read(buf + total, size - total)) != 0; total += length)
+    {
+        if (length < 0)
+        {
+            return -1;
+        }
+    }
+    return total;
+}
+
+// Probe reads at random positions, each checked against the reference. Most positions are out of
+// the reader's read-ahead, so requests in flight get cancelled and read-ahead restarts there; every
+// other probe is preceded by a seek that is abandoned before anything is read.
+// Seeks per second, negative on a mismatch or a read error.
+double CheckRandomReads(FileReader& reader, FileReader& reference)
+{
+    const int64_t size = reader.size();
+    if (size <= 0)
+    {
+        return 0;
+    }
+
+    std::mt19937_64 random(1);
+    std::uniform_int_distribution<int64_t> positions(0, size - 1);
+    std::vector<uint8_t> buffer(SEEK_READ_SIZE);
+    std::vector<uint8_t> expected(SEEK_READ_SIZE);
+
+    const auto startTime = boost::chrono::steady_clock::now();
+    for (int i = 0; i < SEEKS; ++i)
+    {
+        if (i % 2 == 0 && reader.seek(positions(random)) < 0)
+        {
+            return -1;
+        }
+
+        const int64_t position = positions(random);
+        if (reader.seek(position) != position || reference.seek(position) != position)
+        {
+            return -1;
+        }
+        const int length = ReadFully(reader, buffer.data(), SEEK_READ_SIZE);
+        const int expectedLength = ReadFully(reference, expected.data(), SEEK_READ_SIZE);
+        if (length < 0 || length != expectedLength || memcmp(buffer.data(), expected.data(), length) != 0)
+        {
+            std::cerr << "Wrong data read at " << position << '\n';
+            return -1;
+        }
+    }
+    const double elapsed = boost::chrono::duration<double>(boost::chrono::steady_clock::now() - startTime).count();
+
+    return (elapsed > 0) ? SEEKS / elapsed : 0;
+}
+
+} // namespace
+
+// read <file>: sequential throughput of the reader the player picks for the file, then of plain stdio.
+// The stdio pass may be served from the page cache the first one filled, unless that was direct I/O.
+// Then random seeks with probe reads through the picked reader, checked against stdio.
+int RunRead(const std::vector<PathType>& args)
+{
+    auto reader = OpenFileReader(args[0]);
+    if (!reader)
+    {
+        std::cerr << "Unable to open the file\n";
+        return EXIT_FAILURE;
+    }
+
+    const double throughput = MeasureThroughput(*reader);
+    const std::string description = reader->describe();
+    reader.reset();
+
+    FILE* file =
+#ifdef _WIN32
+        _wfsopen(args[0].c_str(), L"rb", _SH_DENYNO);
+#else
+        fopen(args[0].c_str(), "rb");
+#endif
+    auto stdioReader = WrapFileReader(file);
+    const double stdioThroughput = stdioReader ? MeasureThroughput(*stdioReader) : -1;
+
+    if (throughput < 0 || stdioThroughput < 0)
+    {
+        std::cerr << "Read error\n";
+        return EXIT_FAILURE;
+    }
+
+    printf("Picked reader: %.0f MB/s%s%s\nstdio: %.0f MB/s\n", throughput / (1024. * 1024.),
+        description.empty() ? "" : ", ", description.c_str(), stdioThroughput / (1024. * 1024.));
+
+    reader = OpenFileReader(args[0]);
+    if (!reader)
+    {
+        std::cerr << "Unable to open the file again\n";
+        return EXIT_FAILURE;
+    }
+    const double seeksPerSecond = CheckRandomReads(*reader, *stdioReader);
+    if (seeksPerSecond < 0)
+    {
+        std::cerr << "Random reads FAILED\n";
+        return EXIT_FAILURE;
+    }
+    const std::string seekDescription = reader->describe();
+    printf("Random reads: %d seeks checked, %.0f per s%s%s\n", int(SEEKS), seeksPerSecond,
+        seekDescription.empty() ? "" : ", ", seekDescription.c_str());
+    return EXIT_SUCCESS;
+}
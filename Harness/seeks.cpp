@@ -0,0 +1,213 @@
+#include "stdafx.h"
+
+#include "harness.h"
+#include "headless.h"
+
+#include "steadytime.h"
+#include "timesource.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <random>
+
+namespace {
+
+enum { SEQUENTIAL_SEEKS = 20, RANDOM_SEEKS = 20, OPEN_TIMEOUT_SECS = 10, SEEK_TIMEOUT_SECS = 10 };
+
+// A file regresses when its p95 exceeds the baseline one by both of these
+const double REGRESSION_RATIO = 1.25;
+const double REGRESSION_SLACK_MS = 10;
+
+struct FileReport
+{
+    std::string name;
+    std::vector<double> latencies; // ms, sorted once measured
+    int failed = 0;
+
+    double percentile(double p) const
+    {
+        return latencies.empty() ? 0
+            : latencies[std::min(latencies.size() - 1, size_t(p * latencies.size()))];
+    }
+};
+
+// Sequential seeks step through the file front to back by percent, random ones go to a position of the
+// stream's own timeline, with a fixed seed to stay comparable
+bool MeasureFile(const PathType& path, FileReport& report)
+{
+    HeadlessListener listener;
+    auto decoder = GetFrameDecoder(std::make_unique<NullAudioPlayer>(GetSystemTimeSource()));
+    decoder->setFrameListener(&listener);
+    decoder->setDecoderListener(&listener);
+    if (!decoder->openFile(path))
+    {
+        return false;
+    }
+    decoder->play();
+
+    // Audio only files have nothing to present
+    if (!listener.waitForFrames(1, OPEN_TIMEOUT_SECS))
+    {
+        decoder->close();
+        return false;
+    }
+
+    std::mt19937 random(SEQUENTIAL_SEEKS * RANDOM_SEEKS);
+    std::uniform_real_distribution<double> randomPercent(0., 0.95);
+
+    for (int i = 0; i < SEQUENTIAL_SEEKS + RANDOM_SEEKS; ++i)
+    {
+        const bool sequential = i < SEQUENTIAL_SEEKS;
+        const double percent = sequential ? (i + 0.5) / SEQUENTIAL_SEEKS * 0.95 : randomPercent(random);
+        const auto position = decoder->getPlaybackPosition();
+        const int64_t duration = position.start + int64_t((position.total - position.start) * percent);
+
+        listener.expectSeek();
+        const double requestTime = GetSteadyTime();
+        if ((sequential ? decoder->seekByPercent(percent) : decoder->seekDuration(duration))
+            && listener.waitForSeek(SEEK_TIMEOUT_SECS))
+        {
+            report.latencies.push_back((GetSteadyTime() - requestTime) * 1000.);
+        }
+        else
+        {
+            ++report.failed;
+        }
+    }
+
+    decoder->close();
+
+    std::sort(report.latencies.begin(), report.latencies.end());
+    return true;
+}
+
+std::string EscapeJson(const std::string& text)
+{
+    std::string result;
+    for (char ch : text)
+    {
+        if (ch == '"' || ch == '\\')
+        {
+            result += '\\';
+        }
+        result += ch;
+    }
+    return result;
+}
+
+// {"files": [{"name": ..., "seeks": ..., "failed": ..., "p50_ms": ..., "p95_ms": ..., "p99_ms": ...}, ...]}
+bool WriteReport(const PathType& reportFile, const std::vector<FileReport>& reports)
+{
+    std::string result = "{\"files\": [";
+    for (size_t i = 0; i < reports.size(); ++i)
+    {
+        const FileReport& report = reports[i];
+
+        char buffer[200];
+        snprintf(buffer, sizeof(buffer),
+            "\", \"seeks\": %u, \"failed\": %d, \"p50_ms\": %.1f, \"p95_ms\": %.1f, \"p99_ms\": %.1f}",
+            static_cast<unsigned>(report.latencies.size()) + report.failed, report.failed,
+            report.percentile(0.5), report.percentile(0.95), report.percentile(0.99));
+        result += (i == 0) ? "\n  {\"name\": \"" : ",\n  {\"name\": \"";
+        result += EscapeJson(report.name);
+        result += buffer;
+    }
+    result += "\n]}\n";
+
+    FILE* out =
+#ifdef _WIN32
+        _wfopen(reportFile.c_str(), L"w");
+#else
+        fopen(reportFile.c_str(), "w");
+#endif
+    if (out == nullptr)
+    {
+        return false;
+    }
+    const bool ok = fputs(result.c_str(), out) >= 0;
+    return (fclose(out) == 0) && ok;
+}
+
+// Files missing from either side are not compared
+int CountRegressions(const PathType& baselineFile, const std::vector<FileReport>& reports)
+{
+    boost::filesystem::ifstream in(baselineFile);
+    boost::property_tree::ptree baseline;
+    boost::property_tree::read_json(in, baseline);
+
+    std::map<std::string, double> baselineP95;
+    for (const auto& file : baseline.get_child("files"))
+    {
+        baselineP95[file.second.get<std::string>("name")] = file.second.get<double>("p95_ms");
+    }
+
+    int regressions = 0;
+    for (const auto& report : reports)
+    {
+        const auto it = baselineP95.find(report.name);
+        if (it == baselineP95.end())
+        {
+            continue;
+        }
+        const double p95 = report.percentile(0.95);
+        if (p95 > it->second * REGRESSION_RATIO && p95 > it->second + REGRESSION_SLACK_MS || report.failed > 0)
+        {
+            std::cerr << report.name << ": p95 " << p95 << " ms against " << it->second << " ms in the baseline, "
+                << report.failed << " seeks timed out\n";
+            ++regressions;
+        }
+    }
+    return regressions;
+}
+
+} // namespace
+
+// seeks <corpus dir> <report.json> [<baseline.json>]: time from a seek to its first presented frame, file by file
+int RunSeeks(const std::vector<PathType>& args)
+{
+    std::vector<PathType> files;
+    for (const auto& entry : boost::filesystem::directory_iterator(args[0]))
+    {
+        if (boost::filesystem::is_regular_file(entry.status()))
+        {
+            files.push_back(entry.path().native());
+        }
+    }
+    std::sort(files.begin(), files.end());
+
+    std::vector<FileReport> reports;
+    for (const auto& file : files)
+    {
+        FileReport report;
+        report.name = ToUtf8(boost::filesystem::path(file).filename().native());
+        if (!MeasureFile(file, report))
+        {
+            std::cerr << report.name << ": skipped, no video could be played\n";
+            continue;
+        }
+        printf("%s: p50 %.1f ms, p95 %.1f ms, p99 %.1f ms, %d of %u seeks timed out\n",
+            report.name.c_str(), report.percentile(0.5), report.percentile(0.95), report.percentile(0.99),
+            report.failed, static_cast<unsigned>(report.latencies.size()) + report.failed);
+        reports.push_back(std::move(report));
+    }
+
+    if (!WriteReport(args[1], reports))
+    {
+        std::cerr << "Unable to write the report\n";
+        return EXIT_FAILURE;
+    }
+
+    // A report of a known good build serves as the baseline of the next runs
+    if (args.size() > 2 && CountRegressions(args[2], reports) > 0)
+    {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
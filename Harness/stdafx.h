@@ -0,0 +1,26 @@
+// stdafx.h : include file for standard system include files,
+// or project specific include files that are used frequently, but
+// are changed infrequently
+//
+
+#pragma once
+
+#ifdef _WIN32
+#include "targetver.h"
+#endif
+
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <tchar.h>
+#else
+// The CMake build, arguments are UTF-8 like the paths
+#include <strings.h>
+typedef char TCHAR;
+#define _T(text) text
+#define _tcsicmp strcasecmp
+#define _tmain main
+#endif
+
+#include <string>
+#include <vector>
@@ -0,0 +1,233 @@
+#include "stdafx.h"
+
+#include "harness.h"
+#include "headless.h"
+
+#include "steadytime.h"
+#include "timesource.h"
+
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace {
+
+enum StressOperation
+{
+    STRESS_PAUSE_RESUME,
+    STRESS_NEXT_FRAME,
+    STRESS_SEEK,
+    STRESS_VIDEO_RESET,
+    STRESS_AUDIO_TRACK,
+    STRESS_SPEED,
+    STRESS_REOPEN,
+    STRESS_OPERATIONS
+};
+
+const char* const OPERATION_NAMES[STRESS_OPERATIONS] = {
+    "pause/resume",
+    "next frame",
+    "seek",
+    "video reset",
+    "audio track",
+    "speed",
+    "reopen",
+};
+
+const RationalNumber SPEEDS[] = { { 1, 2 }, { 1, 1 }, { 3, 2 }, { 2, 1 } };
+
+enum { MAX_PAUSE_MS = 50, CHECKPOINT_OPERATIONS = 50, CALL_TIMEOUT_SECS = 30, FRAME_TIMEOUT_SECS = 10 };
+
+struct CallStats
+{
+    unsigned int count = 0;
+    double total = 0;
+    double max = 0;
+};
+
+// A call that never returns is a deadlock the run cannot recover from: it is reported and the process aborted,
+// so that a debugger or a crash dump gets the stacks
+class CallWatchdog
+{
+public:
+    CallWatchdog() : m_thread(&CallWatchdog::watch, this) {}
+    ~CallWatchdog()
+    {
+        m_thread.interrupt();
+        m_thread.join();
+    }
+
+    void enter(const char* name)
+    {
+        m_name = name;
+        m_callTime = GetSteadyTime();
+    }
+    void leave() { m_callTime = 0; }
+
+private:
+    void watch()
+    {
+        for (;;)
+        {
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+            const double callTime = m_callTime;
+            if (callTime != 0 && GetSteadyTime() - callTime > CALL_TIMEOUT_SECS)
+            {
+                std::cerr << "DEADLOCK: " << m_name.load() << " has not returned in "
+                    << CALL_TIMEOUT_SECS << " s\n" << std::flush;
+                abort();
+            }
+        }
+    }
+
+    boost::atomic<const char*> m_name{ "" };
+    boost::atomic<double> m_callTime{ 0. }; // 0 outside calls
+    boost::thread m_thread;
+};
+
+} // namespace
+
+// stress <file> [<seconds>] [<seed>]: random control sequences against a playing decoder.
+// Calls are timed and guarded against deadlocks, every CHECKPOINT_OPERATIONS the decoder has to
+// present a frame after a seek, or it lost a wakeup. Same seed, same sequence.
+int RunStress(const std::vector<PathType>& args)
+{
+    const double duration = (args.size() > 1) ? std::stod(args[1]) : 60.;
+    const unsigned int seed = (args.size() > 2) ? static_cast<unsigned int>(std::stoul(args[2])) : 1;
+    std::mt19937 random(seed);
+
+    HeadlessListener listener;
+    auto decoder = GetFrameDecoder(std::make_unique<NullAudioPlayer>(GetSystemTimeSource()));
+    decoder->setFrameListener(&listener);
+    decoder->setDecoderListener(&listener);
+
+    CallWatchdog watchdog;
+    CallStats stats[STRESS_OPERATIONS];
+    int failures = 0;
+
+    const auto open = [&] {
+        watchdog.enter("open");
+        const bool ok = decoder->openFile(args[0]);
+        if (ok)
+        {
+            decoder->play();
+        }
+        watchdog.leave();
+        return ok;
+    };
+
+    // Playing at normal speed, a seek has to bring a frame
+    const auto checkpoint = [&](const char* when) {
+        watchdog.enter("checkpoint");
+        if (decoder->isPaused())
+        {
+            decoder->pauseResume();
+        }
+        decoder->setSpeedRational({ 1, 1 });
+        listener.expectSeek();
+        const bool ok = decoder->seekByPercent(std::uniform_real_distribution<double>(0., 0.9)(random))
+            && listener.waitForSeek(FRAME_TIMEOUT_SECS);
+        watchdog.leave();
+        if (!ok)
+        {
+            std::cerr << "STALL: no frame presented after a seek " << when << '\n';
+            ++failures;
+        }
+    };
+
+    if (!open() || !listener.waitForFrames(1, FRAME_TIMEOUT_SECS))
+    {
+        std::cerr << "Unable to play the file\n";
+        return EXIT_FAILURE;
+    }
+
+    std::uniform_int_distribution<int> randomOperation(0, STRESS_OPERATIONS - 1);
+    std::uniform_int_distribution<int> randomPause(0, MAX_PAUSE_MS);
+    const double endTime = GetSteadyTime() + duration;
+    for (unsigned int i = 1; GetSteadyTime() < endTime; ++i)
+    {
+        const auto operation = static_cast<StressOperation>(randomOperation(random));
+
+        watchdog.enter(OPERATION_NAMES[operation]);
+        const double callTime = GetSteadyTime();
+        switch (operation)
+        {
+        case STRESS_PAUSE_RESUME:
+            decoder->pauseResume();
+            break;
+        case STRESS_NEXT_FRAME:
+            decoder->nextFrame();
+            break;
+        case STRESS_SEEK:
+            decoder->seekByPercent(std::uniform_real_distribution<double>(0., 0.95)(random));
+            break;
+        case STRESS_VIDEO_RESET:
+            decoder->videoReset();
+            break;
+        case STRESS_AUDIO_TRACK:
+            decoder->setAudioTrack(std::uniform_int_distribution<int>(
+                0, std::max(decoder->getNumAudioTracks() - 1, 0))(random));
+            break;
+        case STRESS_SPEED:
+            decoder->setSpeedRational(SPEEDS[random() % (sizeof(SPEEDS) / sizeof(SPEEDS[0]))]);
+            break;
+        case STRESS_REOPEN:
+            decoder->close();
+            if (!decoder->openFile(args[0]))
+            {
+                std::cerr << "Reopening failed\n";
+                return EXIT_FAILURE;
+            }
+            decoder->play();
+            break;
+        default:
+            break;
+        }
+        const double latency = GetSteadyTime() - callTime;
+        watchdog.leave();
+
+        CallStats& callStats = stats[operation];
+        ++callStats.count;
+        callStats.total += latency;
+        callStats.max = std::max(callStats.max, latency);
+
+        if (i % CHECKPOINT_OPERATIONS == 0)
+        {
+            checkpoint("in the run");
+        }
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(randomPause(random)));
+    }
+
+    checkpoint("at the end");
+
+    // How long the effects took, as the decoder measured them
+    for (const auto& property : decoder->getProperties())
+    {
+        if (property.compare(0, 7, "Control") == 0)
+        {
+            std::cout << property << '\n';
+        }
+    }
+
+    watchdog.enter("close");
+    decoder->close();
+    watchdog.leave();
+
+    std::cout << "Seed " << seed << ", call latency avg/max:\n";
+    for (int i = 0; i < STRESS_OPERATIONS; ++i)
+    {
+        if (stats[i].count > 0)
+        {
+            printf("  %-12s %6u calls %8.2f/%.2f ms\n", OPERATION_NAMES[i], stats[i].count,
+                stats[i].total * 1000. / stats[i].count, stats[i].max * 1000.);
+        }
+    }
+
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
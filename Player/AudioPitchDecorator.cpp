@@ -2,8 +2,10 @@
 #include "AudioPitchDecorator.h"
 
 #include "smbPitchShift.h"
+#include "primitivetimer.h"
 
 #include <algorithm>
+#include <chrono>
 #include <utility>
 
 AudioPitchDecorator::AudioPitchDecorator(std::unique_ptr<IAudioPlayer> player
@@ -86,6 +88,7 @@ bool AudioPitchDecorator::WriteAudio(uint8_t * write_data, int64_t write_size)
     const auto pitchShift = m_getPitchShift();
     if (pitchShift != 1. && m_bytesPerSample == 2)
     {
+        const auto startTime = std::chrono::steady_clock::now();
         const auto numSamples = (write_size / m_bytesPerSample) / m_smbPitchShifts.size();
         if (m_buffer.size() < numSamples)
             m_buffer.resize(numSamples);
@@ -96,14 +99,19 @@ bool AudioPitchDecorator::WriteAudio(uint8_t * write_data, int64_t write_size)
             {
                 m_buffer[j] = intData[j * m_smbPitchShifts.size() + i] / 32768.;
             }
-            m_smbPitchShifts[i].smbPitchShift(
-                pitchShift, numSamples, 4096, 16, m_samplesPerSec, m_buffer.data(), m_buffer.data());
+            {
+                PrimitiveTimer timer(PRIMITIVE_PITCH_SHIFT);
+                m_smbPitchShifts[i].smbPitchShift(
+                    pitchShift, numSamples, 4096, 16, m_samplesPerSec, m_buffer.data(), m_buffer.data());
+            }
             for (size_t j = 0; j < numSamples; ++j)
             {
                 // decrease level to avoid clipping distortions
                 intData[j * m_smbPitchShifts.size() + i] = std::clamp(m_buffer[j], -2.f, 2.f) * (32767. / 2);
             }
         }
+        m_processingSeconds = m_processingSeconds
+            + std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
     }
     else
     {
@@ -112,3 +120,8 @@ bool AudioPitchDecorator::WriteAudio(uint8_t * write_data, int64_t write_size)
     }
     return m_player->WriteAudio(write_data, write_size);
 }
+
+double AudioPitchDecorator::GetProcessingSeconds() const
+{
+    return m_processingSeconds + m_player->GetProcessingSeconds();
+}
@@ -2,6 +2,7 @@
 
 #include "audioplayer.h"
 
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <vector>
@@ -32,6 +33,7 @@ public:
     void WaveOutPause() override;
     void WaveOutRestart() override;
     bool WriteAudio(uint8_t * write_data, int64_t write_size) override;
+    double GetProcessingSeconds() const override;
 
 private:
     std::unique_ptr<IAudioPlayer> m_player;
@@ -39,6 +41,7 @@ private:
     std::vector<CSmbPitchShift> m_smbPitchShifts;
 
     std::vector<float> m_buffer;
+    std::atomic<double> m_processingSeconds{ 0. }; // written by the audio thread only
 
     int m_bytesPerSample{};
     int m_samplesPerSec{};
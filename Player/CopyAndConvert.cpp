@@ -0,0 +1,71 @@
+#include "stdafx.h"
+#include "CopyAndConvert.h"
+
+#include <emmintrin.h>
+
+namespace {
+
+void SimdCopyAndConvert(
+    __m128i* const __restrict origin0,
+    __m128i* const __restrict origin1,
+    const __m128i* const __restrict src00,
+    const __m128i* const __restrict src01,
+    const double* const __restrict src0,
+    const double* const __restrict src1,
+    size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        __m128i uv = _mm_unpacklo_epi8(
+            _mm_castpd_si128(_mm_load_sd(src0 + i)),
+            _mm_castpd_si128(_mm_load_sd(src1 + i)));
+        _mm_stream_si128(origin0 + i * 2, _mm_unpacklo_epi8(src00[i], uv));
+        _mm_stream_si128(origin0 + i * 2 + 1, _mm_unpackhi_epi8(src00[i], uv));
+        _mm_stream_si128(origin1 + i * 2, _mm_unpacklo_epi8(src01[i], uv));
+        _mm_stream_si128(origin1 + i * 2 + 1, _mm_unpackhi_epi8(src01[i], uv));
+    }
+}
+
+} // namespace
+
+void CopyAndConvert(
+    uint32_t* __restrict origin0,
+    uint32_t* __restrict origin1,
+    const uint8_t* __restrict src00,
+    const uint8_t* __restrict src01,
+    const uint8_t* __restrict src0,
+    const uint8_t* __restrict src1,
+    size_t count)
+{
+    if (!((intptr_t(origin0) & 15) || (intptr_t(origin1) & 15)
+        || (intptr_t(src00) & 15) || (intptr_t(src01) & 15)
+        || (intptr_t(src0) & 7) || (intptr_t(src1) & 7)))
+    {
+        const auto simdCount = count / 8;
+
+        SimdCopyAndConvert(
+            (__m128i*) origin0,
+            (__m128i*) origin1,
+            (const __m128i*) src00,
+            (const __m128i*) src01,
+            (const double*) src0,
+            (const double*) src1,
+            simdCount);
+
+        origin0 += simdCount * 8;
+        origin1 += simdCount * 8;
+        src00 += simdCount * 16;
+        src01 += simdCount * 16;
+        src0 += simdCount * 8;
+        src1 += simdCount * 8;
+
+        count -= simdCount * 8;
+    }
+
+    for (unsigned int j = 0; j < count; ++j)
+    {
+        const uint32_t uv = (src0[j] << 8) | (src1[j] << 24);
+        origin0[j] = uv | src00[j * 2] | (src00[j * 2 + 1] << 16);
+        origin1[j] = uv | src01[j * 2] | (src01[j * 2 + 1] << 16);
+    }
+}
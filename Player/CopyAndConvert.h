@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Two rows of a YUV420P image into two YUY2 rows, count is the number of pixel pairs
+void CopyAndConvert(
+    uint32_t* __restrict origin0,
+    uint32_t* __restrict origin1,
+    const uint8_t* __restrict src00,
+    const uint8_t* __restrict src01,
+    const uint8_t* __restrict src0,
+    const uint8_t* __restrict src1,
+    size_t count);
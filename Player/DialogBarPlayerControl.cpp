@@ -28,6 +28,8 @@ enum { ICON_SIZE = 24 };
 
 enum { WM_SET_TIME = WM_USER + 101 };
 
+enum { POSITION_TIMER_ID = 1, POSITION_POLL_MS = 50 };
+
 namespace {
 
 std::basic_string<TCHAR> secondsToString(int seconds)
@@ -124,6 +126,7 @@ BEGIN_MESSAGE_MAP(CDialogBarPlayerControl, CPaneDialog)
     ON_BN_CLICKED(IDC_PLAY_PAUSE, &CDialogBarPlayerControl::OnClickedPlayPause)
     ON_BN_CLICKED(IDC_AUDIO_ON_OFF, &CDialogBarPlayerControl::OnClickedAudioOnOff)
     ON_MESSAGE(WM_SET_TIME, &CDialogBarPlayerControl::OnSetTime)
+    ON_WM_TIMER()
     ON_MESSAGE(WM_INITDIALOG, &CDialogBarPlayerControl::HandleInitDialog)
     ON_UPDATE_COMMAND_UI(IDC_FRAME_STEP, &CDialogBarPlayerControl::OnUpdateFrameStep)
     ON_UPDATE_COMMAND_UI(IDC_VOLUME_SLIDER, &CDialogBarPlayerControl::OnUpdateVolumeSlider)
@@ -170,6 +173,21 @@ void CDialogBarPlayerControl::setDocument(CPlayerDoc* pDoc)
 
     m_pDoc->rangeStartTimeChanged.connect(MAKE_DELEGATE(&CDialogBarPlayerControl::onRangeStartTimeChanged, this));
     m_pDoc->rangeEndTimeChanged.connect(MAKE_DELEGATE(&CDialogBarPlayerControl::onRangeEndTimeChanged, this));
+
+    // The decoder publishes its position instead of reporting every frame
+    SetTimer(POSITION_TIMER_ID, POSITION_POLL_MS, nullptr);
+}
+
+void CDialogBarPlayerControl::OnTimer(UINT_PTR nIDEvent)
+{
+    if (nIDEvent == POSITION_TIMER_ID)
+    {
+        if (m_pDoc)
+            m_pDoc->pollPosition();
+        return;
+    }
+
+    __super::OnTimer(nIDEvent);
 }
 
 void CDialogBarPlayerControl::onFramePositionChanged(long long frame, long long total)
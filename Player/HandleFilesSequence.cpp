@@ -5,6 +5,46 @@
 #include <algorithm>
 #include <vector>
 
+namespace {
+
+const LPCTSTR imageExtensions[] = {
+    _T(".png"), _T(".jpg"), _T(".jpeg"), _T(".dpx"), _T(".tif"), _T(".tiff"),
+    _T(".bmp"), _T(".tga"), _T(".exr"),
+};
+
+bool IsImageExtension(LPCTSTR extension)
+{
+    return std::any_of(std::begin(imageExtensions), std::end(imageExtensions),
+        [extension](LPCTSTR imageExtension) { return !_tcsicmp(extension, imageExtension); });
+}
+
+// The alphabetically first image of a folder
+CString GetFirstImageFile(const CString& directory)
+{
+    CString result;
+    WIN32_FIND_DATA ffd{};
+    const auto hFind = FindFirstFile(directory + _T("\\*"), &ffd);
+    if (INVALID_HANDLE_VALUE == hFind)
+    {
+        return result;
+    }
+    do
+    {
+        if (!(ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            && IsImageExtension(PathFindExtension(ffd.cFileName))
+            && (result.IsEmpty() || result.CompareNoCase(ffd.cFileName) > 0))
+        {
+            result = ffd.cFileName;
+        }
+    } while (FindNextFile(hFind, &ffd));
+
+    FindClose(hFind);
+
+    return result.IsEmpty() ? result : directory + _T('\\') + result;
+}
+
+} // namespace
+
 bool HandleFilesSequence(const CString& pathName,
     bool looping,
     std::function<bool(const CString&)> tryToOpen)
@@ -66,3 +106,39 @@ bool HandleFilesSequence(const CString& pathName,
     }
     return false;
 }
+
+bool GetImageSequencePattern(const CString& pathName, CString& pattern, int& startNumber)
+{
+    const CString fileName = PathIsDirectory(pathName)
+        ? GetFirstImageFile(CString(pathName).TrimRight(_T('\\')))
+        : pathName;
+    if (fileName.IsEmpty())
+        return false;
+
+    const auto extension = PathFindExtension(fileName);
+    const auto name = PathFindFileName(fileName);
+    if (!IsImageExtension(extension))
+        return false;
+
+    // The frame number is the run of digits right before the extension
+    auto digits = extension;
+    while (digits > name && _istdigit(digits[-1]))
+        --digits;
+    const int numDigits = static_cast<int>(extension - digits);
+    if (numDigits == 0)
+        return false;
+
+    startNumber = _ttoi(CString(digits, numDigits));
+    const CString prefix(fileName, static_cast<int>(digits - fileName));
+
+    // A single numbered still is not a sequence
+    CString nextFile;
+    nextFile.Format(_T("%s%0*d%s"), prefix.GetString(), numDigits, startNumber + 1, extension);
+    if (!PathFileExists(nextFile))
+        return false;
+
+    CString escapedPrefix(prefix);
+    escapedPrefix.Replace(_T("%"), _T("%%"));
+    pattern.Format(_T("%s%%0%dd%s"), escapedPrefix.GetString(), numDigits, extension);
+    return true;
+}
@@ -5,3 +5,6 @@
 bool HandleFilesSequence(const CString& pathName,
     bool looping,
     std::function<bool(const CString&)> tryToOpen);
+
+// Turns a numbered image file, or a folder of them, into a printf style pattern
+bool GetImageSequencePattern(const CString& pathName, CString& pattern, int& startNumber);
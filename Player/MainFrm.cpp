@@ -68,6 +68,7 @@ BEGIN_MESSAGE_MAP(CMainFrame, CFrameWndEx)
     ON_WM_WINDOWPOSCHANGED()
     ON_WM_NCPAINT()
     ON_WM_POWERBROADCAST()
+    ON_WM_ACTIVATEAPP()
     ON_REGISTERED_MESSAGE(s_uTBBC, &CMainFrame::CreateThumbnailToolbar)
 END_MESSAGE_MAP()
 
@@ -395,3 +396,17 @@ UINT CMainFrame::OnPowerBroadcast(UINT nPowerEvent, LPARAM nEventData)
     }
     return CFrameWndEx::OnPowerBroadcast(nPowerEvent, nEventData);
 }
+
+void CMainFrame::OnActivateApp(BOOL bActive, DWORD dwThreadID)
+{
+    CFrameWndEx::OnActivateApp(bActive, dwThreadID);
+
+    // The player in front keeps its picture, background ones give way first under load
+    if (CView* pView = dynamic_cast<CView*>(GetDescendantWindow(AFX_IDW_PANE_FIRST, TRUE)))
+    {
+        if (CPlayerDoc* pDoc = static_cast<DocumentAccessor*>(pView)->GetDocument())
+        {
+            pDoc->getFrameDecoder()->setDecodePriority(bActive ? 1 : 0);
+        }
+    }
+}
@@ -71,6 +71,7 @@ protected:
     afx_msg void OnWindowPosChanged(WINDOWPOS* lpwndpos);
     afx_msg void OnNcPaint();
     afx_msg UINT OnPowerBroadcast(UINT nPowerEvent, LPARAM nEventData);
+    afx_msg void OnActivateApp(BOOL bActive, DWORD dwThreadID);
     DECLARE_MESSAGE_MAP()
 };
 
@@ -15,6 +15,7 @@
 #include "I420Effect.h"
 
 #include "AsyncGetUrlUnderMouseCursor.h"
+#include "primitivetimer.h"
 
 #include <boost/log/sinks/debug_output_backend.hpp>
 #include <boost/log/sinks/sync_frontend.hpp>
@@ -197,6 +198,21 @@ BOOL CPlayerApp::InitInstance()
     return TRUE;
 }
 
+int CPlayerApp::ExitInstance()
+{
+    // Primitive timings of the session go where FFPLAYER_PRIMITIVES_JSON points, to compare builds timing them
+    if (const wchar_t* path = _wgetenv(L"FFPLAYER_PRIMITIVES_JSON"))
+    {
+        if (FILE* f = _wfopen(path, L"w"))
+        {
+            fputs(PrimitivesToJson().c_str(), f);
+            fclose(f);
+        }
+    }
+
+    return __super::ExitInstance();
+}
+
 // CPlayerApp message handlers
 
 
@@ -24,6 +24,7 @@ public:
 // Overrides
 public:
     BOOL InitInstance() override;
+    int ExitInstance() override;
 
 // Implementation
     afx_msg void OnAppAbout();
@@ -20,6 +20,8 @@
 
 #include "YouTuber.h"
 
+#include "threadpolicy.h"
+
 #include <propkey.h>
 #include <memory>
 
@@ -44,6 +46,17 @@
 
 namespace {
 
+enum { DEFAULT_IMAGE_SEQUENCE_FPS = 24 };
+
+// "24000/1001" as well as "23.976" or "24", 0 when it is neither
+double ParseFrameRate(LPCTSTR text)
+{
+    double numerator = 0;
+    double denominator = 1;
+    const int fields = _stscanf_s(text, _T("%lf/%lf"), &numerator, &denominator);
+    return (fields >= 1 && numerator > 0 && denominator > 0) ? numerator / denominator : 0;
+}
+
 const RationalNumber videoSpeeds[]
 {
     { 1, 2 },
@@ -90,6 +103,22 @@ std::unique_ptr<IAudioPlayer> GetAudioPlayer()
     return std::make_unique<AudioPlayerImpl>();
 }       
 
+// Chunked recordings listed in a .lst are played as one timeline, unless their formats differ
+bool GetLocalFileSequence(const std::deque<std::string>& playList, std::vector<std::wstring>& files)
+{
+    files.clear();
+    for (const auto& line : playList)
+    {
+        if (line.empty())
+            continue;
+        CA2W path(line.c_str(), CP_UTF8);
+        if (PathIsURLW(path) || PathIsRelativeW(path) || !PathFileExistsW(path))
+            return false;
+        files.emplace_back(path);
+    }
+    return files.size() > 1;
+}
+
 } // namespace
 
 
@@ -109,6 +138,10 @@ BEGIN_MESSAGE_MAP(CPlayerDoc, CDocument)
     ON_UPDATE_COMMAND_UI(ID_AUTOPLAY, &CPlayerDoc::OnUpdateAutoplay)
     ON_COMMAND(ID_LOOPING, &CPlayerDoc::OnLooping)
     ON_UPDATE_COMMAND_UI(ID_LOOPING, &CPlayerDoc::OnUpdateLooping)
+    ON_COMMAND(ID_AUTO_CROP, &CPlayerDoc::OnAutoCrop)
+    ON_UPDATE_COMMAND_UI(ID_AUTO_CROP, &CPlayerDoc::OnUpdateAutoCrop)
+    ON_COMMAND(ID_COMPARE_WITH, &CPlayerDoc::OnCompareWith)
+    ON_UPDATE_COMMAND_UI(ID_COMPARE_WITH, &CPlayerDoc::OnUpdateCompareWith)
     ON_COMMAND(ID_FILE_SAVE_COPY_AS, &CPlayerDoc::OnFileSaveCopyAs)
 END_MESSAGE_MAP()
 
@@ -124,9 +157,29 @@ CPlayerDoc::CPlayerDoc()
     , m_onEndOfStream(false)
     , m_autoPlay(false)
     , m_looping(false)
+    , m_autoCrop(false)
+    , m_comparing(false)
     , m_nightcore(false)
 {
     m_frameDecoder->setDecoderListener(this);
+
+    // libavfilter graph from the Settings\VideoFilter registry value, e.g. "hqdn3d" or "eq=gamma=1.2"
+    m_frameDecoder->setVideoFilter(std::string(CT2A(
+        AfxGetApp()->GetProfileString(_T("Settings"), _T("VideoFilter")), CP_UTF8)));
+
+    // Core pinning from Settings\<role>ThreadAffinity registry values, CPU masks such as "0x0c"
+    const LPCTSTR affinityNames[THREAD_ROLE_COUNT] = {
+        _T("AudioThreadAffinity"),
+        _T("DisplayThreadAffinity"),
+        _T("DemuxThreadAffinity"),
+        _T("DecodeThreadAffinity"),
+        _T("BackgroundThreadAffinity"),
+    };
+    for (int role = 0; role < THREAD_ROLE_COUNT; ++role)
+    {
+        const CString mask = AfxGetApp()->GetProfileString(_T("Settings"), affinityNames[role]);
+        SetThreadRoleAffinity(static_cast<ThreadRole>(role), _tcstoui64(mask, nullptr, 0));
+    }
 }
 
 CPlayerDoc::~CPlayerDoc()
@@ -419,7 +472,15 @@ bool CPlayerDoc::openDocument(LPCTSTR lpszPathName)
             m_playList.push_back(buffer);
         }
 
-        if (!openUrlFromList())
+        std::vector<std::wstring> files;
+        if (GetLocalFileSequence(m_playList, files) && m_frameDecoder->openFileSequence(files))
+        {
+            m_playList.clear();
+            m_subtitles.reset();
+            m_frameDecoder->play();
+            onPauseResume(false);
+        }
+        else if (!openUrlFromList())
             return false;
     }
     else if (!_tcsicmp(extension, _T(".url")))
@@ -427,6 +488,13 @@ bool CPlayerDoc::openDocument(LPCTSTR lpszPathName)
         CString url = GetUrlFromUrlFile(lpszPathName);
         return !url.IsEmpty() && openTopLevelUrl(url, false, lpszPathName); // sets m_reopenFunc
     }
+    else if (openImageSequence(lpszPathName))
+    {
+        m_playList.clear();
+        m_subtitles.reset();
+        m_frameDecoder->play();
+        onPauseResume(false);
+    }
     else
     {
         if (extension[0] == _T('\0') || !_tcsicmp(extension, _T(".html"))) // https://community.spiceworks.com/topic/1968971-opening-web-links-downloading-1-item-to-zcrksihu
@@ -441,6 +509,7 @@ bool CPlayerDoc::openDocument(LPCTSTR lpszPathName)
         if (!m_frameDecoder->openFile(lpszPathName))
             return false;
         m_playList.clear();
+        m_frameDecoder->analyzeStream(); // local files only, it reads them once more
 
         m_subtitles.reset();
         for (auto func : { OpenSubRipFile, OpenSubStationAlphaFile })
@@ -467,6 +536,21 @@ bool CPlayerDoc::openDocument(LPCTSTR lpszPathName)
     return true;
 }
 
+bool CPlayerDoc::openImageSequence(LPCTSTR lpszPathName)
+{
+    CString pattern;
+    int startNumber = 0;
+    if (!GetImageSequencePattern(lpszPathName, pattern, startNumber))
+        return false;
+
+    // Settings\ImageSequenceFps is a string, so that NTSC rates come out exact
+    double frameRate = ParseFrameRate(AfxGetApp()->GetProfileString(_T("Settings"), _T("ImageSequenceFps")));
+    if (frameRate <= 0)
+        frameRate = DEFAULT_IMAGE_SEQUENCE_FPS;
+    return m_frameDecoder->openImageSequence(
+        std::string(CT2A(pattern, CP_UTF8)), startNumber, frameRate);
+}
+
 void CPlayerDoc::OnIdle()
 {
     __super::OnIdle();
@@ -521,14 +605,28 @@ void CPlayerDoc::OnCloseDocument()
 }
 
 
+void CPlayerDoc::pollPosition()
+{
+    // One snapshot for all of it, the decoder may be opening another file meanwhile
+    const auto position = m_frameDecoder->getPlaybackPosition();
+    if (position.timeBase > 0 && position.frame != m_lastFramePosition)
+        updatePosition(position.start, position.frame, position.total, position.frame * position.timeBase);
+}
+
 void CPlayerDoc::changedFramePosition(long long start, long long frame, long long total)
 {
+    updatePosition(start, frame, total, m_frameDecoder->getDurationSecs(frame));
+}
+
+void CPlayerDoc::updatePosition(long long start, long long frame, long long total, double currentTime)
+{
+    m_lastFramePosition = frame;
     framePositionChanged(frame - start, total - start);
-    const double currentTime = m_frameDecoder->getDurationSecs(frame);
     m_currentTime = currentTime;
     currentTimeUpdated(currentTime);
 
-    if (m_looping && !m_autoPlay && !isFullFrameRange() && m_currentTime >= m_rangeEndTime)
+    // The decoder loops by itself once the range is cached, this covers the first lap
+    if (m_looping && !m_autoPlay && !isFullFrameRange() && m_currentTime > m_rangeEndTime)
     {
         const double percent = (m_rangeStartTime - m_startTime) / (m_endTime - m_startTime);
         m_frameDecoder->seekByPercent(percent);
@@ -611,9 +709,11 @@ double CPlayerDoc::soundVolume() const
 std::string CPlayerDoc::getSubtitle() const
 {
     std::string result;
-    if (m_subtitles)
+    // Asked for every frame, so the position polled by the controls would lag
+    const auto position = m_frameDecoder->getPlaybackPosition();
+    if (m_subtitles && position.timeBase > 0)
     {
-        auto it = m_subtitles->find(m_currentTime); 
+        auto it = m_subtitles->find(position.frame * position.timeBase);
         if (it != m_subtitles->end())
         {
             result = it->second;
@@ -626,12 +726,22 @@ void CPlayerDoc::setRangeStartTime(double time)
 {
     m_rangeStartTime = time;
     rangeStartTimeChanged(time - m_startTime, m_endTime - m_startTime);
+    updateLoopRange();
 }
 
 void CPlayerDoc::setRangeEndTime(double time)
 {
     m_rangeEndTime = time;
     rangeEndTimeChanged(time - m_startTime, m_endTime - m_startTime);
+    updateLoopRange();
+}
+
+void CPlayerDoc::updateLoopRange()
+{
+    if (m_looping && !m_autoPlay && !isFullFrameRange())
+        m_frameDecoder->setLoopRange(m_rangeStartTime, m_rangeEndTime);
+    else
+        m_frameDecoder->setLoopRange(0, 0);
 }
 
 bool CPlayerDoc::isFullFrameRange() const
@@ -707,6 +817,7 @@ void CPlayerDoc::OnUpdateAudioTrack(CCmdUI* pCmdUI)
 void CPlayerDoc::OnAutoplay()
 {
     m_autoPlay = !m_autoPlay;
+    updateLoopRange();
 }
 
 
@@ -718,6 +829,7 @@ void CPlayerDoc::OnUpdateAutoplay(CCmdUI *pCmdUI)
 void CPlayerDoc::OnLooping()
 {
     m_looping = !m_looping;
+    updateLoopRange();
 }
 
 
@@ -726,6 +838,41 @@ void CPlayerDoc::OnUpdateLooping(CCmdUI *pCmdUI)
     pCmdUI->SetCheck(m_looping);
 }
 
+
+void CPlayerDoc::OnAutoCrop()
+{
+    m_autoCrop = !m_autoCrop;
+    m_frameDecoder->setAutoCrop(m_autoCrop);
+}
+
+
+void CPlayerDoc::OnUpdateAutoCrop(CCmdUI *pCmdUI)
+{
+    pCmdUI->SetCheck(m_autoCrop);
+}
+
+// A second encode shown right of a split wipe, Shift with the mouse moves the wipe
+void CPlayerDoc::OnCompareWith()
+{
+    if (m_comparing)
+    {
+        m_frameDecoder->setSplitWipeSource({});
+        m_comparing = false;
+        return;
+    }
+
+    CFileDialog dlg(TRUE, nullptr, nullptr, OFN_FILEMUSTEXIST | OFN_HIDEREADONLY);
+    if (dlg.DoModal() == IDOK)
+    {
+        m_comparing = m_frameDecoder->setSplitWipeSource(dlg.GetPathName().GetString());
+    }
+}
+
+void CPlayerDoc::OnUpdateCompareWith(CCmdUI *pCmdUI)
+{
+    pCmdUI->SetCheck(m_comparing);
+}
+
 void CPlayerDoc::OnVideoSpeed(UINT id)
 {
     const int idx = id - ID_VIDEO_SPEED1;
@@ -64,6 +64,10 @@ protected:
     afx_msg void OnUpdateAutoplay(CCmdUI *pCmdUI);
     afx_msg void OnLooping();
     afx_msg void OnUpdateLooping(CCmdUI *pCmdUI);
+    afx_msg void OnAutoCrop();
+    afx_msg void OnUpdateAutoCrop(CCmdUI *pCmdUI);
+    afx_msg void OnCompareWith();
+    afx_msg void OnUpdateCompareWith(CCmdUI *pCmdUI);
     DECLARE_MESSAGE_MAP()
 
 #ifdef SHARED_HANDLERS
@@ -103,6 +107,9 @@ public:
     void OnEditPaste(const std::string& text);
 
     double getCurrentTime() const { return m_currentTime; }
+
+    // Follows the decoder's position, called at the refresh rate of the controls
+    void pollPosition();
 	double getStartTime() const { return m_startTime; }
 	double getEndTime() const { return m_endTime; }
 
@@ -117,12 +124,15 @@ private:
     void MoveToNextFile();
 
     bool openDocument(LPCTSTR lpszPathName);
+    bool openImageSequence(LPCTSTR lpszPathName);
     bool openTopLevelUrl(const CString& url, bool force, const CString& pathName = {});
     bool openUrl(const std::string& url);
     bool openUrlFromList();
     bool openUrlFromList(const std::vector<std::string>& playList, const CString& pathName = {});
 
     void reset();
+    void updateLoopRange();
+    void updatePosition(long long start, long long frame, long long total, double currentTime);
 
     float getVideoSpeed() const;
 
@@ -130,6 +140,7 @@ private:
     std::unique_ptr<IFrameDecoder> m_frameDecoder;
 
     std::atomic<double> m_currentTime;
+    std::atomic<long long> m_lastFramePosition{};
     double m_startTime;
     double m_endTime;
 
@@ -142,6 +153,8 @@ private:
     bool m_onEndOfStream;
     bool m_autoPlay;
     bool m_looping;
+    bool m_autoCrop;
+    bool m_comparing;
 
     std::string m_url;
 
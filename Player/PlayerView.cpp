@@ -8,6 +8,9 @@
 #include "GetClipboardText.h"
 
 #include "decoderinterface.h"
+#include "subtitlecache.h"
+#include "primitivetimer.h"
+#include "CopyAndConvert.h"
 
 //#include "D3DFont.h"
 
@@ -20,6 +23,7 @@
 
 #include <Gdiplus.h>
 
+#include <cmath>
 #include <vector>
 
 #ifdef _DEBUG
@@ -276,69 +280,6 @@ DXVA2_VideoSample GetVideoSample(
 #endif
 
 
-void SimdCopyAndConvert(
-    __m128i* const __restrict origin0,
-    __m128i* const __restrict origin1,
-    const __m128i* const __restrict src00,
-    const __m128i* const __restrict src01,
-    const double* const __restrict src0,
-    const double* const __restrict src1,
-    size_t count)
-{
-    for (size_t i = 0; i < count; ++i)
-    {
-        __m128i uv = _mm_unpacklo_epi8(
-            _mm_castpd_si128(_mm_load_sd(src0 + i)),
-            _mm_castpd_si128(_mm_load_sd(src1 + i)));
-        _mm_stream_si128(origin0 + i * 2, _mm_unpacklo_epi8(src00[i], uv));
-        _mm_stream_si128(origin0 + i * 2 + 1, _mm_unpackhi_epi8(src00[i], uv));
-        _mm_stream_si128(origin1 + i * 2, _mm_unpacklo_epi8(src01[i], uv));
-        _mm_stream_si128(origin1 + i * 2 + 1, _mm_unpackhi_epi8(src01[i], uv));
-    }
-}
-
-void CopyAndConvert(
-    uint32_t* __restrict origin0,
-    uint32_t* __restrict origin1,
-    const uint8_t* __restrict src00,
-    const uint8_t* __restrict src01,
-    const uint8_t* __restrict src0,
-    const uint8_t* __restrict src1,
-    size_t count)
-{
-    if (!((intptr_t(origin0) & 15) || (intptr_t(origin1) & 15)
-        || (intptr_t(src00) & 15) || (intptr_t(src01) & 15)
-        || (intptr_t(src0) & 7) || (intptr_t(src1) & 7)))
-    {
-        const auto simdCount = count / 8;
-
-        SimdCopyAndConvert(
-            (__m128i*) origin0,
-            (__m128i*) origin1,
-            (const __m128i*) src00,
-            (const __m128i*) src01,
-            (const double*) src0,
-            (const double*) src1,
-            simdCount);
-
-        origin0 += simdCount * 8;
-        origin1 += simdCount * 8;
-        src00 += simdCount * 16;
-        src01 += simdCount * 16;
-        src0 += simdCount * 8;
-        src1 += simdCount * 8;
-
-        count -= simdCount * 8;
-    }
-
-    for (unsigned int j = 0; j < count; ++j)
-    {
-        const uint32_t uv = (src0[j] << 8) | (src1[j] << 24);
-        origin0[j] = uv | src00[j * 2] | (src00[j * 2 + 1] << 16);
-        origin1[j] = uv | src01[j * 2] | (src01[j * 2 + 1] << 16);
-    }
-}
-
 // subtitles
 
 enum { MAX_NUM_VERTICES = 50 * 6 };
@@ -404,114 +345,62 @@ CComPtr<IDirect3DStateBlock9> InitStateBlock(LPDIRECT3DDEVICE9 pd3dDevice,
     return result;
 }
 
-void DrawSubtitleText(LPDIRECT3DDEVICE9 pd3dDevice, int width, int height, const WCHAR* text)
+int SubtitleFontSize(int width)
+{
+    return max(width / 60, 9);
+}
+
+// Renders the cue white on transparent and keeps its coverage only
+bool RasterizeSubtitle(const SubtitleCache::Key& key, SubtitleBitmap& result)
 {
     using namespace Gdiplus;
 
-    const int fontSize = max(width / 60, 9);
-    Gdiplus::Font font(L"MS Sans Serif", (REAL)fontSize);
+    Gdiplus::Font font(CA2W(key.style.c_str()), (REAL)SubtitleFontSize(key.width));
 
+    CA2W text(key.text.c_str(), CP_UTF8);
     const auto length = wcslen(text);
     RectF boundingBox;
 
     {
         Bitmap bitmap(1, 1);
         Graphics graphics(&bitmap);
-        graphics.SetTextRenderingHint(TextRenderingHintSingleBitPerPixelGridFit);
+        graphics.SetTextRenderingHint(TextRenderingHintAntiAliasGridFit);
         graphics.MeasureString(text, length, &font, PointF(0, 0), &boundingBox);
     }
 
-    CComPtr<IDirect3DTexture9> pTexture;
-
-    // Create a new texture for the font
-    if (FAILED(pd3dDevice->CreateTexture(boundingBox.Width, boundingBox.Height, 1,
-        0,
-        D3DFMT_A4R4G4B4,
-        D3DPOOL_MANAGED, &pTexture, NULL)))
-    {
-        return;
-    }
-
-    D3DLOCKED_RECT d3dlr;
-    if (FAILED(pTexture->LockRect(0, &d3dlr, 0, 0)))
-        return;
+    const int width = static_cast<int>(ceil(boundingBox.Width));
+    const int height = static_cast<int>(ceil(boundingBox.Height));
+    if (width <= 0 || height <= 0)
+        return false;
 
+    Bitmap bitmap(width, height, PixelFormat32bppARGB);
     {
-        Bitmap bitmap(boundingBox.Width, boundingBox.Height, d3dlr.Pitch,
-            PixelFormat16bppRGB565,
-            static_cast<BYTE*>(d3dlr.pBits));
-
         Graphics graphics(&bitmap);
-        graphics.SetTextRenderingHint(TextRenderingHintSingleBitPerPixelGridFit);
+        graphics.SetTextRenderingHint(TextRenderingHintAntiAliasGridFit);
+        graphics.Clear(Color(0, 0, 0, 0));
 
         SolidBrush whiteBrush(Color(0xFF, 0xFF, 0xFF));
         graphics.DrawString(text, length, &font, PointF(0, 0), &whiteBrush);
     }
 
-    pTexture->UnlockRect(0);
-
-    CComPtr<IDirect3DVertexBuffer9> pVB;
-    // Create vertex buffer for the letters
-    if (FAILED(pd3dDevice->CreateVertexBuffer(MAX_NUM_VERTICES * sizeof(FONT2DVERTEX),
-        D3DUSAGE_WRITEONLY | D3DUSAGE_DYNAMIC, 0,
-        D3DPOOL_DEFAULT, &pVB, NULL)))
-    {
-        return;
-    }
-
-    CComPtr<IDirect3DStateBlock9> pStateBlockSaved(InitStateBlock(pd3dDevice, pTexture));
-    if (!pStateBlockSaved)
-        return;
-
-    CComPtr<IDirect3DStateBlock9> pStateBlockDrawText(InitStateBlock(pd3dDevice, pTexture));
-    if (!pStateBlockDrawText)
-        return;
-
-    // Setup renderstate
-    pStateBlockSaved->Capture();
-    pStateBlockDrawText->Apply();
-    pd3dDevice->SetFVF(D3DFVF_XYZRHW | D3DFVF_DIFFUSE | D3DFVF_TEX1);
-    pd3dDevice->SetPixelShader(NULL);
-    pd3dDevice->SetStreamSource(0, pVB, 0, sizeof(FONT2DVERTEX));
-
-    const FLOAT tx1 = 0;
-    const FLOAT ty1 = 0;
-    const FLOAT tx2 = 1;
-    const FLOAT ty2 = 1;
-
-    const FLOAT w = boundingBox.Width;
-    const FLOAT h = boundingBox.Height;
-
-    // Fill vertex buffer
-    FONT2DVERTEX* pVertices = NULL;
-    DWORD         dwNumTriangles = 0;
-    if (FAILED(pVB->Lock(0, 0, (void**)&pVertices, D3DLOCK_DISCARD)))
-        return;
+    Gdiplus::Rect rect(0, 0, width, height);
+    BitmapData data;
+    if (bitmap.LockBits(&rect, ImageLockModeRead, PixelFormat32bppARGB, &data) != Ok)
+        return false;
 
-    for (int pass = 0; pass < 2; ++pass)
+    result.width = width;
+    result.height = height;
+    result.alpha.resize(width * height);
+    for (int y = 0; y < height; ++y)
     {
-        const FLOAT sx = (width - boundingBox.Width) / 2 + !pass;
-        const FLOAT sy = height - boundingBox.Height - fontSize / 3 + !pass;
-
-        const DWORD dwColor = pass? D3DCOLOR_XRGB(255, 255, 255) : D3DCOLOR_XRGB(0, 0, 0);
-
-        *pVertices++ = { { sx + 0, sy + h, 0.9f, 1.0f }, dwColor, tx1, ty2 };
-        *pVertices++ = { { sx + 0, sy + 0, 0.9f, 1.0f }, dwColor, tx1, ty1 };
-        *pVertices++ = { { sx + w, sy + h, 0.9f, 1.0f }, dwColor, tx2, ty2 };
-        *pVertices++ = { { sx + w, sy + 0, 0.9f, 1.0f }, dwColor, tx2, ty1 };
-        *pVertices++ = { { sx + w, sy + h, 0.9f, 1.0f }, dwColor, tx2, ty2 };
-        *pVertices++ = { { sx + 0, sy + 0, 0.9f, 1.0f }, dwColor, tx1, ty1 };
-
-        dwNumTriangles += 2;
+        const auto src = static_cast<const BYTE*>(data.Scan0) + y * data.Stride;
+        auto dst = result.alpha.data() + y * width;
+        for (int x = 0; x < width; ++x)
+            dst[x] = src[x * 4 + 3];
     }
 
-    // Unlock and render the vertex buffer
-    pVB->Unlock();
-    if (dwNumTriangles > 0)
-        pd3dDevice->DrawPrimitive(D3DPT_TRIANGLELIST, 0, dwNumTriangles);
-
-    // Restore the modified renderstates
-    pStateBlockSaved->Apply();
+    bitmap.UnlockBits(&data);
+    return true;
 }
 
 } // namespace
@@ -553,6 +442,7 @@ IMPLEMENT_DYNCREATE(CPlayerView, CView)
 CPlayerView::CPlayerView()
 : m_frameListener(new FrameListener(this))
 , m_aspectRatio(1, 1)
+, m_subtitleCache(std::make_unique<SubtitleCache>(RasterizeSubtitle))
 {
 }
 
@@ -567,6 +457,7 @@ BEGIN_MESSAGE_MAP(CPlayerView, CView)
     ON_WM_CREATE()
     ON_WM_ERASEBKGND()
     ON_WM_DROPFILES()
+    ON_WM_MOUSEMOVE()
 END_MESSAGE_MAP()
 
 
@@ -938,6 +829,12 @@ void CPlayerView::DestroyExtra()
     //    m_subtitleFont.reset();
     //}
 
+    m_pSubtitleStateDraw.Release();
+    m_pSubtitleStateSaved.Release();
+    m_pSubtitleVB.Release();
+    m_pSubtitleTexture.Release();
+    m_subtitleBitmap.reset();
+
     m_pMainStream.Release();
 #ifdef USE_DXVA2
     m_pDXVAVPD.Release();
@@ -946,6 +843,114 @@ void CPlayerView::DestroyExtra()
     m_pD3DRT.Release();
 }
 
+// The cue is rasterized once, its texture kept while it is shown, the rest only blends it
+void CPlayerView::DrawSubtitleText(int width, int height, const std::string& text)
+{
+    auto bitmap = m_subtitleCache->get({ text, "MS Sans Serif", width, height });
+    if (!bitmap)
+        return;
+
+    if (bitmap != m_subtitleBitmap)
+    {
+        m_subtitleBitmap.reset();
+        m_pSubtitleTexture.Release();
+
+        if (FAILED(m_pD3DD9->CreateTexture(bitmap->width, bitmap->height, 1,
+            0,
+            D3DFMT_A8R8G8B8,
+            D3DPOOL_MANAGED, &m_pSubtitleTexture, NULL)))
+        {
+            return;
+        }
+
+        D3DLOCKED_RECT d3dlr;
+        if (FAILED(m_pSubtitleTexture->LockRect(0, &d3dlr, 0, 0)))
+        {
+            m_pSubtitleTexture.Release();
+            return;
+        }
+
+        for (int y = 0; y < bitmap->height; ++y)
+        {
+            const auto src = bitmap->alpha.data() + y * bitmap->width;
+            auto dst = reinterpret_cast<DWORD*>(static_cast<BYTE*>(d3dlr.pBits) + y * d3dlr.Pitch);
+            for (int x = 0; x < bitmap->width; ++x)
+                dst[x] = (DWORD(src[x]) << 24) | 0xFFFFFF;
+        }
+
+        m_pSubtitleTexture->UnlockRect(0);
+        m_subtitleBitmap = bitmap;
+    }
+
+    if (!m_pSubtitleVB)
+    {
+        // Create vertex buffer for the letters
+        if (FAILED(m_pD3DD9->CreateVertexBuffer(MAX_NUM_VERTICES * sizeof(FONT2DVERTEX),
+            D3DUSAGE_WRITEONLY | D3DUSAGE_DYNAMIC, 0,
+            D3DPOOL_DEFAULT, &m_pSubtitleVB, NULL)))
+        {
+            return;
+        }
+    }
+
+    // The texture is not part of the state blocks so that they survive cue changes
+    if (!m_pSubtitleStateSaved)
+        m_pSubtitleStateSaved = InitStateBlock(m_pD3DD9, nullptr);
+    if (!m_pSubtitleStateDraw)
+        m_pSubtitleStateDraw = InitStateBlock(m_pD3DD9, nullptr);
+    if (!m_pSubtitleStateSaved || !m_pSubtitleStateDraw)
+        return;
+
+    // Setup renderstate
+    m_pSubtitleStateSaved->Capture();
+    m_pSubtitleStateDraw->Apply();
+    m_pD3DD9->SetTexture(0, m_pSubtitleTexture);
+    m_pD3DD9->SetFVF(D3DFVF_XYZRHW | D3DFVF_DIFFUSE | D3DFVF_TEX1);
+    m_pD3DD9->SetPixelShader(NULL);
+    m_pD3DD9->SetStreamSource(0, m_pSubtitleVB, 0, sizeof(FONT2DVERTEX));
+
+    const FLOAT tx1 = 0;
+    const FLOAT ty1 = 0;
+    const FLOAT tx2 = 1;
+    const FLOAT ty2 = 1;
+
+    const FLOAT w = (FLOAT)bitmap->width;
+    const FLOAT h = (FLOAT)bitmap->height;
+
+    const int fontSize = SubtitleFontSize(width);
+
+    // Fill vertex buffer
+    FONT2DVERTEX* pVertices = NULL;
+    DWORD         dwNumTriangles = 0;
+    if (SUCCEEDED(m_pSubtitleVB->Lock(0, 0, (void**)&pVertices, D3DLOCK_DISCARD)))
+    {
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            const FLOAT sx = (width - w) / 2 + !pass;
+            const FLOAT sy = height - h - fontSize / 3 + !pass;
+
+            const DWORD dwColor = pass? D3DCOLOR_XRGB(255, 255, 255) : D3DCOLOR_XRGB(0, 0, 0);
+
+            *pVertices++ = { { sx + 0, sy + h, 0.9f, 1.0f }, dwColor, tx1, ty2 };
+            *pVertices++ = { { sx + 0, sy + 0, 0.9f, 1.0f }, dwColor, tx1, ty1 };
+            *pVertices++ = { { sx + w, sy + h, 0.9f, 1.0f }, dwColor, tx2, ty2 };
+            *pVertices++ = { { sx + w, sy + 0, 0.9f, 1.0f }, dwColor, tx2, ty1 };
+            *pVertices++ = { { sx + w, sy + h, 0.9f, 1.0f }, dwColor, tx2, ty2 };
+            *pVertices++ = { { sx + 0, sy + 0, 0.9f, 1.0f }, dwColor, tx1, ty1 };
+
+            dwNumTriangles += 2;
+        }
+
+        // Unlock and render the vertex buffer
+        m_pSubtitleVB->Unlock();
+        if (dwNumTriangles > 0)
+            m_pD3DD9->DrawPrimitive(D3DPT_TRIANGLELIST, 0, dwNumTriangles);
+    }
+
+    // Restore the modified renderstates
+    m_pSubtitleStateSaved->Apply();
+}
+
 void CPlayerView::DestroyD3D9()
 {
     m_pD3DD9.Release();
@@ -1134,8 +1139,9 @@ bool CPlayerView::ProcessVideo()
             //m_subtitleFont->DrawText(left + 1, top + 1, D3DCOLOR_XRGB(0, 0, 0), convertedSubtitle);
             //m_subtitleFont->DrawText(left, top, D3DCOLOR_XRGB(255, 255, 255), convertedSubtitle);
 
-            DrawSubtitleText(m_pD3DD9, target.Width(), target.Height(), 
-                CA2W(subtitle.c_str(), GetDocument()->isUnicodeSubtitles()? CP_UTF8 : CP_ACP));
+            if (!GetDocument()->isUnicodeSubtitles())
+                subtitle = CW2A(CA2W(subtitle.c_str(), CP_ACP), CP_UTF8);
+            DrawSubtitleText(target.Width(), target.Height(), subtitle);
 
             m_pD3DD9->EndScene();
         }
@@ -1299,16 +1305,19 @@ void CPlayerView::updateFrame()
         }
 
 #ifdef CONVERT_FROM_YUV420P
-        for (int i = 0; i < data.height / 2; ++i)
         {
-            CopyAndConvert(
-                (uint32_t*)((char*)lr.pBits + lr.Pitch * 2 * i),
-                (uint32_t*)((char*)lr.pBits + lr.Pitch * (2 * i + 1)),
-                data.image[0] + data.pitch[0] * 2 * i,
-                data.image[0] + data.pitch[0] * (2 * i + 1),
-                data.image[1] + data.pitch[1] * i,
-                data.image[2] + data.pitch[2] * i,
-                data.width / 2);
+            PrimitiveTimer timer(PRIMITIVE_COPY_AND_CONVERT);
+            for (int i = 0; i < data.height / 2; ++i)
+            {
+                CopyAndConvert(
+                    (uint32_t*)((char*)lr.pBits + lr.Pitch * 2 * i),
+                    (uint32_t*)((char*)lr.pBits + lr.Pitch * (2 * i + 1)),
+                    data.image[0] + data.pitch[0] * 2 * i,
+                    data.image[0] + data.pitch[0] * (2 * i + 1),
+                    data.image[1] + data.pitch[1] * i,
+                    data.image[2] + data.pitch[2] * i,
+                    data.width / 2);
+            }
         }
 #else
         const size_t lineSize = (size_t)min(lr.Pitch, data.width * 2);
@@ -1410,3 +1419,18 @@ void CPlayerView::OnDropFiles(HDROP hDropInfo)
     GetDocument()->OnDropFiles(hDropInfo);
     __super::OnDropFiles(hDropInfo);
 }
+
+void CPlayerView::OnMouseMove(UINT nFlags, CPoint point)
+{
+    // The split wipe of a comparison follows the mouse while Shift is held, from the next frame on
+    if ((nFlags & MK_SHIFT) && GetDocument()->m_comparing)
+    {
+        const CRect screenPosition = GetScreenPosition();
+        if (screenPosition.Width() > 0)
+        {
+            GetDocument()->getFrameDecoder()->setSplitWipePosition(
+                double(point.x - screenPosition.left) / screenPosition.Width());
+        }
+    }
+    __super::OnMouseMove(nFlags, point);
+}
@@ -3,6 +3,7 @@
 #include "IEraseableArea.h"
 
 #include <memory>
+#include <string>
 
 struct IFrameListener;
 
@@ -11,6 +12,12 @@ struct IDirect3DDevice9;
 struct IDirect3DSurface9;
 struct IDirectXVideoProcessorService;
 struct IDirectXVideoProcessor;
+struct IDirect3DTexture9;
+struct IDirect3DVertexBuffer9;
+struct IDirect3DStateBlock9;
+
+class SubtitleCache;
+struct SubtitleBitmap;
 
 //class CD3DFont;
 
@@ -57,6 +64,7 @@ private:
 #endif
     bool ResetDevice();
     bool ProcessVideo();
+    void DrawSubtitleText(int width, int height, const std::string& text);
 
     CRect GetScreenPosition();
 
@@ -83,6 +91,13 @@ private:
 
     //std::unique_ptr<CD3DFont> m_subtitleFont;
 
+    std::unique_ptr<SubtitleCache> m_subtitleCache;
+    std::shared_ptr<const SubtitleBitmap> m_subtitleBitmap; // the one in m_pSubtitleTexture
+    CComPtr<IDirect3DTexture9> m_pSubtitleTexture;
+    CComPtr<IDirect3DVertexBuffer9> m_pSubtitleVB;
+    CComPtr<IDirect3DStateBlock9> m_pSubtitleStateSaved;
+    CComPtr<IDirect3DStateBlock9> m_pSubtitleStateDraw;
+
 public:
     afx_msg void OnPaint();
     virtual BOOL PreCreateWindow(CREATESTRUCT& cs);
@@ -91,4 +106,5 @@ public:
     virtual void OnUpdate(CView* /*pSender*/, LPARAM /*lHint*/, CObject* /*pHint*/);
     afx_msg void OnDropFiles(HDROP hDropInfo);
     afx_msg void OnEditPaste();
+    afx_msg void OnMouseMove(UINT nFlags, CPoint point);
 };
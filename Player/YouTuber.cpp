@@ -32,6 +32,7 @@
 
 #include "unzip.h"
 #include "http_get.h"
+#include "http_client.h"
 
 #include "MemoryMappedFile.h"
 
@@ -590,30 +591,12 @@ std::vector<std::string> ParsePlaylist(std::string url, bool force)
         return{};
 
     CWaitCursor wait;
-    CComVariant varBody = HttpGet(url.c_str());
-    if ((VT_ARRAY | VT_UI1) != V_VT(&varBody))
+    const auto response = HttpClient::Instance().get(url);
+    if (response.status == 0)
         return{};
 
-    auto psa = V_ARRAY(&varBody);
-    LONG iLBound, iUBound;
-    HRESULT hr = SafeArrayGetLBound(psa, 1, &iLBound);
-    if (FAILED(hr))
-        return{};
-    hr = SafeArrayGetUBound(psa, 1, &iUBound);
-    if (FAILED(hr))
-        return{};
-
-    const char* pData = nullptr;
-
-    hr = SafeArrayAccessData(psa, (void**)&pData);
-    if (FAILED(hr) || !pData)
-        return{};
-
-    const char* const pDataEnd = pData + iUBound - iLBound + 1;
-
-    std::unique_ptr<SAFEARRAY, decltype(&SafeArrayUnaccessData)> guard(
-        psa, SafeArrayUnaccessData);
-    return ParsePlaylist(pData, pDataEnd);
+    auto* const pData = response.body.data();
+    return ParsePlaylist(pData, pData + response.body.size());
 }
 
 std::vector<std::string> ParsePlaylistFile(const TCHAR* fileName)
@@ -52,13 +52,15 @@
 #define ID_VIDEO_SPEED6                 32782
 #define ID_VIDEO_SPEED7                 32783
 #define ID_NIGHTCORE                    32784
+#define ID_AUTO_CROP                    32785
+#define ID_COMPARE_WITH                 32786
 
 // Next default values for new objects
 // 
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        321
-#define _APS_NEXT_COMMAND_VALUE         32785
+#define _APS_NEXT_COMMAND_VALUE         32787
 #define _APS_NEXT_CONTROL_VALUE         1018
 #define _APS_NEXT_SYMED_VALUE           310
 #endif
@@ -0,0 +1,287 @@
+#include "http_client.h"
+
+#include <windows.h>
+#include <winhttp.h>
+
+#include <algorithm>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#pragma comment(lib, "Winhttp")
+
+namespace {
+
+const wchar_t USER_AGENT[]
+    = L"Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/77.0.3865.75 Safari/537.36";
+
+enum { CONNECT_TIMEOUT_MS = 10000, TRANSFER_TIMEOUT_MS = 30000 };
+
+auto MakeGuard(HINTERNET h)
+{
+    return std::unique_ptr<std::remove_pointer_t<HINTERNET>, decltype(&WinHttpCloseHandle)>
+        (h, WinHttpCloseHandle);
+}
+
+std::wstring ToWide(const std::string& s)
+{
+    const int size = MultiByteToWideChar(CP_UTF8, 0, s.c_str(), static_cast<int>(s.size()), nullptr, 0);
+    std::wstring result(size, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, s.c_str(), static_cast<int>(s.size()), &result[0], size);
+    return result;
+}
+
+} // namespace
+
+// static
+HttpClient& HttpClient::Instance()
+{
+    static HttpClient instance;
+    return instance;
+}
+
+HttpClient::HttpClient()
+    : m_session(WinHttpOpen(USER_AGENT,
+        WINHTTP_ACCESS_TYPE_DEFAULT_PROXY,
+        WINHTTP_NO_PROXY_NAME,
+        WINHTTP_NO_PROXY_BYPASS, 0))
+{
+    if (m_session != nullptr)
+    {
+        WinHttpSetTimeouts(m_session, 0, CONNECT_TIMEOUT_MS, TRANSFER_TIMEOUT_MS, TRANSFER_TIMEOUT_MS);
+    }
+}
+
+HttpClient::~HttpClient()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_asyncMutex);
+        m_stopping = true;
+    }
+    m_asyncCV.notify_all();
+    for (auto& thread : m_asyncThreads)
+    {
+        thread.join();
+    }
+
+    m_connections.clear();
+    if (m_session != nullptr)
+    {
+        WinHttpCloseHandle(m_session);
+    }
+}
+
+std::shared_ptr<void> HttpClient::connection(const HostKey& host)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_connections.find(host);
+    if (it != m_connections.end())
+    {
+        it->second.lastUse = ++m_uses;
+        return it->second.handle;
+    }
+
+    const HINTERNET handle = WinHttpConnect(m_session, host.first.c_str(), host.second, 0);
+    if (handle == nullptr)
+    {
+        return nullptr;
+    }
+
+    if (m_connections.size() >= MAX_CONNECTIONS)
+    {
+        // Playlist checks touch many hosts once, the least recently used one goes
+        m_connections.erase(std::min_element(m_connections.begin(), m_connections.end(),
+            [](const auto& left, const auto& right) { return left.second.lastUse < right.second.lastUse; }));
+    }
+
+    std::shared_ptr<void> result(handle, WinHttpCloseHandle);
+    m_connections.emplace(host, Connection{ result, ++m_uses });
+    return result;
+}
+
+size_t HttpClient::connections() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_connections.size();
+}
+
+std::future<HttpResponse> HttpClient::sendAsync(HttpRequest request)
+{
+    std::packaged_task<HttpResponse()> task([this, request = std::move(request)] { return send(request); });
+    auto result = task.get_future();
+    {
+        std::lock_guard<std::mutex> lock(m_asyncMutex);
+        m_asyncTasks.push_back(std::move(task));
+        if (m_asyncThreads.empty())
+        {
+            for (int i = 0; i < ASYNC_THREADS; ++i)
+            {
+                m_asyncThreads.emplace_back(&HttpClient::asyncRunnable, this);
+            }
+        }
+    }
+    m_asyncCV.notify_one();
+    return result;
+}
+
+void HttpClient::asyncRunnable()
+{
+    for (;;)
+    {
+        std::packaged_task<HttpResponse()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_asyncMutex);
+            m_asyncCV.wait(lock, [this] { return m_stopping || !m_asyncTasks.empty(); });
+            if (m_asyncTasks.empty())
+            {
+                return; // stopping, everything queued has been sent
+            }
+            task = std::move(m_asyncTasks.front());
+            m_asyncTasks.pop_front();
+        }
+        task();
+    }
+}
+
+HttpResponse HttpClient::send(const HttpRequest& request)
+{
+    HttpResponse response;
+    if (m_session == nullptr)
+    {
+        return response;
+    }
+
+    const std::wstring url = ToWide(request.url);
+    URL_COMPONENTS urlComp{ sizeof(urlComp) };
+
+    // Set required component lengths to non-zero
+    // so that they are cracked.
+    urlComp.dwSchemeLength = (DWORD)-1;
+    urlComp.dwHostNameLength = (DWORD)-1;
+    urlComp.dwUrlPathLength = (DWORD)-1;
+    urlComp.dwExtraInfoLength = (DWORD)-1;
+
+    if (!WinHttpCrackUrl(url.c_str(), static_cast<DWORD>(url.length()), 0, &urlComp))
+    {
+        return response;
+    }
+
+    const auto hConnect = connection(HostKey(
+        std::wstring(urlComp.lpszHostName, urlComp.lpszHostName + urlComp.dwHostNameLength),
+        urlComp.nPort));
+    if (!hConnect)
+    {
+        return response;
+    }
+
+    // Path and query string are adjacent in the url
+    const std::wstring path(urlComp.lpszUrlPath,
+        urlComp.lpszUrlPath + urlComp.dwUrlPathLength + urlComp.dwExtraInfoLength);
+
+    auto hRequest = MakeGuard(WinHttpOpenRequest(hConnect.get(), request.headOnly ? L"HEAD" : L"GET",
+        path.c_str(),
+        NULL, WINHTTP_NO_REFERER,
+        WINHTTP_DEFAULT_ACCEPT_TYPES,
+        (urlComp.nScheme == INTERNET_SCHEME_HTTPS) ? WINHTTP_FLAG_SECURE : 0));
+    if (!hRequest)
+    {
+        return response;
+    }
+
+    std::wstring headers;
+    if (request.rangeBegin >= 0)
+    {
+        headers = L"Range: bytes=" + std::to_wstring(request.rangeBegin) + L'-';
+        if (request.rangeEnd >= 0)
+        {
+            headers += std::to_wstring(request.rangeEnd);
+        }
+    }
+
+    if (!WinHttpSendRequest(hRequest.get(),
+            headers.empty() ? WINHTTP_NO_ADDITIONAL_HEADERS : headers.c_str(),
+            headers.empty() ? 0 : static_cast<DWORD>(-1L),
+            WINHTTP_NO_REQUEST_DATA, 0,
+            0, 0)
+        || !WinHttpReceiveResponse(hRequest.get(), NULL))
+    {
+        return response;
+    }
+
+    DWORD status = 0;
+    DWORD size = sizeof(status);
+    if (!WinHttpQueryHeaders(hRequest.get(), WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
+            WINHTTP_HEADER_NAME_BY_INDEX, &status, &size, WINHTTP_NO_HEADER_INDEX))
+    {
+        return response;
+    }
+    response.status = status;
+
+    wchar_t contentLength[32];
+    size = sizeof(contentLength);
+    if (WinHttpQueryHeaders(hRequest.get(), WINHTTP_QUERY_CONTENT_LENGTH,
+            WINHTTP_HEADER_NAME_BY_INDEX, contentLength, &size, WINHTTP_NO_HEADER_INDEX))
+    {
+        response.contentLength = _wtoi64(contentLength);
+    }
+
+    if (request.headOnly)
+    {
+        return response;
+    }
+
+    if (response.contentLength > 0 && !request.onData)
+    {
+        response.body.reserve(static_cast<size_t>(response.contentLength));
+    }
+
+    // Reading the body to the end lets the connection go back to the pool
+    std::vector<char> buf;
+    for (;;)
+    {
+        DWORD dwSize = 0;
+        if (!WinHttpQueryDataAvailable(hRequest.get(), &dwSize) || dwSize == 0)
+        {
+            break;
+        }
+
+        if (buf.size() < dwSize)
+            buf.resize(dwSize);
+
+        DWORD dwDownloaded = 0;
+        if (!WinHttpReadData(hRequest.get(), buf.data(), dwSize, &dwDownloaded) || dwDownloaded == 0)
+        {
+            break;
+        }
+
+        if (request.onData)
+        {
+            if (!request.onData(buf.data(), dwDownloaded))
+            {
+                break;
+            }
+        }
+        else
+        {
+            response.body.append(buf.data(), dwDownloaded);
+        }
+    }
+
+    return response;
+}
+
+HttpResponse HttpClient::head(const std::string& url)
+{
+    HttpRequest request;
+    request.url = url;
+    request.headOnly = true;
+    return send(request);
+}
+
+HttpResponse HttpClient::get(const std::string& url)
+{
+    HttpRequest request;
+    request.url = url;
+    return send(request);
+}
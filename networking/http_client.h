@@ -0,0 +1,85 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+typedef void* HINTERNET;
+
+// Gets every piece of the body as it arrives, returning false stops the transfer
+typedef std::function<bool(const char* data, size_t size)> HttpDataCallback;
+
+struct HttpRequest
+{
+    std::string url;
+    bool headOnly = false;
+    int64_t rangeBegin = -1;    // asks for bytes=rangeBegin-rangeEnd when set
+    int64_t rangeEnd = -1;      // open ended if not set
+    HttpDataCallback onData;    // streams the body instead of collecting it
+};
+
+struct HttpResponse
+{
+    long status = 0;            // 0 if the request could not be made
+    int64_t contentLength = -1; // -1 if unknown
+    std::string body;           // empty for HEAD and streamed requests
+};
+
+// One WinHTTP session for the process: connections are kept alive and reused per host,
+// no COM apartment or object per request
+class HttpClient
+{
+public:
+    enum { ASYNC_THREADS = 4, MAX_CONNECTIONS = 16 };
+
+    static HttpClient& Instance();
+
+    ~HttpClient();
+    HttpClient(const HttpClient&) = delete;
+    HttpClient& operator=(const HttpClient&) = delete;
+
+    HttpResponse send(const HttpRequest& request);
+    // Sent by one of ASYNC_THREADS worker threads, requests beyond that wait their turn
+    std::future<HttpResponse> sendAsync(HttpRequest request);
+
+    HttpResponse head(const std::string& url);
+    HttpResponse get(const std::string& url);
+
+    // Hosts with a connection kept, at most MAX_CONNECTIONS
+    size_t connections() const;
+
+private:
+    HttpClient();
+
+    typedef std::pair<std::wstring, unsigned short> HostKey;
+    // Null if the host cannot be reached, a connection evicted meanwhile stays open until released
+    std::shared_ptr<void> connection(const HostKey& host);
+
+    void asyncRunnable();
+
+    struct Connection
+    {
+        std::shared_ptr<void> handle;
+        uint64_t lastUse;
+    };
+
+    HINTERNET m_session;
+    mutable std::mutex m_mutex;
+    std::map<HostKey, Connection> m_connections;
+    uint64_t m_uses = 0;
+
+    std::mutex m_asyncMutex;
+    std::condition_variable m_asyncCV;
+    std::deque<std::packaged_task<HttpResponse()>> m_asyncTasks;
+    std::vector<std::thread> m_asyncThreads; // started with the first async request
+    bool m_stopping = false;
+};
@@ -1,70 +1,34 @@
 #include "http_get.h"
 
-#include "httprequest_h.h"
-
-namespace {
-
-const wchar_t USER_AGENT[]
-    = L"Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/77.0.3865.75 Safari/537.36";
-
-class CComUsageScope
-{
-    bool m_bInitialized;
-public:
-    explicit CComUsageScope(DWORD dwCoInit = COINIT_MULTITHREADED | COINIT_SPEED_OVER_MEMORY)
-    {
-        m_bInitialized = SUCCEEDED(CoInitializeEx(NULL, dwCoInit));
-    }
-    ~CComUsageScope()
-    {
-        if (m_bInitialized)
-            CoUninitialize();
-    }
-};
-
-} // namespace
+#include "http_client.h"
 
+// Kept for existing callers, both go through the pooled client now
 
 long HttpGetStatus(const char * url)
 {
-    VARIANT varFalse{ VT_BOOL };
-    VARIANT varEmpty{ VT_ERROR };
-
-    HRESULT result = 0;
-
-    CComPtr<IWinHttpRequest> pIWinHttpRequest;
-
-    CComUsageScope scope;
-
-    if (SUCCEEDED(result = pIWinHttpRequest.CoCreateInstance(L"WinHttp.WinHttpRequest.5.1", NULL, CLSCTX_INPROC_SERVER))
-        && SUCCEEDED(result = pIWinHttpRequest->Open(CComBSTR(L"HEAD"), CComBSTR(static_cast<const char*>(url)), varFalse))
-        && SUCCEEDED(result = pIWinHttpRequest->SetRequestHeader(CComBSTR(L"User-Agent"), CComBSTR(USER_AGENT)))
-        && SUCCEEDED(result = pIWinHttpRequest->Send(varEmpty)))
-    {
-        pIWinHttpRequest->get_Status(&result);
-    }
-
-    return result;
+    return HttpClient::Instance().head(url).status;
 }
 
 CComVariant HttpGet(const char * url)
 {
-    VARIANT varFalse{ VT_BOOL };
-    VARIANT varEmpty{ VT_ERROR };
-
     CComVariant varBody;
 
-    CComPtr<IWinHttpRequest> pIWinHttpRequest;
+    const auto response = HttpClient::Instance().get(url);
+    if (response.status == 0)
+        return varBody;
 
-    CComUsageScope scope;
+    SAFEARRAY* psa = SafeArrayCreateVector(VT_UI1, 0, static_cast<ULONG>(response.body.size()));
+    if (psa == nullptr)
+        return varBody;
 
-    if (SUCCEEDED(pIWinHttpRequest.CoCreateInstance(L"WinHttp.WinHttpRequest.5.1", NULL, CLSCTX_INPROC_SERVER))
-        && SUCCEEDED(pIWinHttpRequest->Open(CComBSTR(L"GET"), CComBSTR(static_cast<const char*>(url)), varFalse))
-        && SUCCEEDED(pIWinHttpRequest->SetRequestHeader(CComBSTR(L"User-Agent"), CComBSTR(USER_AGENT)))
-        && SUCCEEDED(pIWinHttpRequest->Send(varEmpty)))
+    void* pData = nullptr;
+    if (SUCCEEDED(SafeArrayAccessData(psa, &pData)))
     {
-        pIWinHttpRequest->get_ResponseBody(&varBody);
+        memcpy(pData, response.body.data(), response.body.size());
+        SafeArrayUnaccessData(psa);
     }
 
+    V_VT(&varBody) = VT_ARRAY | VT_UI1;
+    V_ARRAY(&varBody) = psa;
     return varBody;
 }
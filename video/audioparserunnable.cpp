@@ -35,16 +35,16 @@ void FFmpegDecoder::audioParseRunnable()
     CHANNEL_LOG(ffmpeg_threads) << "Audio thread started";
     AVPacket packet;
 
-    bool initialized = false;
-    bool failed = false;
+    AudioParseContext context;
 
+    m_audioLoopOffset = 0;
+
+    ApplyThreadPolicy(THREAD_ROLE_AUDIO);
     m_audioPlayer->InitializeThread();
     auto deinitializeThread = MakeGuard(
         m_audioPlayer.get(),
         std::mem_fn(&IAudioPlayer::DeinitializeThread));
 
-    std::vector<uint8_t> resampleBuffer;
-
     while (!boost::this_thread::interruption_requested())
     {
         if (!m_audioPacketsQueue.pop(packet))
@@ -54,47 +54,84 @@ void FFmpegDecoder::audioParseRunnable()
 
         auto packetGuard = MakeGuard(&packet, av_packet_unref);
 
-        if (m_audioStreamNumber != packet.stream_index)
+        if (!processAudioPacket(packet, context))
         {
-            continue;
+            break;
         }
+    }
+}
 
-        if (!initialized)
+bool FFmpegDecoder::processAudioPacket(const AVPacket& packet, AudioParseContext& context)
+{
+    if (m_audioStreamNumber != packet.stream_index)
+    {
+        return true;
+    }
+    m_controlMonitor.end(CONTROL_AUDIO_TRACK);
+
+    if (IsLoopMarker(packet))
+    {
+        handleAudioPacket(packet, context.resampleBuffer, context.failed); // drains the previous lap
+        flushAudioBatch();
+        avcodec_flush_buffers(m_audioCodecContext);
+        context.looping = true;
+        context.lapStarted = true;
+        return true;
+    }
+
+    if (context.looping)
+    {
+        const double pts = av_q2d(m_audioStream->time_base) * packet.pts;
+        if (packet.pts == AV_NOPTS_VALUE
+            || !isInLoopRange(pts, pts + av_q2d(m_audioStream->time_base) * packet.duration))
         {
-            if (packet.pts != AV_NOPTS_VALUE)
-            {
-                const double pts = av_q2d(m_audioStream->time_base) * packet.pts;
-                m_audioPTS = pts;
-            }
-            else
-            {
-                assert(false && "No audio pts found");
-                return;
-            }
+            return true;
+        }
+        if (context.lapStarted && context.initialized)
+        {
+            // The clock goes on, reported positions start over
+            m_audioLoopOffset = m_audioPTS - pts;
+        }
+        context.lapStarted = false;
+    }
 
-            // invoke changedFramePosition() if needed
-            //AppendFrameClock(0);
+    if (!context.initialized)
+    {
+        if (packet.pts != AV_NOPTS_VALUE)
+        {
+            const double pts = av_q2d(m_audioStream->time_base) * packet.pts;
+            m_audioPTS = pts;
         }
+        else
+        {
+            assert(false && "No audio pts found");
+            return false;
+        }
+
+        // invoke changedFramePosition() if needed
+        //AppendFrameClock(0);
+    }
 
-        initialized = true;
+    context.initialized = true;
 
-        if (handleAudioPacket(packet, resampleBuffer, failed))
+    if (handleAudioPacket(packet, context.resampleBuffer, context.failed))
+    {
+        if (context.failed)
         {
-            if (failed)
+            context.failed = false;
+            boost::unique_lock<boost::mutex> locker(m_isPausedMutex);
+            if (m_videoStartClock != VIDEO_START_CLOCK_NOT_INITIALIZED)
             {
-                failed = false;
-                boost::unique_lock<boost::mutex> locker(m_isPausedMutex);
-                if (m_videoStartClock != VIDEO_START_CLOCK_NOT_INITIALIZED)
-                {
-                    m_audioPTS = (m_isPaused ? m_pauseTimer : GetHiResTime()) - m_videoStartClock;
-                }
+                m_audioPTS = (m_isPaused ? m_pauseTimer : GetHiResTime()) - m_videoStartClock;
             }
         }
-        else
-        {
-            failed = true;
-        }
     }
+    else
+    {
+        context.failed = true;
+    }
+
+    return true;
 }
 
 bool FFmpegDecoder::handleAudioPacket(
@@ -112,19 +149,39 @@ bool FFmpegDecoder::handleAudioPacket(
         }
     }
 
+    const auto stageTime = [](boost::atomic<double>& total, boost::chrono::high_resolution_clock::time_point startTime)
+    {
+        InterlockedAdd(total, boost::chrono::duration_cast<boost::chrono::microseconds>(
+            boost::chrono::high_resolution_clock::now() - startTime).count() / 1000000.);
+    };
+
+    auto startTime = boost::chrono::high_resolution_clock::now();
     const int ret = avcodec_send_packet(m_audioCodecContext, &packet);
+    stageTime(m_audioDecodeTime, startTime);
     if (ret < 0) {
         return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF;
     }
 
     AVFramePtr audioFrame(av_frame_alloc());
     bool result = true;
-    while (avcodec_receive_frame(m_audioCodecContext, audioFrame.get()) == 0)
+    for (;;)
     {
+        startTime = boost::chrono::high_resolution_clock::now();
+        const bool received = avcodec_receive_frame(m_audioCodecContext, audioFrame.get()) == 0;
+        stageTime(m_audioDecodeTime, startTime);
+        if (!received)
+        {
+            break;
+        }
+
         if (audioFrame->nb_samples <= 0)
         {
             continue;
         }
+        if (audioFrame->sample_rate > 0)
+        {
+            InterlockedAdd(m_audioMediaTime, double(audioFrame->nb_samples) / audioFrame->sample_rate);
+        }
 
         const int original_buffer_size = av_samples_get_buffer_size(
             nullptr, audioFrame->channels,
@@ -157,12 +214,14 @@ bool FFmpegDecoder::handleAudioPacket(
 
             // Code for resampling
             uint8_t *out = resampleBuffer.data();
+            startTime = boost::chrono::high_resolution_clock::now();
             const int converted_size = swr_convert(
                 m_audioSwrContext, 
                 &out,
                 out_count,
                 const_cast<const uint8_t**>(getAudioData(audioFrame.get())),
                 audioFrame->nb_samples);
+            stageTime(m_audioResampleTime, startTime);
 
             if (converted_size < 0)
             {
@@ -206,21 +265,32 @@ bool FFmpegDecoder::handleAudioPacket(
                 m_audioPlayer->WaveOutPause();
                 m_audioPaused = true;
             }
+            m_controlMonitor.end(CONTROL_PAUSE);
 
             boost::unique_lock<boost::mutex> locker(m_isPausedMutex);
 
-            while (m_isVideoSeekingWhilePaused 
+            // Seeks are served by this very thread in audio only mode
+            while (!(m_audioOnly && isSeekRequested())
+                && (m_isVideoSeekingWhilePaused 
                 || (delta = (m_videoStartClock != VIDEO_START_CLOCK_NOT_INITIALIZED)
                     ? (m_isPaused ? m_pauseTimer : GetHiResTime()) - m_videoStartClock - m_audioPTS : 0
-                , m_isPaused && !(skipAll = delta >= frame_clock)))
+                , m_isPaused && !(skipAll = delta >= frame_clock))))
             {
                 m_isPausedCV.wait(locker);
+                if (m_audioOnly)
+                {
+                    countWakeup();
+                }
             }
         }
 
         // Audio sync
         if (!failed && !skipAll && fabs(delta) > 0.1)
         {
+            if (delta > 0)
+            {
+                ++m_audioLateResyncs; // audio fell behind the clock
+            }
             InterlockedAdd(m_videoStartClock, delta / 2);
         }
 
@@ -228,9 +298,11 @@ bool FFmpegDecoder::handleAudioPacket(
         {
             m_audioPlayer->WaveOutRestart();
             m_audioPaused = false;
+            m_controlMonitor.end(CONTROL_RESUME);
         }
 
-        if (boost::this_thread::interruption_requested())
+        if (boost::this_thread::interruption_requested()
+            || m_audioOnly && isSeekRequested())
         {
             return false;
         }
@@ -239,8 +311,7 @@ bool FFmpegDecoder::handleAudioPacket(
         {
             InterlockedAdd(m_audioPTS, frame_clock);
         }
-        else if (!(m_audioPlayer->WriteAudio(write_data, write_size)
-            || initAudioOutput() && m_audioPlayer->WriteAudio(write_data, write_size)))
+        else if (!writeAudio(write_data, write_size))
         {
             result = false;
         }
@@ -249,6 +320,41 @@ bool FFmpegDecoder::handleAudioPacket(
     return result;
 }
 
+bool FFmpegDecoder::writeAudio(uint8_t* write_data, int64_t write_size)
+{
+    if (!m_audioOnly)
+    {
+        return m_audioPlayer->WriteAudio(write_data, write_size)
+            || initAudioOutput() && m_audioPlayer->WriteAudio(write_data, write_size);
+    }
+
+    // Nothing else runs on this thread, so hand the device few large blocks rather than every frame
+    m_audioBatch.insert(m_audioBatch.end(), write_data, write_data + write_size);
+    const int64_t batchSize = int64_t(m_audioSettings.frequency) * m_audioSettings.channels
+        * av_get_bytes_per_sample(m_audioSettings.format) * AUDIO_BATCH_MS / 1000;
+    return int64_t(m_audioBatch.size()) < batchSize || flushAudioBatch();
+}
+
+bool FFmpegDecoder::flushAudioBatch()
+{
+    if (m_audioBatch.empty())
+    {
+        return true;
+    }
+
+    const bool result = m_audioPlayer->WriteAudio(m_audioBatch.data(), m_audioBatch.size())
+        || initAudioOutput() && m_audioPlayer->WriteAudio(m_audioBatch.data(), m_audioBatch.size());
+    m_audioBatch.clear();
+    countWakeup();
+    return result;
+}
+
+void FFmpegDecoder::countWakeup()
+{
+    ++m_audioOnlyWakeups;
+    m_audioOnlyCpuTime = GetThreadCpuTime();
+}
+
 void FFmpegDecoder::setupAudioSwrContext(AVFrame* audioFrame)
 {
     const auto audioFrameFormat = static_cast<AVSampleFormat>(audioFrame->format);
@@ -257,6 +363,7 @@ void FFmpegDecoder::setupAudioSwrContext(AVFrame* audioFrame)
     const int64_t dec_channel_layout = getChannelLayout(audioFrame);
 
     const auto speed = getSpeedRational();
+    m_controlMonitor.end(CONTROL_SPEED);
 
     // Check if the new swr context required
     if (audioFrameFormat != m_audioCurrentPref.format ||
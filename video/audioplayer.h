@@ -27,4 +27,7 @@ struct IAudioPlayer
     virtual void WaveOutRestart() = 0;
 
     virtual bool WriteAudio(uint8_t* write_data, int64_t write_size) = 0;
+
+    // Spent transforming samples on their way to the device, pitch shifting say; never reset
+    virtual double GetProcessingSeconds() const { return 0; }
 };
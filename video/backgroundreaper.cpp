@@ -0,0 +1,64 @@
+#include "backgroundreaper.h"
+
+#include "threadpolicy.h"
+
+#include <boost/log/trivial.hpp>
+
+BackgroundReaper::~BackgroundReaper()
+{
+    {
+        boost::lock_guard<boost::mutex> locker(m_mutex);
+        m_stopping = true;
+    }
+    m_condVar.notify_all();
+
+    if (m_thread)
+    {
+        m_thread->join();
+    }
+}
+
+void BackgroundReaper::post(std::function<void()> task)
+{
+    {
+        boost::lock_guard<boost::mutex> locker(m_mutex);
+        m_tasks.push_back(std::move(task));
+        if (!m_thread)
+        {
+            m_thread = std::make_unique<boost::thread>(&BackgroundReaper::run, this);
+        }
+    }
+    m_condVar.notify_all();
+}
+
+void BackgroundReaper::run()
+{
+    ApplyThreadPolicy(THREAD_ROLE_BACKGROUND);
+
+    for (;;)
+    {
+        std::function<void()> task;
+        {
+            boost::unique_lock<boost::mutex> locker(m_mutex);
+            while (m_tasks.empty())
+            {
+                if (m_stopping)
+                {
+                    return;
+                }
+                m_condVar.wait(locker);
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+
+        try
+        {
+            task();
+        }
+        catch (const std::exception& e)
+        {
+            BOOST_LOG_TRIVIAL(error) << "Teardown failed: " << e.what();
+        }
+    }
+}
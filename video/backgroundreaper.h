@@ -0,0 +1,29 @@
+#pragma once
+
+#include <boost/thread/thread.hpp>
+
+#include <deque>
+#include <functional>
+#include <memory>
+
+// Runs teardown tasks one after another off the caller's thread
+class BackgroundReaper
+{
+public:
+    BackgroundReaper() = default;
+    ~BackgroundReaper(); // finishes whatever was posted
+    BackgroundReaper(const BackgroundReaper&) = delete;
+    BackgroundReaper& operator=(const BackgroundReaper&) = delete;
+
+    // The thread is started on the first task
+    void post(std::function<void()> task);
+
+private:
+    void run();
+
+    boost::mutex m_mutex;
+    boost::condition_variable m_condVar;
+    std::deque<std::function<void()>> m_tasks;
+    bool m_stopping = false;
+    std::unique_ptr<boost::thread> m_thread;
+};
@@ -0,0 +1,111 @@
+#include "controlmonitor.h"
+#include "steadytime.h"
+
+#include <boost/thread/lock_guard.hpp>
+#include <boost/log/trivial.hpp>
+
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+const char* const OPERATION_NAMES[CONTROL_OPERATIONS] = {
+    "pause",
+    "resume",
+    "next frame",
+    "seek",
+    "video reset",
+    "audio track",
+    "speed",
+    "close",
+};
+
+} // namespace
+
+void ControlMonitor::begin(ControlOperation operation)
+{
+    boost::lock_guard<boost::mutex> locker(m_mutex);
+    Stats& stats = m_stats[operation];
+    if (stats.requestTime == 0)
+    {
+        stats.requestTime = GetSteadyTime();
+    }
+    m_pending |= 1u << operation;
+}
+
+void ControlMonitor::end(ControlOperation operation)
+{
+    if ((m_pending & (1u << operation)) == 0)
+    {
+        return;
+    }
+
+    boost::lock_guard<boost::mutex> locker(m_mutex);
+    Stats& stats = m_stats[operation];
+    if (stats.requestTime == 0)
+    {
+        return;
+    }
+
+    const double latency = GetSteadyTime() - stats.requestTime;
+    stats.requestTime = 0;
+    m_pending &= ~(1u << operation);
+
+    ++stats.count;
+    stats.total += latency;
+    stats.max = std::max(stats.max, latency);
+
+    if (latency > STALL_TIMEOUT_MS / 1000.)
+    {
+        ++stats.stalls;
+        BOOST_LOG_TRIVIAL(warning) << "Stalled " << OPERATION_NAMES[operation]
+            << " took effect after " << latency * 1000. << " ms";
+    }
+}
+
+void ControlMonitor::cancel()
+{
+    boost::lock_guard<boost::mutex> locker(m_mutex);
+    for (auto& stats : m_stats)
+    {
+        stats.requestTime = 0;
+    }
+    m_pending = 0;
+}
+
+std::string ControlMonitor::describe() const
+{
+    std::string result;
+    unsigned int stalls = 0;
+    const double now = GetSteadyTime();
+
+    boost::lock_guard<boost::mutex> locker(m_mutex);
+    for (int i = 0; i < CONTROL_OPERATIONS; ++i)
+    {
+        const Stats& stats = m_stats[i];
+        stalls += stats.stalls;
+        if (stats.requestTime != 0 && now - stats.requestTime > STALL_TIMEOUT_MS / 1000.)
+        {
+            ++stalls; // and counting
+        }
+        if (stats.count == 0)
+        {
+            continue;
+        }
+
+        char buffer[100];
+        snprintf(buffer, sizeof(buffer), "%s%s %.1f/%.1f ms",
+            result.empty() ? "Control latency avg/max: " : ", ",
+            OPERATION_NAMES[i], stats.total * 1000. / stats.count, stats.max * 1000.);
+        result += buffer;
+    }
+
+    if (stalls > 0)
+    {
+        char buffer[100];
+        snprintf(buffer, sizeof(buffer), "%s%u stalled", result.empty() ? "Control: " : ", ", stalls);
+        result += buffer;
+    }
+
+    return result;
+}
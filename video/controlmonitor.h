@@ -0,0 +1,56 @@
+#pragma once
+
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <string>
+
+enum ControlOperation
+{
+    CONTROL_PAUSE,
+    CONTROL_RESUME,
+    CONTROL_NEXT_FRAME,
+    CONTROL_SEEK,
+    CONTROL_VIDEO_RESET,
+    CONTROL_AUDIO_TRACK,
+    CONTROL_SPEED,
+    CONTROL_CLOSE,
+    CONTROL_OPERATIONS
+};
+
+// Times control operations from the call to the moment their effect is seen.
+// Operations overdue by STALL_TIMEOUT_MS count as stalls, a sign of lost wakeups and deadlocks;
+// the stress mode of the harness is what hunts for them.
+class ControlMonitor
+{
+public:
+    ControlMonitor() = default;
+    ControlMonitor(const ControlMonitor&) = delete;
+    ControlMonitor& operator=(const ControlMonitor&) = delete;
+
+    // Requests repeated before the effect count from the first one
+    void begin(ControlOperation operation);
+    // Cheap when nothing is pending, fine to call on every frame
+    void end(ControlOperation operation);
+    // Nothing pending is going to happen any more, e.g. on close
+    void cancel();
+
+    // Includes operations still pending past the timeout
+    std::string describe() const;
+
+private:
+    enum { STALL_TIMEOUT_MS = 5000 };
+
+    struct Stats
+    {
+        double requestTime = 0; // 0 if nothing is pending
+        unsigned int count = 0;
+        double total = 0;
+        double max = 0;
+        unsigned int stalls = 0;
+    };
+
+    boost::atomic_uint m_pending{ 0 }; // bit per operation
+    mutable boost::mutex m_mutex;
+    Stats m_stats[CONTROL_OPERATIONS];
+};
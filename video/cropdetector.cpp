@@ -0,0 +1,220 @@
+#include "cropdetector.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include <emmintrin.h>
+
+extern "C"
+{
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+}
+
+namespace {
+
+enum
+{
+    BLACK_THRESHOLD = 32,   // luma above this counts as picture
+    MIN_MARGIN = 8,         // smaller bars are left alone
+    NUM_SAMPLED_ROWS = 16,
+};
+
+const __m128i* AsM128(const uint8_t* p) { return reinterpret_cast<const __m128i*>(p); }
+
+bool IsRowBlack(const uint8_t* row, int width)
+{
+    const __m128i threshold = _mm_set1_epi8(static_cast<char>(BLACK_THRESHOLD));
+    __m128i acc = _mm_setzero_si128();
+
+    int i = 0;
+    for (; i + 16 <= width; i += 16)
+    {
+        acc = _mm_or_si128(acc, _mm_subs_epu8(_mm_loadu_si128(AsM128(row + i)), threshold));
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xFFFF)
+    {
+        return false;
+    }
+    for (; i < width; ++i)
+    {
+        if (row[i] > BLACK_THRESHOLD)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Mask of bytes brighter than the threshold
+inline int BrightMask(const uint8_t* p)
+{
+    const __m128i threshold = _mm_set1_epi8(static_cast<char>(BLACK_THRESHOLD));
+    const __m128i excess = _mm_subs_epu8(_mm_loadu_si128(AsM128(p)), threshold);
+    return ~_mm_movemask_epi8(_mm_cmpeq_epi8(excess, _mm_setzero_si128())) & 0xFFFF;
+}
+
+int FirstBright(const uint8_t* row, int width)
+{
+    int i = 0;
+    for (; i + 16 <= width; i += 16)
+    {
+        if (BrightMask(row + i) != 0)
+        {
+            break;
+        }
+    }
+    for (; i < width; ++i)
+    {
+        if (row[i] > BLACK_THRESHOLD)
+        {
+            return i;
+        }
+    }
+    return width;
+}
+
+int LastBright(const uint8_t* row, int width)
+{
+    int i = width;
+    for (; i >= 16; i -= 16)
+    {
+        if (BrightMask(row + i - 16) != 0)
+        {
+            break;
+        }
+    }
+    while (i-- > 0)
+    {
+        if (row[i] > BLACK_THRESHOLD)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int AlignMargin(int margin, int alignment, int limit)
+{
+    margin = std::min(margin, limit);
+    margin -= margin % alignment;
+    return (margin < MIN_MARGIN) ? 0 : margin;
+}
+
+} // namespace
+
+void CropDetector::reset()
+{
+    m_window.clear();
+    m_stable = {};
+    m_hasStable = false;
+    m_width = 0;
+    m_height = 0;
+    m_format = -1;
+    m_frameCounter = 0;
+}
+
+bool CropDetector::apply(AVFrame* frame)
+{
+    if (frame->width != m_width || frame->height != m_height || frame->format != m_format)
+    {
+        reset();
+        m_width = frame->width;
+        m_height = frame->height;
+        m_format = frame->format;
+    }
+
+    if (m_frameCounter++ % SAMPLE_INTERVAL == 0)
+    {
+        Margins margins;
+        if (detect(frame, margins))
+        {
+            m_window.push_back(margins);
+            if (m_window.size() > WINDOW_SIZE)
+            {
+                m_window.pop_front();
+            }
+
+            if (m_window.size() == WINDOW_SIZE)
+            {
+                // The least crop any recent frame needs, so no picture is ever lost
+                m_stable = m_window.front();
+                for (const auto& m : m_window)
+                {
+                    m_stable.top = std::min(m_stable.top, m.top);
+                    m_stable.bottom = std::min(m_stable.bottom, m.bottom);
+                    m_stable.left = std::min(m_stable.left, m.left);
+                    m_stable.right = std::min(m_stable.right, m.right);
+                }
+                m_hasStable = true;
+            }
+        }
+    }
+
+    if (!m_hasStable
+        || m_stable.top == 0 && m_stable.bottom == 0 && m_stable.left == 0 && m_stable.right == 0)
+    {
+        return false;
+    }
+
+    frame->crop_top = m_stable.top;
+    frame->crop_bottom = m_stable.bottom;
+    frame->crop_left = m_stable.left;
+    frame->crop_right = m_stable.right;
+
+    // Keeps plane pointers aligned, so SIMD copies downstream stay on their fast path
+    return av_frame_apply_cropping(frame, 0) >= 0;
+}
+
+bool CropDetector::detect(const AVFrame* frame, Margins& margins) const
+{
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+    if (desc == nullptr
+        || (desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL)) != 0
+        || desc->comp[0].plane != 0 || desc->comp[0].step != 1 || desc->comp[0].depth != 8)
+    {
+        return false;
+    }
+
+    const int width = frame->width;
+    const int height = frame->height;
+    const uint8_t* luma = frame->data[0];
+    const int pitch = frame->linesize[0];
+
+    int top = 0;
+    while (top < height && IsRowBlack(luma + top * pitch, width))
+    {
+        ++top;
+    }
+    if (top == height)
+    {
+        return false; // fade to black tells nothing
+    }
+
+    int bottom = 0;
+    while (IsRowBlack(luma + (height - 1 - bottom) * pitch, width))
+    {
+        ++bottom;
+    }
+
+    int left = width;
+    int right = width;
+    const int rows = height - top - bottom;
+    for (int i = 0; i < NUM_SAMPLED_ROWS; ++i)
+    {
+        const uint8_t* row = luma + (top + rows * i / NUM_SAMPLED_ROWS) * pitch;
+        left = std::min(left, FirstBright(row, width));
+        right = std::min(right, width - 1 - LastBright(row, width));
+    }
+
+    // Line pairs and chroma samples must stay intact
+    const int alignW = std::max(2, 1 << desc->log2_chroma_w);
+    const int alignH = std::max(2, 1 << desc->log2_chroma_h);
+
+    margins.top = AlignMargin(top, alignH, height / 4);
+    margins.bottom = AlignMargin(bottom, alignH, height / 4);
+    margins.left = AlignMargin(left, alignW, width / 4);
+    margins.right = AlignMargin(right, alignW, width / 4);
+
+    return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <deque>
+
+struct AVFrame;
+
+// Finds black bars around the picture and crops them away by moving plane pointers
+class CropDetector
+{
+public:
+    CropDetector() = default;
+    CropDetector(const CropDetector&) = delete;
+    CropDetector& operator=(const CropDetector&) = delete;
+
+    void reset();
+
+    // Returns true if the frame has been cropped
+    bool apply(AVFrame* frame);
+
+private:
+    struct Margins
+    {
+        int top;
+        int bottom;
+        int left;
+        int right;
+    };
+
+    bool detect(const AVFrame* frame, Margins& margins) const;
+
+    enum
+    {
+        SAMPLE_INTERVAL = 4,    // frames between two detections
+        WINDOW_SIZE = 8,        // detections that must agree before cropping
+    };
+
+    std::deque<Margins> m_window;
+    Margins m_stable{};
+    bool m_hasStable = false;
+
+    int m_width = 0;
+    int m_height = 0;
+    int m_format = -1;
+    unsigned int m_frameCounter = 0;
+};
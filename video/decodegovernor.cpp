@@ -0,0 +1,371 @@
+#include "decodegovernor.h"
+#include "steadytime.h"
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/interprocess/sync/interprocess_mutex.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <boost/log/trivial.hpp>
+
+#ifdef _WIN32
+#include <boost/interprocess/managed_windows_shared_memory.hpp>
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <boost/interprocess/managed_shared_memory.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+
+namespace {
+
+// Seconds between quality changes, one decoder moves one step at a time
+const double ADJUST_INTERVAL = 1.;
+// Everyone has to be calm that long before quality is given back
+const double RESTORE_DELAY = 5.;
+// Paused or stalled decoders stop reporting, their last figures are not trusted after that
+const double STALE_INTERVAL = 3.;
+
+const double HIGH_LOAD = 0.9;
+const double LOW_LOAD = 0.6;
+const double LAG_THRESHOLD = 0.05;
+
+// A process that died holding the lock leaves it locked, the others carry on without the table
+const int LOCK_TIMEOUT_MS = 100;
+
+const size_t SEGMENT_SIZE = 64 * 1024;
+
+#ifdef _WIN32
+typedef boost::interprocess::managed_windows_shared_memory Segment;
+#else
+typedef boost::interprocess::managed_shared_memory Segment;
+#endif
+
+uint32_t GetProcessId()
+{
+#ifdef _WIN32
+    return ::GetCurrentProcessId();
+#else
+    return static_cast<uint32_t>(getpid());
+#endif
+}
+
+bool IsProcessAlive(uint32_t processId)
+{
+#ifdef _WIN32
+    const HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, processId);
+    if (process == nullptr)
+    {
+        return GetLastError() == ERROR_ACCESS_DENIED;
+    }
+    const bool alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+    CloseHandle(process);
+    return alive;
+#else
+    return kill(static_cast<pid_t>(processId), 0) == 0 || errno == EPERM;
+#endif
+}
+
+} // namespace
+
+// Plain data only, it is mapped into every player process
+struct DecodeGovernor::Table
+{
+    enum { MAX_CLIENTS = 64 };
+
+    struct Client
+    {
+        uint32_t processId; // 0 for a free slot
+        int32_t priority;
+        double load;
+        double lag;
+        double reportTime;
+        int32_t quality;
+    };
+
+    boost::interprocess::interprocess_mutex mutex;
+    double lastChange = 0;
+    double calmSince = 0; // 0 while somebody is struggling
+    Client clients[MAX_CLIENTS] = {};
+};
+
+struct DecodeGovernor::Shared
+{
+    explicit Shared(const char* sharedName)
+        : segment(boost::interprocess::open_or_create, sharedName, SEGMENT_SIZE)
+        , table(segment.find_or_construct<Table>("DecodeGovernor")())
+    {
+    }
+
+    Segment segment;
+    Table* table;
+};
+
+namespace {
+
+class TableLock
+{
+public:
+    explicit TableLock(boost::interprocess::interprocess_mutex& mutex)
+        : m_lock(mutex, boost::posix_time::microsec_clock::universal_time()
+            + boost::posix_time::milliseconds(LOCK_TIMEOUT_MS))
+    {
+    }
+
+    explicit operator bool() const { return m_lock.owns(); }
+
+private:
+    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> m_lock;
+};
+
+} // namespace
+
+const char* DecodeQualityName(int quality)
+{
+    switch (quality)
+    {
+    case DECODE_QUALITY_FULL: return "full";
+    case DECODE_QUALITY_NO_LOOP_FILTER: return "no loop filter";
+    case DECODE_QUALITY_NO_NONREF: return "reference frames only";
+    case DECODE_QUALITY_KEYFRAMES_ONLY: return "keyframes only";
+    default: return "unknown";
+    }
+}
+
+DecodeGovernor& DecodeGovernor::Instance()
+{
+    static DecodeGovernor instance("FFPlayerDecodeGovernor");
+    return instance;
+}
+
+DecodeGovernor::DecodeGovernor(const char* sharedName)
+{
+    try
+    {
+        m_shared = std::make_unique<Shared>(sharedName);
+        m_table = m_shared->table;
+    }
+    catch (const std::exception& e)
+    {
+        BOOST_LOG_TRIVIAL(error) << "Decode governor is on its own, no shared memory: " << e.what();
+        m_shared.reset();
+    }
+    if (!m_shared)
+    {
+        m_ownTable = std::make_unique<Table>();
+        m_table = m_ownTable.get();
+    }
+}
+
+DecodeGovernor::~DecodeGovernor() = default;
+
+// static
+void DecodeGovernor::Remove(const char* sharedName)
+{
+#ifndef _WIN32
+    boost::interprocess::shared_memory_object::remove(sharedName);
+#else
+    (void)sharedName;
+#endif
+}
+
+int DecodeGovernor::registerDecoder()
+{
+    TableLock lock(m_table->mutex);
+    if (!lock)
+    {
+        return -1;
+    }
+
+    const uint32_t processId = GetProcessId();
+    for (int id = 0; id < Table::MAX_CLIENTS; ++id)
+    {
+        Table::Client& client = m_table->clients[id];
+        // Slots of players that crashed are taken over
+        if (client.processId == 0 || client.processId != processId && !IsProcessAlive(client.processId))
+        {
+            client = Table::Client{};
+            client.processId = processId;
+            client.quality = DECODE_QUALITY_FULL;
+            return id; // stale until it reports
+        }
+    }
+    return -1;
+}
+
+void DecodeGovernor::unregisterDecoder(int id)
+{
+    TableLock lock(m_table->mutex);
+    if (lock && id >= 0 && id < Table::MAX_CLIENTS)
+    {
+        m_table->clients[id].processId = 0;
+    }
+}
+
+void DecodeGovernor::setPriority(int id, int priority)
+{
+    TableLock lock(m_table->mutex);
+    if (lock && id >= 0 && id < Table::MAX_CLIENTS)
+    {
+        m_table->clients[id].priority = priority;
+    }
+}
+
+int DecodeGovernor::priority(int id) const
+{
+    TableLock lock(m_table->mutex);
+    return (lock && id >= 0 && id < Table::MAX_CLIENTS) ? m_table->clients[id].priority : 0;
+}
+
+DecodeQuality DecodeGovernor::report(int id, double load, double lag)
+{
+    return report(id, load, lag, GetSteadyTime());
+}
+
+DecodeQuality DecodeGovernor::report(int id, double load, double lag, double now)
+{
+    if (id < 0 || id >= Table::MAX_CLIENTS)
+    {
+        return DECODE_QUALITY_FULL;
+    }
+
+    TableLock lock(m_table->mutex);
+    if (!lock)
+    {
+        return DECODE_QUALITY_FULL;
+    }
+
+    Table::Client& client = m_table->clients[id];
+    client.load = load;
+    client.lag = lag;
+    client.reportTime = now;
+
+    rebalance(now);
+
+    return static_cast<DecodeQuality>(client.quality);
+}
+
+void DecodeGovernor::rebalance(double now)
+{
+    Table& table = *m_table;
+    if (now - table.lastChange < ADJUST_INTERVAL)
+    {
+        return;
+    }
+
+    const auto isStale = [now](const Table::Client& client)
+    {
+        return now - client.reportTime > STALE_INTERVAL;
+    };
+    const auto isStruggling = [&isStale](const Table::Client& client)
+    {
+        return !isStale(client) && (client.lag > LAG_THRESHOLD || client.load > HIGH_LOAD);
+    };
+    const auto isLagging = [&isStale](const Table::Client& client)
+    {
+        return !isStale(client) && client.lag > LAG_THRESHOLD;
+    };
+
+    const uint32_t processId = GetProcessId();
+    int topPriority = INT_MIN;
+    bool struggling = false;
+    bool calm = true;
+    for (Table::Client& client : table.clients)
+    {
+        if (client.processId == 0)
+        {
+            continue;
+        }
+        if (isStale(client))
+        {
+            // Players that crashed never unregister
+            if (client.processId != processId && !IsProcessAlive(client.processId))
+            {
+                client.processId = 0;
+            }
+            continue;
+        }
+        topPriority = std::max(topPriority, static_cast<int>(client.priority));
+        struggling = struggling || isStruggling(client);
+        calm = calm && client.lag == 0 && client.load < LOW_LOAD;
+    }
+
+    if (struggling)
+    {
+        table.calmSince = 0;
+
+        // The least important decoder that has something left to give. A top priority one that keeps up
+        // is left alone however busy it is, and it is never reduced to a slide show of keyframes.
+        int victim = -1;
+        for (int id = 0; id < Table::MAX_CLIENTS; ++id)
+        {
+            const Table::Client& client = table.clients[id];
+            const bool top = client.priority == topPriority;
+            if (client.processId == 0 || isStale(client)
+                || client.quality + 1 >= (top ? DECODE_QUALITY_KEYFRAMES_ONLY : DECODE_QUALITY_LEVELS)
+                || top && !isLagging(client))
+            {
+                continue;
+            }
+            if (victim < 0
+                || client.priority < table.clients[victim].priority
+                || client.priority == table.clients[victim].priority
+                    && client.quality < table.clients[victim].quality)
+            {
+                victim = id;
+            }
+        }
+
+        if (victim >= 0)
+        {
+            Table::Client& client = table.clients[victim];
+            ++client.quality;
+            table.lastChange = now;
+            BOOST_LOG_TRIVIAL(info) << "Decoder " << victim << " of process " << client.processId
+                << " (priority " << client.priority << ") lowered to " << DecodeQualityName(client.quality);
+        }
+    }
+    else if (!calm)
+    {
+        table.calmSince = 0;
+    }
+    else if (table.calmSince == 0)
+    {
+        table.calmSince = now;
+    }
+    else if (now - table.calmSince >= RESTORE_DELAY)
+    {
+        // Quality goes back to the most important decoder first
+        int favorite = -1;
+        for (int id = 0; id < Table::MAX_CLIENTS; ++id)
+        {
+            const Table::Client& client = table.clients[id];
+            if (client.processId == 0 || client.quality == DECODE_QUALITY_FULL)
+            {
+                continue;
+            }
+            if (favorite < 0
+                || client.priority > table.clients[favorite].priority
+                || client.priority == table.clients[favorite].priority
+                    && client.quality > table.clients[favorite].quality)
+            {
+                favorite = id;
+            }
+        }
+
+        if (favorite >= 0)
+        {
+            Table::Client& client = table.clients[favorite];
+            --client.quality;
+            table.lastChange = now;
+            table.calmSince = now;
+            BOOST_LOG_TRIVIAL(info) << "Decoder " << favorite << " of process " << client.processId
+                << " (priority " << client.priority << ") raised to " << DecodeQualityName(client.quality);
+        }
+    }
+}
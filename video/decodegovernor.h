@@ -0,0 +1,61 @@
+#pragma once
+
+#include <memory>
+
+// Steps a decoder takes to save CPU, each one includes the ones before it
+enum DecodeQuality
+{
+    DECODE_QUALITY_FULL,
+    DECODE_QUALITY_NO_LOOP_FILTER,  // deblocking skipped
+    DECODE_QUALITY_NO_NONREF,       // frames nothing refers to are not decoded
+    DECODE_QUALITY_KEYFRAMES_ONLY,
+    DECODE_QUALITY_LEVELS
+};
+
+const char* DecodeQualityName(int quality);
+
+// Arbiter of decoding quality between simultaneous players. Each player window is a process of its own,
+// so the decoders are listed in a table in named shared memory all of them attach to.
+// Under load the least important decoder is degraded first, a decoder with the top priority
+// only gives in when it drops frames itself and nobody else has anything left to give,
+// and then not as far as keyframes only.
+class DecodeGovernor
+{
+public:
+    static DecodeGovernor& Instance();
+
+    // Attaches to the table of that name, creating it if need be. Without shared memory the table is
+    // the process' own.
+    explicit DecodeGovernor(const char* sharedName);
+    ~DecodeGovernor();
+
+    DecodeGovernor(const DecodeGovernor&) = delete;
+    DecodeGovernor& operator=(const DecodeGovernor&) = delete;
+
+    // Gone once no process has it attached, on systems that keep it beyond that too
+    static void Remove(const char* sharedName);
+
+    // -1 if the table is full, the other calls ignore that id
+    int registerDecoder();
+    void unregisterDecoder(int id);
+
+    // Higher is more important, e.g. the player that has the focus
+    void setPriority(int id, int priority);
+    int priority(int id) const;
+
+    // load: share of the interval spent inside the codec, lag: share of frames dropped for being late.
+    // Returns the quality the decoder is to use from now on.
+    DecodeQuality report(int id, double load, double lag);
+    // As of the time given, in seconds of the steady clock, for simulations
+    DecodeQuality report(int id, double load, double lag, double now);
+
+private:
+    struct Table;
+    struct Shared;
+
+    void rebalance(double now);
+
+    std::unique_ptr<Shared> m_shared;
+    std::unique_ptr<Table> m_ownTable; // without shared memory
+    Table* m_table;
+};
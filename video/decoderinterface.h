@@ -42,6 +42,7 @@ struct FrameDecoderListener
 {
     virtual ~FrameDecoderListener() = default;
 
+    // On load and seek only, IFrameDecoder::getPlaybackPosition() tells the position in between
     virtual void changedFramePosition(
         long long /*start*/, long long /*frame*/, long long /*total*/) {}
     virtual void decoderClosed(bool /*fileReleased*/) {}
@@ -51,6 +52,17 @@ struct FrameDecoderListener
     virtual void onEndOfStream() {}
 
     virtual void playingFinished() {}
+
+    // IFrameDecoder::getProperties() lists the findings from now on
+    virtual void streamAnalyzed() {}
+};
+
+struct PlaybackPosition
+{
+    long long start;
+    long long frame;
+    long long total;
+    double timeBase; // seconds per unit, 0 while nothing is open
 };
 
 struct RationalNumber
@@ -78,12 +90,17 @@ struct IFrameDecoder
 
     virtual bool openFile(const PathType& file) = 0;
     virtual bool openUrl(const std::string& url) = 0;
+    virtual bool openFileSequence(const std::vector<PathType>& files) = 0;
+    // printf style UTF-8 pattern of numbered image files, e.g. "shot_%04d.png"
+    virtual bool openImageSequence(const std::string& pattern, int startNumber, double frameRate) = 0;
 
     virtual void play(bool isPaused = false) = 0;
     virtual bool pauseResume() = 0;
     virtual bool nextFrame() = 0;
     virtual void setVolume(double volume) = 0;
 
+    // In the units of getPlaybackPosition()
+    virtual bool seekDuration(int64_t duration) = 0;
     virtual bool seekByPercent(double percent) = 0;
 
     virtual void videoReset() = 0;
@@ -100,6 +117,9 @@ struct IFrameDecoder
     virtual double volume() const = 0;
     virtual double getDurationSecs(int64_t duration) const = 0;
 
+    // Consistent snapshot without locking for UI components to poll at their own refresh rate
+    virtual PlaybackPosition getPlaybackPosition() const = 0;
+
     virtual int getNumAudioTracks() const = 0;
     virtual int getAudioTrack() const = 0;
     virtual void setAudioTrack(int idx) = 0;
@@ -108,8 +128,33 @@ struct IFrameDecoder
     virtual void setSpeedRational(const RationalNumber& speed) = 0;
 
     virtual std::vector<std::string> getProperties() = 0;
+
+    // Packet scan of the open file or URL for keyframe intervals, bitrate, B-frames and timestamp jumps,
+    // on a worker thread of its own. Not available for file and image sequences.
+    virtual void analyzeStream() = 0;
+
+    // libavfilter graph description (e.g. "hqdn3d,crop=iw:ih-140"), takes effect on next open
+    virtual void setVideoFilter(const std::string& description) = 0;
+
+    // Letterbox and pillarbox bars are cut off before conversion
+    virtual void setAutoCrop(bool enable) = 0;
+
+    // Gapless playback of the range over and over, an empty range turns it off
+    virtual void setLoopRange(double startSecs, double endSecs) = 0;
+
+    // Higher keeps its picture quality longer when several players share the CPU
+    virtual void setDecodePriority(int priority) = 0;
+
+    // A second file or URL shown right of a split wipe in the frames getFrameRenderingData() hands out,
+    // in step with them by presentation time. An empty name turns the wipe off.
+    virtual bool setSplitWipeSource(const PathType& source) = 0;
+    // 0 to 1 of the frame width, where the second source starts
+    virtual void setSplitWipePosition(double position) = 0;
 };
 
 struct IAudioPlayer;
+struct ITimeSource;
 
-std::unique_ptr<IFrameDecoder> GetFrameDecoder(std::unique_ptr<IAudioPlayer> audioPlayer);
+// Playback is paced by the system clock unless another time source is given
+std::unique_ptr<IFrameDecoder> GetFrameDecoder(std::unique_ptr<IAudioPlayer> audioPlayer,
+    std::shared_ptr<ITimeSource> timeSource = nullptr);
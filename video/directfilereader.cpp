@@ -0,0 +1,312 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // O_DIRECT
+#endif
+
+#include "directfilereader.h"
+
+#include "threadpolicy.h"
+
+#include <boost/chrono.hpp>
+#include <boost/log/trivial.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Below that the page cache does more good than harm
+const int64_t DIRECT_IO_MIN_FILE_SIZE = 4LL * 1024 * 1024 * 1024;
+
+uint8_t* AllocateAligned(size_t size)
+{
+#ifdef _WIN32
+    return static_cast<uint8_t*>(_aligned_malloc(size, DirectFileReader::ALIGNMENT));
+#else
+    void* result = nullptr;
+    return (posix_memalign(&result, DirectFileReader::ALIGNMENT, size) == 0)
+        ? static_cast<uint8_t*>(result) : nullptr;
+#endif
+}
+
+void FreeAligned(uint8_t* data)
+{
+#ifdef _WIN32
+    _aligned_free(data);
+#else
+    free(data);
+#endif
+}
+
+} // namespace
+
+// static
+std::unique_ptr<DirectFileReader> DirectFileReader::Open(const PathType& path)
+{
+    std::unique_ptr<DirectFileReader> result(new DirectFileReader());
+
+#ifdef _WIN32
+    HANDLE handle = CreateFileW(path.c_str(), GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+        FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        return nullptr;
+    }
+    result->m_handle = handle;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size))
+    {
+        return nullptr;
+    }
+    result->m_size = size.QuadPart;
+#elif defined(__linux__)
+    result->m_fd = open(path.c_str(), O_RDONLY | O_DIRECT);
+    if (result->m_fd < 0)
+    {
+        return nullptr; // e.g. tmpfs refuses O_DIRECT
+    }
+
+    struct stat status;
+    if (fstat(result->m_fd, &status) != 0)
+    {
+        return nullptr;
+    }
+    result->m_size = status.st_size;
+#elif defined(__APPLE__)
+    result->m_fd = open(path.c_str(), O_RDONLY);
+    if (result->m_fd < 0 || fcntl(result->m_fd, F_NOCACHE, 1) != 0)
+    {
+        return nullptr;
+    }
+
+    struct stat status;
+    if (fstat(result->m_fd, &status) != 0)
+    {
+        return nullptr;
+    }
+    result->m_size = status.st_size;
+#else
+    return nullptr;
+#endif
+
+    if (result->m_size < DIRECT_IO_MIN_FILE_SIZE)
+    {
+        return nullptr;
+    }
+
+    result->m_current.data = AllocateAligned(BLOCK_SIZE);
+    result->m_spare.data = AllocateAligned(BLOCK_SIZE);
+    if (result->m_current.data == nullptr || result->m_spare.data == nullptr)
+    {
+        return nullptr;
+    }
+
+    result->m_prefetchThread = std::make_unique<boost::thread>(&DirectFileReader::prefetchRunnable, result.get());
+
+    BOOST_LOG_TRIVIAL(info) << "Reading " << result->m_size << " bytes bypassing the page cache";
+    return result;
+}
+
+DirectFileReader::~DirectFileReader()
+{
+    if (m_prefetchThread)
+    {
+        {
+            boost::lock_guard<boost::mutex> locker(m_mutex);
+            m_stopping = true;
+        }
+        m_condVar.notify_all();
+        m_prefetchThread->join();
+    }
+
+    FreeAligned(m_current.data);
+    FreeAligned(m_spare.data);
+
+#ifdef _WIN32
+    if (m_handle != nullptr)
+    {
+        CloseHandle(m_handle);
+    }
+#else
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+    }
+#endif
+}
+
+int DirectFileReader::read(uint8_t* buf, int size)
+{
+    if (m_position >= m_size)
+    {
+        return 0;
+    }
+
+    if (m_position < m_current.offset || m_position >= m_current.offset + m_current.length)
+    {
+        if (!load(m_position))
+        {
+            return -1;
+        }
+    }
+
+    const int64_t offsetInBlock = m_position - m_current.offset;
+    const int length = static_cast<int>(std::min<int64_t>(size, m_current.length - offsetInBlock));
+    if (length <= 0)
+    {
+        return 0;
+    }
+
+    memcpy(buf, m_current.data + offsetInBlock, length);
+    m_position += length;
+    return length;
+}
+
+int64_t DirectFileReader::seek(int64_t position)
+{
+    if (position < 0 || position > m_size)
+    {
+        return -1;
+    }
+    m_position = position;
+    return position;
+}
+
+double DirectFileReader::throughput() const
+{
+    const double readTime = m_readTime;
+    return (readTime > 0) ? m_bytesRead / readTime : 0;
+}
+
+std::string DirectFileReader::describe() const
+{
+    char buffer[100];
+    snprintf(buffer, sizeof(buffer), "Direct I/O: %.0f MB/s from disk", throughput() / (1024. * 1024.));
+    return buffer;
+}
+
+bool DirectFileReader::load(int64_t position)
+{
+    const int64_t offset = position / BLOCK_SIZE * BLOCK_SIZE;
+
+    // The spare buffer is off limits until the prefetch is done with it
+    waitForPrefetch();
+
+    if (m_spare.offset == offset && m_spare.length > 0)
+    {
+        std::swap(m_current, m_spare);
+    }
+    else
+    {
+        readBlock(m_current, offset); // seek
+    }
+
+    if (m_current.length <= 0)
+    {
+        return false;
+    }
+
+    const int64_t next = m_current.offset + m_current.length;
+    if (next < m_size)
+    {
+        {
+            boost::lock_guard<boost::mutex> locker(m_mutex);
+            m_requested = next;
+        }
+        m_condVar.notify_all();
+    }
+
+    return true;
+}
+
+void DirectFileReader::readBlock(Block& block, int64_t offset)
+{
+    const auto startTime = boost::chrono::steady_clock::now();
+
+    // The tail of the file comes short, the request itself stays aligned
+    const int length = readAt(block.data, offset, BLOCK_SIZE);
+
+    m_readTime = m_readTime + boost::chrono::duration<double>(
+        boost::chrono::steady_clock::now() - startTime).count();
+
+    block.offset = offset;
+    block.length = std::max(length, 0);
+    if (length > 0)
+    {
+        m_bytesRead += length;
+    }
+    else if (length < 0)
+    {
+        BOOST_LOG_TRIVIAL(error) << "Direct read failed at " << offset;
+    }
+}
+
+int DirectFileReader::readAt(uint8_t* data, int64_t offset, int size)
+{
+#ifdef _WIN32
+    OVERLAPPED overlapped{};
+    overlapped.Offset = static_cast<DWORD>(offset);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD read = 0;
+    if (!ReadFile(m_handle, data, size, &read, &overlapped))
+    {
+        return (GetLastError() == ERROR_HANDLE_EOF) ? 0 : -1;
+    }
+    return static_cast<int>(read);
+#else
+    return static_cast<int>(pread(m_fd, data, size, offset));
+#endif
+}
+
+void DirectFileReader::prefetchRunnable()
+{
+    ApplyThreadPolicy(THREAD_ROLE_DEMUX);
+
+    for (;;)
+    {
+        int64_t offset;
+        {
+            boost::unique_lock<boost::mutex> locker(m_mutex);
+            while (m_requested < 0 && !m_stopping)
+            {
+                m_condVar.wait(locker);
+            }
+            if (m_stopping)
+            {
+                return;
+            }
+            offset = m_requested;
+        }
+
+        readBlock(m_spare, offset);
+
+        {
+            boost::lock_guard<boost::mutex> locker(m_mutex);
+            m_requested = -1;
+        }
+        m_condVar.notify_all();
+    }
+}
+
+void DirectFileReader::waitForPrefetch()
+{
+    boost::unique_lock<boost::mutex> locker(m_mutex);
+    while (m_requested >= 0)
+    {
+        m_condVar.wait(locker);
+    }
+}
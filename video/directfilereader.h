@@ -0,0 +1,73 @@
+#pragma once
+
+#include "filereader.h"
+
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <cstdint>
+#include <memory>
+
+// Reads a large file past the page cache: aligned direct reads into two buffers,
+// the block after the one being consumed is read in the background
+class DirectFileReader : public FileReader
+{
+public:
+    enum { ALIGNMENT = 4096 };
+    enum { BLOCK_SIZE = 4 * 1024 * 1024 }; // a multiple of ALIGNMENT
+
+    // Null for files below the size threshold and where direct I/O is not available
+    static std::unique_ptr<DirectFileReader> Open(const PathType& path);
+
+    ~DirectFileReader() override;
+    DirectFileReader(const DirectFileReader&) = delete;
+    DirectFileReader& operator=(const DirectFileReader&) = delete;
+
+    int read(uint8_t* buf, int size) override;
+    int64_t seek(int64_t position) override;
+
+    int64_t tell() const override { return m_position; }
+    int64_t size() const override { return m_size; }
+
+    std::string describe() const override;
+
+    // Disk throughput of the direct reads so far, bytes per second
+    double throughput() const;
+
+private:
+    struct Block
+    {
+        uint8_t* data = nullptr;
+        int64_t offset = -1;
+        int length = 0;
+    };
+
+    DirectFileReader() = default;
+
+    bool load(int64_t position);
+    void readBlock(Block& block, int64_t offset);
+    int readAt(uint8_t* data, int64_t offset, int size);
+
+    void prefetchRunnable();
+    void waitForPrefetch();
+
+#ifdef _WIN32
+    void* m_handle = nullptr;
+#else
+    int m_fd = -1;
+#endif
+    int64_t m_size = 0;
+    int64_t m_position = 0;
+
+    Block m_current;
+    Block m_spare; // written by the prefetch thread while a request is pending
+
+    boost::mutex m_mutex;
+    boost::condition_variable m_condVar;
+    int64_t m_requested = -1; // offset being prefetched
+    bool m_stopping = false;
+    std::unique_ptr<boost::thread> m_prefetchThread;
+
+    boost::atomic_int64_t m_bytesRead{ 0 };
+    boost::atomic<double> m_readTime{ 0 }; // seconds
+};
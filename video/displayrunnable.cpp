@@ -5,16 +5,28 @@
 void FFmpegDecoder::displayRunnable()
 {
     CHANNEL_LOG(ffmpeg_threads) << "Displaying thread started";
+    ApplyThreadPolicy(THREAD_ROLE_DISPLAY);
+
+    const double LATE_FRAME_THRESHOLD = 0.02;
 
     for (;;)
     {
         {
             boost::unique_lock<boost::mutex> locker(m_videoFramesMutex);
+#ifdef PRIMITIVE_TIMING
+            const bool starving = !m_frameDisplayingRequested && !m_videoFramesQueue.canPop();
+#endif
             m_videoFramesCV.wait(locker, [this]()
             {
                 return !m_frameDisplayingRequested &&
                     m_videoFramesQueue.canPop();
             });
+#ifdef PRIMITIVE_TIMING
+            if (starving)
+            {
+                RecordPrimitive(PRIMITIVE_FRAME_HANDOFF, PrimitiveClock::now() - m_frameHandoffTime);
+            }
+#endif
         }
 
         const VideoFrame& current_frame = m_videoFramesQueue.front();
@@ -24,6 +36,7 @@ void FFmpegDecoder::displayRunnable()
             && m_videoStartClock + current_frame.m_pts < GetHiResTime())
         {
             CHANNEL_LOG(ffmpeg_threads) << __FUNCTION__ << " Framedrop";
+            ++m_lateFrames;
             finishedDisplayingFrame(m_generation);
             continue;
         }
@@ -37,21 +50,25 @@ void FFmpegDecoder::displayRunnable()
         }
 
         const auto speed = getSpeedRational();
+        m_controlMonitor.end(CONTROL_SPEED);
 
-        for (;;)
+        for (bool waited = false;; waited = true)
         {
             const double delay = m_videoStartClock + current_frame.m_pts - GetHiResTime();
             if (delay < 0.005) {
+                if (!waited && delay < -LATE_FRAME_THRESHOLD) {
+                    ++m_lateFrames;
+                }
                 break;
             }
             if (delay > 0.1)
             {
-                boost::this_thread::sleep_for(
+                m_timeSource->sleepFor(
                     boost::chrono::milliseconds(100 * speed.denominator / speed.numerator));
                 continue;
             }
 
-            boost::this_thread::sleep_for(
+            m_timeSource->sleepFor(
                 boost::chrono::milliseconds(int(delay * 1000. * speed.denominator / speed.numerator)));
             break;
         }
@@ -60,12 +77,10 @@ void FFmpegDecoder::displayRunnable()
         if (current_frame.m_duration != AV_NOPTS_VALUE)
         {
             m_currentTime = current_frame.m_duration;
-            if ((m_decoderListener != nullptr) && m_seekDuration == AV_NOPTS_VALUE)
+            if (m_seekDuration == AV_NOPTS_VALUE)
             {
-                m_decoderListener->changedFramePosition(
-                    m_startTime,
-                    current_frame.m_duration,
-                    m_duration + m_startTime);
+                const int64_t frame = current_frame.m_duration;
+                m_position.update([frame](PlaybackPosition& position) { position.frame = frame; });
             }
         }
         if (m_frameListener != nullptr)
@@ -473,7 +473,7 @@ static int dxva2_retrieve_data(AVCodecContext *s, AVFrame *frame)
         ctx->tmp_frame->height = frame->height;
         ctx->tmp_frame->format = AV_PIX_FMT_NV12;
 
-        ret = av_frame_get_buffer(ctx->tmp_frame, 32);
+        ret = av_frame_get_buffer(ctx->tmp_frame, 64);
         if (ret < 0)
             return ret;
 
@@ -491,7 +491,7 @@ static int dxva2_retrieve_data(AVCodecContext *s, AVFrame *frame)
         ctx->tmp_frame->height = frame->height;
         ctx->tmp_frame->format = AV_PIX_FMT_P010;
 
-        ret = av_frame_get_buffer(ctx->tmp_frame, 32);
+        ret = av_frame_get_buffer(ctx->tmp_frame, 64);
         if (ret < 0)
             return ret;
 
@@ -509,7 +509,7 @@ static int dxva2_retrieve_data(AVCodecContext *s, AVFrame *frame)
         ctx->tmp_frame->height = frame->height;
         ctx->tmp_frame->format = AV_PIX_FMT_YUV420P;
 
-        ret = av_frame_get_buffer(ctx->tmp_frame, 32);
+        ret = av_frame_get_buffer(ctx->tmp_frame, 64);
         if (ret < 0)
             return ret;
 
@@ -1,10 +1,16 @@
 ﻿#include "ffmpegdecoder.h"
 
 #include <climits>
+#include <cmath>
 #include <cstdint>
 
 #include "makeguard.h"
+#include "securecrt.h"
 #include "interlockedadd.h"
+#include "framebufferpool.h"
+#include "filereader.h"
+#include "utf8.h"
+#include "steadytime.h"
 
 #include <boost/chrono.hpp>
 #include <memory>
@@ -18,9 +24,13 @@
 extern "C"
 {
 #include "libavutil/pixdesc.h"
+#include "libavutil/display.h"
 }
 
+// DXVA2 is Direct3D 9, elsewhere decoding is in software
+#ifdef _WIN32
 #define USE_HWACCEL
+#endif
 
 // http://stackoverflow.com/questions/34602561
 #ifdef USE_HWACCEL
@@ -32,6 +42,11 @@ namespace
 
 void FreeVideoCodecContext(AVCodecContext*& videoCodecContext)
 {
+    if (videoCodecContext != nullptr)
+    {
+        FrameBufferPool::Release(videoCodecContext);
+    }
+
 #ifdef USE_HWACCEL
     if (videoCodecContext != nullptr)
     {
@@ -70,6 +85,70 @@ inline void Shutdown(const std::unique_ptr<boost::thread>& th)
     }
 }
 
+template<size_t N>
+void Interrupt(const std::unique_ptr<boost::thread>* const (&threads)[N])
+{
+    for (auto th : threads)
+    {
+        if (*th)
+        {
+            (*th)->interrupt();
+        }
+    }
+}
+
+// Interrupts all first so that they wind down together
+template<size_t N>
+void Shutdown(const std::unique_ptr<boost::thread>* const (&threads)[N])
+{
+    Interrupt(threads);
+    for (auto th : threads)
+    {
+        if (*th)
+        {
+            (*th)->join();
+        }
+    }
+}
+
+int AbortIo(void* /*unused*/)
+{
+    return 1;
+}
+
+// Same as ffplay does for streams carrying a display matrix
+std::string GetRotationFilter(const AVStream* stream)
+{
+    const auto displayMatrix = av_stream_get_side_data(stream, AV_PKT_DATA_DISPLAYMATRIX, nullptr);
+    if (displayMatrix == nullptr)
+    {
+        return std::string();
+    }
+
+    double theta = -av_display_rotation_get(reinterpret_cast<const int32_t*>(displayMatrix));
+    theta -= 360 * floor(theta / 360 + 0.9 / 360);
+
+    if (fabs(theta - 90) < 1.0)
+    {
+        return "transpose=clock";
+    }
+    if (fabs(theta - 180) < 1.0)
+    {
+        return "hflip,vflip";
+    }
+    if (fabs(theta - 270) < 1.0)
+    {
+        return "transpose=cclock";
+    }
+    if (fabs(theta) > 1.0)
+    {
+        char buffer[64];
+        sprintf_s(buffer, "rotate=%f*PI/180", theta);
+        return buffer;
+    }
+    return std::string();
+}
+
 int ThisThreadInterruptionRequested(void* /*unused*/)
 {
     return static_cast<int>(boost::this_thread::interruption_requested());
@@ -111,9 +190,11 @@ boost::log::sources::channel_logger_mt<>
 
 } // namespace channel_logger
 
-std::unique_ptr<IFrameDecoder> GetFrameDecoder(std::unique_ptr<IAudioPlayer> audioPlayer)
+std::unique_ptr<IFrameDecoder> GetFrameDecoder(std::unique_ptr<IAudioPlayer> audioPlayer,
+    std::shared_ptr<ITimeSource> timeSource)
 {
-    return std::unique_ptr<IFrameDecoder>(new FFmpegDecoder(std::move(audioPlayer)));
+    return std::unique_ptr<IFrameDecoder>(new FFmpegDecoder(std::move(audioPlayer),
+        timeSource ? std::move(timeSource) : GetSystemTimeSource()));
 }
 
 // https://gist.github.com/xlphs/9895065
@@ -123,15 +204,19 @@ private:
     AVIOContext *ioCtx;
     uint8_t *buffer;  // internal buffer for ffmpeg
     int bufferSize;
-    FILE *fh;
+    std::unique_ptr<FileReader> reader; // stdio, direct or io_uring, chosen on open
+
+    void allocate();
 
 public:
     IOContext(const PathType &datafile);
+    explicit IOContext(FILE *file); // takes ownership
     ~IOContext();
 
     void initAVFormatContext(AVFormatContext * /*pCtx*/);
 
-    bool valid() const { return fh != nullptr; }
+    bool valid() const { return reader != nullptr; }
+    const FileReader* fileReader() const { return reader.get(); }
 
     static int IOReadFunc(void *data, uint8_t *buf, int buf_size);
     static int64_t IOSeekFunc(void *data, int64_t pos, int whence);
@@ -141,57 +226,55 @@ public:
 int FFmpegDecoder::IOContext::IOReadFunc(void *data, uint8_t *buf, int buf_size)
 {
     auto *hctx = static_cast<IOContext *>(data);
-    size_t len = fread(buf, 1, buf_size, hctx->fh);
+    const int len = hctx->reader->read(buf, buf_size);
+    if (len < 0)
+    {
+        // Not the end of the file, FFmpeg may retry or give up on the packet
+        return AVERROR(EIO);
+    }
     if (len == 0)
     {
-        // Let FFmpeg know that we have reached EOF, or do something else
+        // Let FFmpeg know that we have reached EOF
         return AVERROR_EOF;
     }
-    return static_cast<int>(len);
+    return len;
 }
 
 // whence: SEEK_SET, SEEK_CUR, SEEK_END (like fseek) and AVSEEK_SIZE
 // static
 int64_t FFmpegDecoder::IOContext::IOSeekFunc(void *data, int64_t pos, int whence)
 {
-    auto *hctx = static_cast<IOContext *>(data);
+    FileReader& reader = *static_cast<IOContext *>(data)->reader;
 
-    if (whence == AVSEEK_SIZE)
+    switch (whence & ~AVSEEK_FORCE)
     {
-        // return the file size if you wish to
-        auto current = _ftelli64(hctx->fh);
-        int rs = _fseeki64(hctx->fh, 0, SEEK_END);
-        if (rs != 0)
-        {
-            return -1LL;
-        }
-        int64_t result = _ftelli64(hctx->fh);
-        _fseeki64(hctx->fh, current, SEEK_SET);  // reset to the saved position
-        return result;
-    }
-
-    int rs = _fseeki64(hctx->fh, pos, whence);
-    if (rs != 0)
-    {
-        return -1LL;
+    case AVSEEK_SIZE: return reader.size();
+    case SEEK_SET: return reader.seek(pos);
+    case SEEK_CUR: return reader.seek(reader.tell() + pos);
+    case SEEK_END: return reader.seek(reader.size() + pos);
     }
-    return _ftelli64(hctx->fh);  // int64_t is usually long long
+    return -1LL;
 }
 
 FFmpegDecoder::IOContext::IOContext(const PathType &s)
+    : reader(OpenFileReader(s))
+{
+    allocate();
+}
+
+FFmpegDecoder::IOContext::IOContext(FILE *file)
+    : reader(WrapFileReader(file))
+{
+    allocate();
+}
+
+void FFmpegDecoder::IOContext::allocate()
 {
     // allocate buffer
     bufferSize = 1024 * 64;                     // FIXME: not sure what size to use
     buffer = static_cast<uint8_t *>(av_malloc(bufferSize));  // see destructor for details
 
-                                                // open file
-    if ((fh = 
-#ifdef _WIN32
-        _wfsopen(s.c_str(), L"rb", _SH_DENYNO)
-#else
-        _fsopen(s.c_str(), "rb", _SH_DENYNO)
-#endif
-    ) == nullptr)
+    if (!valid())
     {
         // fprintf(stderr, "MyIOContext: failed to open file %s\n", s.c_str());
         BOOST_LOG_TRIVIAL(error) << "MyIOContext: failed to open file";
@@ -210,9 +293,7 @@ FFmpegDecoder::IOContext::IOContext(const PathType &s)
 FFmpegDecoder::IOContext::~IOContext()
 {
     CHANNEL_LOG(ffmpeg_closing) << "In IOContext::~IOContext()";
-    if (fh != nullptr) {
-        fclose(fh);
-    }
+    reader.reset();
 
     // NOTE: ffmpeg messes up the buffer
     // so free the buffer first then free the context
@@ -230,11 +311,10 @@ void FFmpegDecoder::IOContext::initAVFormatContext(AVFormatContext *pCtx)
     // pCtx->iformat = av_find_input_format("h264");
 
     // or read some of the file and let ffmpeg do the guessing
-    size_t len = fread(buffer, 1, bufferSize, fh);
-    if (len == 0) {
+    if (reader->read(buffer, bufferSize) <= 0) {
         return;
     }
-    _fseeki64(fh, 0, SEEK_SET);  // reset to beginning of file
+    reader->seek(0);  // reset to beginning of file
 
     AVProbeData probeData = { nullptr };
     probeData.buf = buffer;
@@ -245,13 +325,56 @@ void FFmpegDecoder::IOContext::initAVFormatContext(AVFormatContext *pCtx)
 
 //////////////////////////////////////////////////////////////////////////////
 
-FFmpegDecoder::FFmpegDecoder(std::unique_ptr<IAudioPlayer> audioPlayer)
+// What a closed file leaves behind once its threads are gone
+struct FFmpegDecoder::Teardown
+{
+    AVFormatContext* formatContext = nullptr;
+    std::unique_ptr<IOContext> ioCtx;
+    AVCodecContext* videoCodecContext = nullptr;
+    AVCodecContext* audioCodecContext = nullptr;
+    std::unique_ptr<IntraDecoderPool> intraDecoderPool;
+    std::unique_ptr<TimeshiftBuffer> timeshift;
+    std::unique_ptr<FileSequence> fileSequence;
+
+    bool empty() const
+    {
+        return formatContext == nullptr && !ioCtx && videoCodecContext == nullptr
+            && audioCodecContext == nullptr && !intraDecoderPool && !timeshift && !fileSequence;
+    }
+
+    void run()
+    {
+        intraDecoderPool.reset();
+        FreeVideoCodecContext(videoCodecContext);
+        avcodec_free_context(&audioCodecContext);
+
+        if (formatContext != nullptr)
+        {
+            // Nobody waits for a stalled source to say goodbye
+            formatContext->interrupt_callback.callback = AbortIo;
+            avformat_close_input(&formatContext);
+        }
+        ioCtx.reset();
+
+        timeshift.reset();
+        fileSequence.reset();
+
+        CHANNEL_LOG(ffmpeg_closing) << "Old file torn down";
+    }
+};
+
+//////////////////////////////////////////////////////////////////////////////
+
+FFmpegDecoder::FFmpegDecoder(std::unique_ptr<IAudioPlayer> audioPlayer, std::shared_ptr<ITimeSource> timeSource)
     : m_frameListener(nullptr),
       m_decoderListener(nullptr),
       m_audioSettings({48000, 2, av_get_default_channel_layout(2), AV_SAMPLE_FMT_S16}),
       m_pixelFormat(AV_PIX_FMT_YUV420P),
       m_allowDirect3dData(false),
-      m_audioPlayer(std::move(audioPlayer))
+      m_autoCrop(false),
+      m_splitWipePosition(0.5),
+      m_audioPlayer(std::move(audioPlayer)),
+      m_timeSource(std::move(timeSource))
 {
     av_log_set_level(AV_LOG_ERROR);
     av_log_set_callback(log_callback);
@@ -259,18 +382,32 @@ FFmpegDecoder::FFmpegDecoder(std::unique_ptr<IAudioPlayer> audioPlayer)
     m_audioPlayer->SetCallback(this);
 
     resetVariables();
+    m_closeTime = 0;
+    m_windDownTime = 0;
+
+    m_governorId = DecodeGovernor::Instance().registerDecoder();
+    m_decodeQuality = DECODE_QUALITY_FULL;
+    m_videoDecodeTime = 0;
 
     // init codecs
 #if ( LIBAVFORMAT_VERSION_INT <= AV_VERSION_INT(58,9,100) )
     avcodec_register_all();
     av_register_all();
 #endif
+#if ( LIBAVFILTER_VERSION_INT < AV_VERSION_INT(7,14,100) )
+    avfilter_register_all();
+#endif
 
     //avdevice_register_all();
     avformat_network_init();
 }
 
-FFmpegDecoder::~FFmpegDecoder() { close(); }
+FFmpegDecoder::~FFmpegDecoder()
+{
+    close();
+    waitForClosed(); // the threads use this object
+    DecodeGovernor::Instance().unregisterDecoder(m_governorId);
+}
 
 void FFmpegDecoder::resetVariables()
 {
@@ -282,9 +419,8 @@ void FFmpegDecoder::resetVariables()
     m_videoStream = nullptr;
     m_audioStream = nullptr;
 
-    m_startTime = 0;
+    m_position.update([](PlaybackPosition& position) { position = {}; });
     m_currentTime = 0;
-    m_duration = 0;
 
     m_imageCovertContext = nullptr;
 
@@ -310,18 +446,104 @@ void FFmpegDecoder::resetVariables()
 
     m_speedRational = { 1, 1 };
 
+    m_cropDetector.reset();
+
+    m_loopState = LOOP_IDLE;
+    m_loopStart = 0;
+    m_loopEnd = 0;
+    m_loopPeriod = 0;
+    m_loopChanged = false;
+    m_audioLoopOffset = 0;
+
+    m_videoFilterGraph = nullptr;
+    m_videoFilterSource = nullptr;
+    m_videoFilterSink = nullptr;
+    m_videoFilterInput = {};
+    m_videoFilterFailed = false;
+    m_videoFilterGraphDescription.clear();
+    m_videoFilterTime = 0;
+    m_videoFilterFrames = 0;
+    m_lateFrames = 0;
+    m_audioLateResyncs = 0;
+
+    m_seekRequestTime = 0;
+    m_seekLatencyPending = false;
+    {
+        boost::lock_guard<boost::mutex> locker(m_seekLatencyMutex);
+        m_seekLatencies.clear();
+        m_seekLatencyCount = 0;
+    }
+
+    m_audioOnly = false;
+    m_audioBatch.clear();
+    m_audioOnlyWakeups = 0;
+    m_audioOnlyCpuTime = 0;
+
+    m_audioDecodeTime = 0;
+    m_audioResampleTime = 0;
+    m_audioMediaTime = 0;
+    m_audioPitchShiftBase = m_audioPlayer->GetProcessingSeconds();
+    m_audioOnlyCpuBase = 0;
+    m_audioOnlyStartTime = 0;
+
+    m_sourceUrl.clear();
+    {
+        boost::lock_guard<boost::mutex> locker(m_streamAnalysisMutex);
+        m_streamAnalysis.reset();
+    }
+
     CHANNEL_LOG(ffmpeg_closing) << "Variables reset";
 }
 
 void FFmpegDecoder::close()
 {
     CHANNEL_LOG(ffmpeg_closing) << "Start file closing";
+    const auto startTime = boost::chrono::steady_clock::now();
+    m_controlMonitor.cancel();
+    m_controlMonitor.begin(CONTROL_CLOSE);
+
+    waitForClosed(); // one close at a time
 
     CHANNEL_LOG(ffmpeg_closing) << "Aborting threads";
+    {
+        boost::lock_guard<boost::mutex> locker(m_threadsMutex);
+        const std::unique_ptr<boost::thread>* const threads[] = {
+            &m_mainParseThread,
+            &m_timeshiftThread,
+            &m_mainVideoThread,
+            &m_mainVideoFilterThread,
+            &m_mainAudioThread,
+            &m_mainDisplayThread,
+            &m_analysisThread,
+        };
+        Interrupt(threads);
+    }
+
+    {
+        boost::lock_guard<boost::mutex> locker(m_closingMutex);
+        m_closing = true;
+    }
+    m_reaper.post([this] { finishClosing(); });
+
+    m_closeTime = boost::chrono::duration<double>(boost::chrono::steady_clock::now() - startTime).count();
+    m_controlMonitor.end(CONTROL_CLOSE);
+}
+
+void FFmpegDecoder::finishClosing()
+{
+    const auto startTime = boost::chrono::steady_clock::now();
+
     Shutdown(m_mainParseThread);  // controls other threads, hence stop first
-    Shutdown(m_mainVideoThread);
-    Shutdown(m_mainAudioThread);
-    Shutdown(m_mainDisplayThread);
+    // Interrupted once more, the parse thread may have started some after close()
+    const std::unique_ptr<boost::thread>* const workers[] = {
+        &m_timeshiftThread,
+        &m_mainVideoThread,
+        &m_mainVideoFilterThread,
+        &m_mainAudioThread,
+        &m_mainDisplayThread,
+        &m_analysisThread,
+    };
+    Shutdown(workers);
 
     m_audioPlayer->Close();
 
@@ -331,51 +553,80 @@ void FFmpegDecoder::close()
 
     closeProcessing();
 
+    m_windDownTime = boost::chrono::duration<double>(boost::chrono::steady_clock::now() - startTime).count();
+
     if (m_decoderListener != nullptr) {
         m_decoderListener->playingFinished();
     }
+
+    boost::lock_guard<boost::mutex> locker(m_closingMutex);
+    m_closing = false;
+    m_closingCV.notify_all();
+}
+
+void FFmpegDecoder::waitForClosed()
+{
+    boost::unique_lock<boost::mutex> locker(m_closingMutex);
+    while (m_closing)
+    {
+        m_closingCV.wait(locker);
+    }
 }
 
 void FFmpegDecoder::closeProcessing()
 {
+    {
+        // The view may still be painting the last one
+        boost::lock_guard<boost::mutex> locker(m_videoFramesMutex);
+        m_frameDisplayingRequested = false;
+        m_videoFramesQueue.clear();
+    }
     m_audioPacketsQueue.clear();
     m_videoPacketsQueue.clear();
+    m_videoFilterQueue.clear();
 
     CHANNEL_LOG(ffmpeg_closing) << "Closing old vars";
 
     m_mainVideoThread.reset();
+    m_mainVideoFilterThread.reset();
     m_mainAudioThread.reset();
     m_mainParseThread.reset();
     m_mainDisplayThread.reset();
+    m_timeshiftThread.reset();
+    m_analysisThread.reset();
 
-    m_audioPlayer->Reset();
+    auto teardown = std::make_shared<Teardown>();
+    teardown->timeshift = std::move(m_timeshift);
 
-    // Free videoFrames
-    m_videoFramesQueue.clear();
+    m_loopCache.clear();
+    m_packetHistory.clear();
+    teardown->fileSequence = std::move(m_fileSequence);
+
+    m_audioPlayer->Reset();
 
     sws_freeContext(m_imageCovertContext);
 
+    freeVideoFilter();
+
     if (m_audioSwrContext != nullptr)
     {
         swr_free(&m_audioSwrContext);
     }
 
-    FreeVideoCodecContext(m_videoCodecContext);
+    // Codecs and the file are closed by a task of their own, stalled sources can take their time there
+    teardown->intraDecoderPool = std::move(m_intraDecoderPool);
+    std::swap(teardown->videoCodecContext, m_videoCodecContext);
+    std::swap(teardown->audioCodecContext, m_audioCodecContext);
 
-    // Close the audio codec
-    avcodec_free_context(&m_audioCodecContext);
+    const bool isFileReallyClosed = m_formatContext != nullptr;
+    std::swap(teardown->formatContext, m_formatContext);
+    teardown->ioCtx = std::move(m_ioCtx);
 
-    bool isFileReallyClosed = false;
-
-    // Close video file
-    if (m_formatContext != nullptr)
+    if (!teardown->empty())
     {
-        avformat_close_input(&m_formatContext);
-        isFileReallyClosed = true;
+        m_reaper.post([teardown] { teardown->run(); });
     }
 
-    m_ioCtx.reset();
-
     CHANNEL_LOG(ffmpeg_closing) << "Old file closed";
 
     resetVariables();
@@ -395,16 +646,61 @@ bool FFmpegDecoder::openUrl(const std::string& url)
     return openDecoder(PathType(), url, false);
 }
 
-bool FFmpegDecoder::openDecoder(const PathType &file, const std::string& url, bool isFile)
+bool FFmpegDecoder::openFileSequence(const std::vector<PathType>& files)
+{
+    auto fileSequence = std::make_unique<FileSequence>();
+    if (!fileSequence->init(files))
+    {
+        return false;
+    }
+
+    FILE* concatScript = fileSequence->createScript();
+    if (concatScript == nullptr)
+    {
+        BOOST_LOG_TRIVIAL(error) << "Unable to create concat script";
+        return false;
+    }
+
+    if (!openDecoder(PathType(), std::string(), true, concatScript))
+    {
+        return false;
+    }
+
+    CHANNEL_LOG(ffmpeg_opening) << "Opened sequence of " << fileSequence->size()
+        << " files, " << fileSequence->duration() << " s total";
+    m_fileSequence = std::move(fileSequence);
+    return true;
+}
+
+bool FFmpegDecoder::openImageSequence(const std::string& pattern, int startNumber, double frameRate)
+{
+    if (frameRate <= 0)
+    {
+        return false;
+    }
+    const ImageSequence imageSequence{ startNumber, av_d2q(frameRate, 1001000) };
+    return openDecoder(PathType(), pattern, false, nullptr, &imageSequence);
+}
+
+bool FFmpegDecoder::openDecoder(const PathType &file, const std::string& url, bool isFile,
+    FILE* concatScript, const ImageSequence* imageSequence)
 {
     close();
+    waitForClosed();
 
-    m_referenceTime = boost::chrono::high_resolution_clock::now().time_since_epoch();
+    m_referenceTime = m_timeSource->now().time_since_epoch();
+
+    if (concatScript == nullptr && imageSequence == nullptr)
+    {
+        m_sourceUrl = isFile ? ToUtf8(file) : url;
+    }
 
     std::unique_ptr<IOContext> ioCtx;
     if (isFile)
     {
-        ioCtx = std::make_unique<IOContext>(file);
+        ioCtx = (concatScript != nullptr)
+            ? std::make_unique<IOContext>(concatScript)
+            : std::make_unique<IOContext>(file);
         if (!ioCtx->valid())
         {
             BOOST_LOG_TRIVIAL(error) << "Couldn't open video/audio file";
@@ -414,11 +710,28 @@ bool FFmpegDecoder::openDecoder(const PathType &file, const std::string& url, bo
 
     AVDictionary *streamOpts = nullptr;
     auto avOptionsGuard = MakeGuard(&streamOpts, av_dict_free);
+    AVInputFormat* inputFormat = nullptr;
 
     m_formatContext = avformat_alloc_context();
     if (isFile)
     {
         ioCtx->initAVFormatContext(m_formatContext);
+        if (concatScript != nullptr)
+        {
+            // The script lists absolute paths, segments share one set of decoders
+            av_dict_set(&streamOpts, "safe", "0", 0);
+        }
+    }
+    else if (imageSequence != nullptr)
+    {
+        // Numbered files on local disk, each one a packet for the intra-only decoder pool
+        inputFormat = av_find_input_format("image2");
+        char frameRate[32];
+        sprintf_s(frameRate, sizeof(frameRate) / sizeof(frameRate[0]),
+            "%d/%d", imageSequence->frameRate.num, imageSequence->frameRate.den);
+        av_dict_set(&streamOpts, "framerate", frameRate, 0);
+        av_dict_set(&streamOpts, "pattern_type", "sequence", 0);
+        av_dict_set_int(&streamOpts, "start_number", imageSequence->startNumber, 0);
     }
     else
     {
@@ -435,7 +748,7 @@ bool FFmpegDecoder::openDecoder(const PathType &file, const std::string& url, bo
     auto formatContextGuard = MakeGuard(&m_formatContext, avformat_close_input);
 
     // Open video file
-    const int error = avformat_open_input(&m_formatContext, url.c_str(), nullptr, &streamOpts);
+    const int error = avformat_open_input(&m_formatContext, url.c_str(), inputFormat, &streamOpts);
     if (error != 0)
     {
         BOOST_LOG_TRIVIAL(error) << "Couldn't open video/audio file error: " << error;
@@ -495,14 +808,30 @@ bool FFmpegDecoder::openDecoder(const PathType &file, const std::string& url, bo
         timeStream = m_audioStream;
     }
 
-    m_startTime = (timeStream->start_time > 0)
+    const int64_t startTime = (timeStream->start_time > 0)
         ? timeStream->start_time
         : ((m_formatContext->start_time == AV_NOPTS_VALUE)? 0 
             : int64_t((m_formatContext->start_time / av_q2d(timeStream->time_base)) / 1000000LL));
-    m_duration = (timeStream->duration > 0)
+    const int64_t duration = (timeStream->duration > 0)
         ? timeStream->duration
         : ((m_formatContext->duration == AV_NOPTS_VALUE)? 0 
             : int64_t((m_formatContext->duration / av_q2d(timeStream->time_base)) / 1000000LL));
+    m_position.update([startTime, duration, timeStream](PlaybackPosition& position) {
+        position = { startTime, startTime, startTime + duration, av_q2d(timeStream->time_base) };
+    });
+
+    if (m_videoStream != nullptr)
+    {
+        m_videoFilterGraphDescription = GetRotationFilter(m_videoStream);
+        if (!m_videoFilterDescription.empty())
+        {
+            if (!m_videoFilterGraphDescription.empty())
+            {
+                m_videoFilterGraphDescription += ',';
+            }
+            m_videoFilterGraphDescription += m_videoFilterDescription;
+        }
+    }
 
     if (!resetVideoProcessing())
     {
@@ -522,6 +851,7 @@ bool FFmpegDecoder::openDecoder(const PathType &file, const std::string& url, bo
 
 bool FFmpegDecoder::resetVideoProcessing()
 {
+    m_intraDecoderPool.reset();
     FreeVideoCodecContext(m_videoCodecContext);
 
     // Find the decoder for the video stream
@@ -546,6 +876,8 @@ bool FFmpegDecoder::resetVideoProcessing()
             return false;  // Codec not found
         }
 
+        bool softwareDecoding = false;
+
 #ifdef USE_HWACCEL
         m_videoCodecContext->coded_width = m_videoCodecContext->width;
         m_videoCodecContext->coded_height = m_videoCodecContext->height;
@@ -570,18 +902,44 @@ bool FFmpegDecoder::resetVideoProcessing()
 
             m_videoCodecContext->thread_count = 2;
             m_videoCodecContext->flags2 |= AV_CODEC_FLAG2_FAST;
+            softwareDecoding = true;
         }
 #else
         m_videoCodecContext->thread_count = 2;
-        m_videoCodecContext->flags2 |= CODEC_FLAG2_FAST;
+        m_videoCodecContext->flags2 |= AV_CODEC_FLAG2_FAST;
+        softwareDecoding = true;
 #endif
 
+        // Every frame of intra-only codecs stands alone, so whole frames can be decoded side by side
+        const unsigned numCores = boost::thread::hardware_concurrency();
+        if (softwareDecoding && numCores > 1 && IntraDecoderPool::IsIntraOnly(m_videoStream->codecpar))
+        {
+            m_intraDecoderPool = std::make_unique<IntraDecoderPool>();
+            if (m_intraDecoderPool->open(m_videoStream->codecpar, numCores, INTRA_FRAME_BUDGET))
+            {
+                CHANNEL_LOG(ffmpeg_opening) << "Intra-only decoding on " << numCores << " contexts";
+            }
+            else
+            {
+                m_intraDecoderPool.reset();
+            }
+        }
 
-    // Open codec
-        if (avcodec_open2(m_videoCodecContext, m_videoCodec, nullptr) < 0)
+        // With the pool decoding everything the context is left unopened, it only describes the stream
+        if (!m_intraDecoderPool)
         {
-            assert(false && "Error on codec opening");
-            return false;  // Could not open codec
+            if (softwareDecoding)
+            {
+                FrameBufferPool::Attach(m_videoCodecContext, m_videoCodec);
+            }
+
+            // Open codec; its frame threads are started there and decode just as the video thread does
+            ThreadPolicyForNewThreads codecThreads(THREAD_ROLE_DECODE);
+            if (avcodec_open2(m_videoCodecContext, m_videoCodec, nullptr) < 0)
+            {
+                assert(false && "Error on codec opening");
+                return false;  // Could not open codec
+            }
         }
 
         // Some broken files can pass codec check but don't have width x height
@@ -670,20 +1028,23 @@ void FFmpegDecoder::play(bool isPaused)
     if (!m_mainParseThread)
     {
         m_isPlaying = true;
+        m_audioOnly = m_videoStreamNumber < 0 && m_audioStreamNumber >= 0;
         m_mainParseThread = std::make_unique<boost::thread>(&FFmpegDecoder::parseRunnable, this);
-        m_mainDisplayThread = std::make_unique<boost::thread>(&FFmpegDecoder::displayRunnable, this);
+        if (!m_audioOnly)
+        {
+            m_mainDisplayThread = std::make_unique<boost::thread>(&FFmpegDecoder::displayRunnable, this);
+        }
         CHANNEL_LOG(ffmpeg_opening) << "Playing";
     }
 }
 
 void FFmpegDecoder::AppendFrameClock(double frame_clock)
 {
-    if (!m_mainVideoThread && (m_decoderListener != nullptr) && m_seekDuration == AV_NOPTS_VALUE)
+    if (!m_mainVideoThread && m_seekDuration == AV_NOPTS_VALUE)
     {
-        m_decoderListener->changedFramePosition(
-            m_startTime,
-            int64_t((m_audioPTS + frame_clock) / av_q2d(m_audioStream->time_base)), 
-            m_duration + m_startTime);
+        const auto frame = int64_t((m_audioPTS + frame_clock - m_audioLoopOffset)
+            / av_q2d(m_audioStream->time_base));
+        m_position.update([frame](PlaybackPosition& position) { position.frame = frame; });
     }
 
     const auto speed = getSpeedRational();
@@ -731,18 +1092,172 @@ void FFmpegDecoder::finishedDisplayingFrame(unsigned int generation)
             }
 
             m_videoFramesQueue.popFront();
+
+            if (m_seekLatencyPending.exchange(false))
+            {
+                recordSeekLatency();
+                m_controlMonitor.end(CONTROL_SEEK);
+            }
+            m_controlMonitor.end(CONTROL_RESUME);
+            m_controlMonitor.end(CONTROL_NEXT_FRAME);
         }
         m_frameDisplayingRequested = false;
     }
     m_videoFramesCV.notify_all();
 }
 
+void FFmpegDecoder::recordSeekLatency()
+{
+    const double requestTime = m_seekRequestTime.exchange(0);
+    if (requestTime == 0)
+    {
+        return;
+    }
+
+    const double latency = GetSteadyTime() - requestTime;
+    CHANNEL_LOG(ffmpeg_seek) << "Seek answered in " << latency * 1000. << " ms";
+
+    boost::lock_guard<boost::mutex> locker(m_seekLatencyMutex);
+    if (m_seekLatencies.size() < SEEK_LATENCY_SAMPLES)
+    {
+        m_seekLatencies.push_back(latency);
+    }
+    else
+    {
+        m_seekLatencies[m_seekLatencyCount % SEEK_LATENCY_SAMPLES] = latency;
+    }
+    ++m_seekLatencyCount;
+}
+
+void FFmpegDecoder::setVideoFilter(const std::string& description)
+{
+    m_videoFilterDescription = description;
+}
+
+void FFmpegDecoder::setLoopRange(double startSecs, double endSecs)
+{
+    m_loopStart = startSecs;
+    m_loopEnd = endSecs;
+    m_loopChanged = true;
+    notifyParseThread();
+}
+
+void FFmpegDecoder::setDecodePriority(int priority)
+{
+    DecodeGovernor::Instance().setPriority(m_governorId, priority);
+}
+
+bool FFmpegDecoder::setSplitWipeSource(const PathType& source)
+{
+    // Opened and torn down outside the lock, the display thread goes on meanwhile
+    std::unique_ptr<SplitWipe> splitWipe;
+    if (!source.empty())
+    {
+        splitWipe = std::make_unique<SplitWipe>();
+        if (!splitWipe->open(ToUtf8(source)))
+        {
+            return false;
+        }
+    }
+
+    {
+        boost::lock_guard<boost::mutex> locker(m_splitWipeMutex);
+        if (splitWipe)
+        {
+            splitWipe->setPosition(m_splitWipePosition);
+        }
+        std::swap(m_splitWipe, splitWipe);
+    }
+    return true;
+}
+
+void FFmpegDecoder::setSplitWipePosition(double position)
+{
+    boost::lock_guard<boost::mutex> locker(m_splitWipeMutex);
+    m_splitWipePosition = position;
+    if (m_splitWipe)
+    {
+        m_splitWipe->setPosition(position);
+    }
+}
+
+void FFmpegDecoder::analyzeStream()
+{
+    if (m_sourceUrl.empty())
+    {
+        return;
+    }
+
+    boost::lock_guard<boost::mutex> locker(m_threadsMutex);
+    if (!m_analysisThread)
+    {
+        m_analysisThread = std::make_unique<boost::thread>(&FFmpegDecoder::analysisRunnable, this, m_sourceUrl);
+    }
+}
+
+void FFmpegDecoder::analysisRunnable(const std::string& url)
+{
+    ApplyThreadPolicy(THREAD_ROLE_BACKGROUND);
+
+    // Its own demuxer, playback is not held up
+    auto analysis = StreamAnalyzer::Analyze(url);
+    if (!analysis)
+    {
+        return;
+    }
+
+    {
+        boost::lock_guard<boost::mutex> locker(m_streamAnalysisMutex);
+        m_streamAnalysis = std::move(analysis);
+    }
+    CHANNEL_LOG(ffmpeg_opening) << "Stream analyzed";
+
+    if (m_decoderListener != nullptr) {
+        m_decoderListener->streamAnalyzed();
+    }
+}
+
+bool FFmpegDecoder::isLoopStart(int64_t seekDuration) const
+{
+    const double LOOP_START_TOLERANCE = 0.05;
+
+    const AVStream* timeStream = (m_videoStream != nullptr) ? m_videoStream : m_audioStream;
+    return m_loopEnd > m_loopStart
+        && fabs(seekDuration * av_q2d(timeStream->time_base) - m_loopStart) < LOOP_START_TOLERANCE;
+}
+
+bool FFmpegDecoder::isInLoopRange(double start, double end) const
+{
+    const double EPSILON = 0.001;
+    return m_loopEnd <= m_loopStart
+        || start >= m_loopStart - EPSILON && end <= m_loopEnd + EPSILON;
+}
+
+void FFmpegDecoder::startLoopLap(VideoParseContext& context)
+{
+    // The first lap keeps original timestamps, later ones continue the clock
+    if (context.looping)
+    {
+        context.loopOffset += m_loopPeriod;
+    }
+    context.looping = true;
+}
+
 bool FFmpegDecoder::seekDuration(int64_t duration)
 {
+    // Seeks issued before the picture catches up are felt as one
+    double noRequest = 0;
+    m_seekRequestTime.compare_exchange_strong(noRequest, GetSteadyTime());
+
+    if (m_mainParseThread)
+    {
+        m_controlMonitor.begin(CONTROL_SEEK);
+    }
     if (m_mainParseThread && m_seekDuration.exchange(duration) == AV_NOPTS_VALUE)
     {
         m_videoPacketsQueue.notify();
         m_audioPacketsQueue.notify();
+        notifyParseThread();
     }
 
     return true;
@@ -751,10 +1266,33 @@ bool FFmpegDecoder::seekDuration(int64_t duration)
 void FFmpegDecoder::videoReset()
 {
     m_videoResetting = true;
+    if (m_mainParseThread)
+    {
+        m_controlMonitor.begin(CONTROL_VIDEO_RESET);
+    }
     if (m_mainParseThread && m_videoResetDuration.exchange(m_currentTime) == AV_NOPTS_VALUE)
     {
         m_videoPacketsQueue.notify();
         m_audioPacketsQueue.notify();
+        notifyParseThread();
+    }
+}
+
+void FFmpegDecoder::notifyParseThread()
+{
+    // Taking the mutexes orders this after any predicate check in progress
+    {
+        boost::lock_guard<boost::mutex> locker(m_parseMutex);
+    }
+    m_parseCV.notify_all();
+
+    // Audio only decoding waits for resume on the parse thread
+    if (m_audioOnly)
+    {
+        {
+            boost::lock_guard<boost::mutex> locker(m_isPausedMutex);
+        }
+        m_isPausedCV.notify_all();
     }
 }
 
@@ -776,7 +1314,8 @@ void FFmpegDecoder::seekWhilePaused()
 
 bool FFmpegDecoder::seekByPercent(double percent)
 {
-    return seekDuration(m_startTime + int64_t(m_duration * percent));
+    const auto position = m_position.get();
+    return seekDuration(position.start + int64_t((position.total - position.start) * percent));
 }
 
 bool FFmpegDecoder::getFrameRenderingData(FrameRenderingData *data)
@@ -812,9 +1351,22 @@ bool FFmpegDecoder::getFrameRenderingData(FrameRenderingData *data)
     {
         data->d3d9device = get_device(m_videoCodecContext);
         data->surface = reinterpret_cast<IDirect3DSurface9**>(&current_frame.m_image->data[3]);
+        return true;
     }
 #endif
 
+    boost::lock_guard<boost::mutex> locker(m_splitWipeMutex);
+    if (m_splitWipe && m_videoStream != nullptr)
+    {
+        const double startTime = (m_videoStream->start_time != AV_NOPTS_VALUE)
+            ? m_videoStream->start_time * av_q2d(m_videoStream->time_base) : 0;
+        if (AVFrame* composed = m_splitWipe->compose(current_frame.m_image.get(), current_frame.m_pts - startTime))
+        {
+            data->image = composed->data;
+            data->pitch = composed->linesize;
+        }
+    }
+
     return true;
 }
 
@@ -828,6 +1380,7 @@ bool FFmpegDecoder::pauseResume()
     if (!m_isPaused)
     {
         CHANNEL_LOG(ffmpeg_pause) << "Pause";
+        m_controlMonitor.begin(CONTROL_PAUSE);
         {
             boost::lock_guard<boost::mutex> locker(m_isPausedMutex);
             m_isPaused = true;
@@ -835,12 +1388,14 @@ bool FFmpegDecoder::pauseResume()
         }
         m_videoFramesCV.notify_all();
         m_videoPacketsQueue.notify();
+        m_videoFilterQueue.notify();
         m_audioPacketsQueue.notify();
 
         return true;
     }
 
     CHANNEL_LOG(ffmpeg_pause) << "Resume";
+    m_controlMonitor.begin(CONTROL_RESUME);
     {
         boost::lock_guard<boost::mutex> locker(m_isPausedMutex);
         if (m_videoStartClock != VIDEO_START_CLOCK_NOT_INITIALIZED) {
@@ -881,9 +1436,11 @@ bool FFmpegDecoder::nextFrame()
         m_pauseTimer = currentTime;
 
         m_isVideoSeekingWhilePaused = true;
+        m_controlMonitor.begin(CONTROL_NEXT_FRAME);
     }
     m_isPausedCV.notify_all();
     m_videoPacketsQueue.notify();
+    m_videoFilterQueue.notify();
     return true;
 }
 
@@ -902,7 +1459,8 @@ int FFmpegDecoder::getAudioTrack() const
 
 void FFmpegDecoder::setAudioTrack(int idx)
 {
-    if (idx >= 0 && idx < m_audioIndices.size()) {
+    if (idx >= 0 && idx < m_audioIndices.size() && m_audioStreamNumber != m_audioIndices[idx]) {
+        m_controlMonitor.begin(CONTROL_AUDIO_TRACK);
         m_audioStreamNumber = m_audioIndices[idx];
     }
 }
@@ -914,18 +1472,28 @@ RationalNumber FFmpegDecoder::getSpeedRational() const
 
 void FFmpegDecoder::setSpeedRational(const RationalNumber& speed)
 {
-    boost::lock_guard<boost::mutex> locker(m_isPausedMutex);
+    // Takes effect with the next frame paced or the next audio resampled
+    m_controlMonitor.begin(CONTROL_SPEED);
+    {
+        boost::lock_guard<boost::mutex> locker(m_isPausedMutex);
 
-    const auto time = GetHiResTime();
-    m_speedRational = speed;
+        const auto time = GetHiResTime();
+        m_speedRational = speed;
 
-    m_referenceTime = (boost::chrono::high_resolution_clock::now()
-            - boost::chrono::microseconds(int64_t(time * speed.denominator / speed.numerator * 1000000.)))
-        .time_since_epoch();
+        m_referenceTime = (m_timeSource->now()
+                - boost::chrono::microseconds(int64_t(time * speed.denominator / speed.numerator * 1000000.)))
+            .time_since_epoch();
+    }
+    if (m_isPaused)
+    {
+        m_controlMonitor.end(CONTROL_SPEED); // nothing is played to show it
+    }
 }
 
 std::vector<std::string> FFmpegDecoder::getProperties()
 {
+    waitForClosed();
+
     std::vector<std::string> result;
 
     if (m_formatContext && m_formatContext->iformat && m_formatContext->iformat->long_name)
@@ -965,19 +1533,143 @@ std::vector<std::string> FFmpegDecoder::getProperties()
             "%d / %d @ %.2f FPS %d BPP %d bits", 
             m_videoCodecContext->width, m_videoCodecContext->height, fps, bpp, depth);
         result.push_back(buffer);
+
+        if (m_intraDecoderPool)
+        {
+            sprintf_s(buffer, sizeof(buffer) / sizeof(buffer[0]),
+                "Intra-only decoding: %u threads, %u frames ahead",
+                static_cast<unsigned>(m_intraDecoderPool->numWorkers()),
+                static_cast<unsigned>(m_intraDecoderPool->maxInFlight()));
+            result.push_back(buffer);
+        }
+    }
+
+    {
+        boost::lock_guard<boost::mutex> locker(m_streamAnalysisMutex);
+        if (m_streamAnalysis)
+        {
+            const auto description = m_streamAnalysis->describe();
+            result.insert(result.end(), description.begin(), description.end());
+        }
+    }
+
+    if (!m_videoFilterGraphDescription.empty())
+    {
+        const int64_t frames = m_videoFilterFrames;
+        char buffer[1000];
+        sprintf_s(buffer, sizeof(buffer) / sizeof(buffer[0]),
+            "Filters: %s %.2f ms/frame", m_videoFilterGraphDescription.c_str(),
+            (frames > 0) ? m_videoFilterTime * 1000. / frames : 0.);
+        result.push_back(buffer);
     }
 
     if (m_audioCodec && m_audioCodec->long_name)
         result.push_back(m_audioCodec->long_name);
 
+    {
+        char buffer[1000];
+        sprintf_s(buffer, sizeof(buffer) / sizeof(buffer[0]),
+            "Late frames: %d, audio late resyncs: %d", int(m_lateFrames), int(m_audioLateResyncs));
+        result.push_back(buffer);
+    }
+
+    if (m_videoCodecContext)
+    {
+        char buffer[1000];
+        sprintf_s(buffer, sizeof(buffer) / sizeof(buffer[0]),
+            "Decode quality: %s, priority %d",
+            DecodeQualityName(m_decodeQuality), DecodeGovernor::Instance().priority(m_governorId));
+        result.push_back(buffer);
+    }
+
+    if (m_ioCtx && m_ioCtx->fileReader() != nullptr)
+    {
+        const auto description = m_ioCtx->fileReader()->describe();
+        if (!description.empty())
+            result.push_back(description);
+    }
+
+    {
+        const auto description = m_controlMonitor.describe();
+        if (!description.empty())
+            result.push_back(description);
+    }
+
+    {
+        const auto description = DescribePrimitives();
+        if (!description.empty())
+            result.push_back(description);
+    }
+
+    if (m_closeTime > 0)
+    {
+        char buffer[1000];
+        sprintf_s(buffer, sizeof(buffer) / sizeof(buffer[0]),
+            "Previous close returned in %.1f ms, its threads finished in %.1f ms",
+            m_closeTime * 1000., m_windDownTime * 1000.);
+        result.push_back(buffer);
+    }
+
+    {
+        std::vector<double> latencies;
+        size_t count;
+        {
+            boost::lock_guard<boost::mutex> locker(m_seekLatencyMutex);
+            latencies = m_seekLatencies;
+            count = m_seekLatencyCount;
+        }
+        if (!latencies.empty())
+        {
+            std::sort(latencies.begin(), latencies.end());
+            const auto percentile = [&latencies](double p)
+            {
+                return latencies[std::min(latencies.size() - 1, size_t(p * latencies.size()))] * 1000.;
+            };
+            char buffer[1000];
+            sprintf_s(buffer, sizeof(buffer) / sizeof(buffer[0]),
+                "Seek latency: p50 %.0f ms, p95 %.0f ms, p99 %.0f ms over %u seeks",
+                percentile(0.5), percentile(0.95), percentile(0.99), static_cast<unsigned>(count));
+            result.push_back(buffer);
+        }
+    }
+
+    if (m_audioCodecContext && m_audioMediaTime > 0)
+    {
+        const double media = m_audioMediaTime;
+        const double decode = m_audioDecodeTime;
+        const double resample = m_audioResampleTime;
+        const double pitchShift = m_audioPlayer->GetProcessingSeconds() - m_audioPitchShiftBase;
+        const double total = decode + resample + pitchShift;
+        char buffer[1000];
+        sprintf_s(buffer, sizeof(buffer) / sizeof(buffer[0]),
+            "Audio %d ch %d Hz: decode %.2f%%, resample %.2f%%, pitch shift %.2f%%, %.0fx real time",
+            m_audioCodecContext->channels, m_audioCodecContext->sample_rate,
+            decode * 100. / media, resample * 100. / media, pitchShift * 100. / media,
+            (total > 0) ? media / total : 0.);
+        result.push_back(buffer);
+    }
+
+    if (m_audioOnly)
+    {
+        const double elapsed = GetSteadyTime() - m_audioOnlyStartTime;
+        if (elapsed > 0)
+        {
+            char buffer[1000];
+            sprintf_s(buffer, sizeof(buffer) / sizeof(buffer[0]),
+                "Audio only: %.1f wakeups/s, %.2f%% CPU",
+                m_audioOnlyWakeups / elapsed, (m_audioOnlyCpuTime - m_audioOnlyCpuBase) * 100. / elapsed);
+            result.push_back(buffer);
+        }
+    }
+
     return result;
 }
 
 
-void FFmpegDecoder::handleDirect3dData(AVFrame* videoFrame)
+void FFmpegDecoder::handleDirect3dData(AVFrame* videoFrame, bool allowDirect3dData)
 {
 #ifdef USE_HWACCEL
-    if (!m_allowDirect3dData && videoFrame->format == AV_PIX_FMT_DXVA2_VLD)
+    if (!allowDirect3dData && videoFrame->format == AV_PIX_FMT_DXVA2_VLD)
     {
         dxva2_retrieve_data_call(m_videoCodecContext, videoFrame);
         assert(videoFrame->format != AV_PIX_FMT_DXVA2_VLD);
@@ -989,6 +1681,6 @@ double FFmpegDecoder::GetHiResTime()
 {
     const auto speed = getSpeedRational();
     return boost::chrono::duration_cast<boost::chrono::microseconds>(
-        boost::chrono::high_resolution_clock::now() - boost::chrono::high_resolution_clock::time_point(m_referenceTime)).count()
+        m_timeSource->now() - boost::chrono::high_resolution_clock::time_point(m_referenceTime)).count()
             / 1000000. * speed.numerator / speed.denominator;
 }
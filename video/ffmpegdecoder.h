@@ -8,6 +8,7 @@ extern "C" {
 #include <libavformat/avformat.h>
 #include <libswscale/swscale.h>
 #include <libswresample/swresample.h>
+#include <libavfilter/avfilter.h>
 //#include <libavdevice/avdevice.h>
 }
 
@@ -41,6 +42,22 @@ extern boost::log::sources::channel_logger_mt<>
 #include "fqueue.h"
 #include "videoframe.h"
 #include "vqueue.h"
+#include "framequeue.h"
+#include "cropdetector.h"
+#include "timeshiftbuffer.h"
+#include "loopcache.h"
+#include "packethistory.h"
+#include "filesequence.h"
+#include "intradecoderpool.h"
+#include "threadpolicy.h"
+#include "backgroundreaper.h"
+#include "decodegovernor.h"
+#include "controlmonitor.h"
+#include "timesource.h"
+#include "primitivetimer.h"
+#include "positionsnapshot.h"
+#include "streamanalyzer.h"
+#include "framecomparator.h"
 
 
 // Inspired by http://dranger.com/ffmpeg/ffmpeg.html
@@ -48,7 +65,7 @@ extern boost::log::sources::channel_logger_mt<>
 class FFmpegDecoder : public IFrameDecoder, public IAudioPlayerCallback
 {
    public:
-    FFmpegDecoder(std::unique_ptr<IAudioPlayer> audioPlayer);
+    FFmpegDecoder(std::unique_ptr<IAudioPlayer> audioPlayer, std::shared_ptr<ITimeSource> timeSource);
     ~FFmpegDecoder() override;
 
     FFmpegDecoder(const FFmpegDecoder&) = delete;
@@ -58,7 +75,9 @@ class FFmpegDecoder : public IFrameDecoder, public IAudioPlayerCallback
 
     bool openFile(const PathType& file) override;
     bool openUrl(const std::string& url) override;
-    bool seekDuration(int64_t duration);
+    bool openFileSequence(const std::vector<PathType>& files) override;
+    bool openImageSequence(const std::string& pattern, int startNumber, double frameRate) override;
+    bool seekDuration(int64_t duration) override;
     bool seekByPercent(double percent) override;
 
     void videoReset() override;
@@ -84,6 +103,8 @@ class FFmpegDecoder : public IFrameDecoder, public IAudioPlayerCallback
 
     void finishedDisplayingFrame(unsigned int generation) override;
 
+    PlaybackPosition getPlaybackPosition() const override { return m_position.get(); }
+
     void close() override;
     void play(bool isPaused = false) override;
     bool pauseResume() override;
@@ -99,43 +120,134 @@ class FFmpegDecoder : public IFrameDecoder, public IAudioPlayerCallback
 
     std::vector<std::string> getProperties() override;
 
+    void analyzeStream() override;
+
+    void setVideoFilter(const std::string& description) override;
+
+    void setAutoCrop(bool enable) override { m_autoCrop = enable; }
+
+    void setLoopRange(double startSecs, double endSecs) override;
+
+    void setDecodePriority(int priority) override;
+
+    bool setSplitWipeSource(const PathType& source) override;
+    void setSplitWipePosition(double position) override;
+
    private:
     class IOContext;
-    struct VideoParseContext;
+    struct Teardown;
+
+    struct VideoParseContext
+    {
+        bool initialized = false;
+        int numSkipped = 0;
+        AVFramePtr frame; // reused for every decoded picture
+        bool looping = false;
+        double loopOffset = 0;
+
+        int decodeQuality = -1; // as set on the codec context, none before the first packet
+        double reportStart = 0;
+        double reportDecodeTime = 0;
+        int reportFrames = 0;
+        int reportSkipped = 0;
+    };
+
+    struct AudioParseContext
+    {
+        bool initialized = false;
+        bool failed = false;
+        bool looping = false;
+        bool lapStarted = false;
+        std::vector<uint8_t> resampleBuffer;
+    };
 
     // Threads
     void parseRunnable();
     void audioParseRunnable();
     void videoParseRunnable();
+    void videoFilterRunnable();
     void displayRunnable();
+    void timeshiftRunnable();
+    void analysisRunnable(const std::string& url);
 
     void dispatchPacket(AVPacket& packet);
     void startAudioThread();
     void startVideoThread();
+    void startVideoFilterThread();
+    void startTimeshift();
+    void updateTimeshiftWindow();
+    int readPacket(AVPacket& packet);
+    bool isSeekPoint(const AVPacket& packet) const;
+    int readLoopPacket(AVPacket& packet);
+    bool cacheLoopPacket(AVPacket& packet);
+    void startLoopReplay();
+    void dispatchLoopMarker();
+    void handleLoopRangeChange();
+    bool isLoopStart(int64_t seekDuration) const;
+    bool isInLoopRange(double start, double end) const;
+    void startLoopLap(VideoParseContext& context);
+    static bool IsLoopMarker(const AVPacket& packet) { return packet.data == nullptr && packet.size == 0; }
     //void seek();
     bool resetDecoding(int64_t seekDuration, bool resetVideo);
     void fixDuration();
+    bool processAudioPacket(const AVPacket& packet, AudioParseContext& context);
     bool handleAudioPacket(
         const AVPacket& packet,
         std::vector<uint8_t>& resampleBuffer,
         bool failed);
+    bool writeAudio(uint8_t* write_data, int64_t write_size);
+    bool flushAudioBatch();
+    void countWakeup();
+    void recordSeekLatency();
+
+    bool isSeekRequested() const
+    {
+        return m_seekDuration != AV_NOPTS_VALUE || m_videoResetDuration != AV_NOPTS_VALUE;
+    }
+    void notifyParseThread();
     void setupAudioSwrContext(AVFrame* audioFrame);
     bool handleVideoPacket(
         const AVPacket& packet,
         double& videoClock,
         VideoParseContext& context);
+    bool handleIntraVideoPacket(
+        const AVPacket& packet,
+        double& videoClock,
+        VideoParseContext& context);
+    bool handleDecodedFrame(
+        AVFramePtr& frame,
+        double& videoClock,
+        VideoParseContext& context);
     bool handleVideoFrame(
         AVFramePtr& frame,
         double pts,
         VideoParseContext& context);
+    void reportDecodeLoad(VideoParseContext& context, bool skipped);
+    void applyDecodeQuality(VideoParseContext& context);
+    bool filterVideoFrame(
+        AVFramePtr& frame,
+        VideoParseContext& context);
+    bool receiveFilteredFrames(VideoParseContext& context);
+    void drainVideoFilter(VideoParseContext& context);
+    bool configureVideoFilter(const AVFrame* frame);
+    void freeVideoFilter();
 
     // IAudioPlayerCallback
     void AppendFrameClock(double frame_clock) override;
 
     void resetVariables();
+    void finishClosing();
+    void waitForClosed();
     void closeProcessing();
 
-    bool openDecoder(const PathType& file, const std::string& url, bool isFile);
+    struct ImageSequence
+    {
+        int startNumber;
+        AVRational frameRate;
+    };
+
+    bool openDecoder(const PathType& file, const std::string& url, bool isFile,
+        FILE* concatScript = nullptr, const ImageSequence* imageSequence = nullptr);
 
     bool resetVideoProcessing();
     bool setupAudioProcessing();
@@ -144,7 +256,7 @@ class FFmpegDecoder : public IFrameDecoder, public IAudioPlayerCallback
 
     void seekWhilePaused();
 
-    void handleDirect3dData(AVFrame* videoFrame);
+    void handleDirect3dData(AVFrame* videoFrame, bool allowDirect3dData);
 
     double GetHiResTime();
 
@@ -160,14 +272,19 @@ class FFmpegDecoder : public IFrameDecoder, public IAudioPlayerCallback
     std::unique_ptr<boost::thread> m_mainAudioThread;
     std::unique_ptr<boost::thread> m_mainParseThread;
     std::unique_ptr<boost::thread> m_mainDisplayThread;
+    std::unique_ptr<boost::thread> m_mainVideoFilterThread;
+    std::unique_ptr<boost::thread> m_timeshiftThread;
+    std::unique_ptr<boost::thread> m_analysisThread;
+    // Held while the thread objects are replaced, close() interrupts them from another thread
+    boost::mutex m_threadsMutex;
 
     // Synchronization
     boost::atomic<double> m_audioPTS;
 
-    // Real duration from video stream
-    int64_t m_startTime;
+    // Real duration from video stream. The start moves along with a timeshift window,
+    // the position is the presented video frame or the audio being played.
+    PositionSnapshot m_position;
     boost::atomic_int64_t m_currentTime;
-    int64_t m_duration;
 
     // Basic stuff
     AVFormatContext* m_formatContext;
@@ -186,6 +303,10 @@ class FFmpegDecoder : public IFrameDecoder, public IAudioPlayerCallback
     AVStream* m_videoStream;
     int m_videoStreamNumber;
 
+    // Set for software decoding of intra-only codecs, takes over from m_videoCodecContext
+    enum { INTRA_FRAME_BUDGET = 256 * 1024 * 1024 };
+    std::unique_ptr<IntraDecoderPool> m_intraDecoderPool;
+
     // Audio Stuff
     AVCodec* m_audioCodec;
     AVCodecContext* m_audioCodecContext;
@@ -207,6 +328,13 @@ class FFmpegDecoder : public IFrameDecoder, public IAudioPlayerCallback
     SwsContext* m_imageCovertContext;
     AVPixelFormat m_pixelFormat;
     bool m_allowDirect3dData;
+    boost::atomic_bool m_autoCrop;
+    CropDetector m_cropDetector;
+
+    // Guards the wipe against replacement while the display thread composes with it
+    boost::mutex m_splitWipeMutex;
+    std::unique_ptr<SplitWipe> m_splitWipe;
+    double m_splitWipePosition;
 
     // Video and audio queues
     enum
@@ -220,7 +348,79 @@ class FFmpegDecoder : public IFrameDecoder, public IAudioPlayerCallback
 
     VQueue m_videoFramesQueue;
 
+    // Live streams are recorded here so that they can be paused and rewound
+    enum { TIMESHIFT_CAPACITY = 512 * 1024 * 1024 };
+    std::unique_ptr<TimeshiftBuffer> m_timeshift;
+
+    // Recently read packets, parse thread only
+    PacketHistory m_packetHistory;
+
+    // Set when a file sequence is played as one timeline
+    std::unique_ptr<FileSequence> m_fileSequence;
+
+    // UTF-8 name of what is open, empty for sequences, which cannot be analyzed
+    std::string m_sourceUrl;
+    boost::mutex m_streamAnalysisMutex;
+    std::shared_ptr<const StreamAnalysis> m_streamAnalysis;
+
+    // A-B loop: the parse thread caches one lap and replays it after an in-band marker packet
+    enum LoopState { LOOP_IDLE, LOOP_CACHING, LOOP_CACHED, LOOP_REPLAYING, LOOP_TOO_LARGE };
+    LoopState m_loopState;
+    LoopCache m_loopCache;
+    double m_loopAudioStart;
+    double m_loopAudioEnd;
+
+    boost::atomic<double> m_loopStart;
+    boost::atomic<double> m_loopEnd;
+    boost::atomic<double> m_loopPeriod; // added to timestamps on every lap
+    boost::atomic_bool m_loopChanged;
+    boost::atomic<double> m_audioLoopOffset;
+
+    // Optional filter graph stage between decoding and conversion
+    enum { MAX_FILTER_FRAMES = 8 };
+    FrameQueue<MAX_FILTER_FRAMES> m_videoFilterQueue;
+
+    std::string m_videoFilterDescription; // user supplied, applied on open
+    std::string m_videoFilterGraphDescription; // effective one, empty if the stage is off
+
+    AVFilterGraph* m_videoFilterGraph;
+    AVFilterContext* m_videoFilterSource;
+    AVFilterContext* m_videoFilterSink;
+
+    struct VideoFilterInput
+    {
+        int width;
+        int height;
+        int format;
+        AVRational sampleAspectRatio;
+    };
+    VideoFilterInput m_videoFilterInput;
+    bool m_videoFilterFailed; // for m_videoFilterInput, retried on a geometry change or the next open
+
+    boost::atomic<double> m_videoFilterTime; // seconds spent inside the graph
+    boost::atomic_int64_t m_videoFilterFrames;
+
+    // Preemption shows up as frames presented too late and as the audio clock falling behind,
+    // which the audio thread corrects by moving the video start clock
+    boost::atomic_int m_lateFrames;
+    boost::atomic_int m_audioLateResyncs;
+
+    // Load and lag go to the process wide governor, the quality it assigns is applied before decoding
+    enum { GOVERNOR_REPORT_MS = 500 };
+    int m_governorId;
+    boost::atomic_int m_decodeQuality;
+    boost::atomic<double> m_videoDecodeTime; // seconds spent inside the codec
+
+    // From a seek request to the first frame presented after it, the last SEEK_LATENCY_SAMPLES kept
+    enum { SEEK_LATENCY_SAMPLES = 256 };
+    boost::atomic<double> m_seekRequestTime; // earliest unanswered request, 0 if none
+    boost::atomic_bool m_seekLatencyPending; // the seek is done, the next presented frame answers it
+    boost::mutex m_seekLatencyMutex;
+    std::vector<double> m_seekLatencies;
+    size_t m_seekLatencyCount;
+
     bool m_frameDisplayingRequested;
+    PrimitiveClock::time_point m_frameHandoffTime; // of the last frame queued, guarded by m_videoFramesMutex
 
     unsigned int m_generation;
 
@@ -238,10 +438,43 @@ class FFmpegDecoder : public IFrameDecoder, public IAudioPlayerCallback
     std::unique_ptr<IAudioPlayer> m_audioPlayer;
     bool m_audioPaused;
 
+    // Without video there is no display thread and the parse thread decodes audio as well
+    enum { AUDIO_BATCH_MS = 200 };
+    boost::atomic_bool m_audioOnly;
+    AudioParseContext m_audioOnlyContext;
+    std::vector<uint8_t> m_audioBatch;
+    boost::atomic_int64_t m_audioOnlyWakeups;
+    boost::atomic<double> m_audioOnlyCpuTime;
+    boost::atomic<double> m_audioOnlyCpuBase; // parse thread CPU time before playback
+    boost::atomic<double> m_audioOnlyStartTime;
+
+    // Cost of the audio path stage by stage against the sound it produced
+    boost::atomic<double> m_audioDecodeTime;
+    boost::atomic<double> m_audioResampleTime;
+    boost::atomic<double> m_audioMediaTime;
+    double m_audioPitchShiftBase; // audio player processing time when the file was opened
+
+    // The parse thread waits on it at the end of the stream
+    enum { EOF_WAIT_MS = 100 };
+    boost::mutex m_parseMutex;
+    boost::condition_variable m_parseCV;
+
     std::vector<int> m_audioIndices;
 
     std::unique_ptr<IOContext> m_ioCtx;
 
+    // Closing is finished there: threads joined first, then resources freed as a task of its own.
+    // Opening the next file waits for the threads only.
+    BackgroundReaper m_reaper;
+    boost::mutex m_closingMutex;
+    boost::condition_variable m_closingCV;
+    bool m_closing = false;
+    boost::atomic<double> m_closeTime; // seconds the last close() took to return
+    boost::atomic<double> m_windDownTime; // seconds its threads took to finish
+
+    ControlMonitor m_controlMonitor;
+
+    std::shared_ptr<ITimeSource> m_timeSource;
     boost::atomic<boost::chrono::high_resolution_clock::duration> m_referenceTime;
 
     boost::atomic<RationalNumber> m_speedRational; // Numerator, Denominator
@@ -0,0 +1,87 @@
+#include "filereader.h"
+
+#include "directfilereader.h"
+#include "uringfilereader.h"
+
+#ifdef _WIN32
+#include <share.h>
+#else
+#define _fseeki64 fseeko
+#define _ftelli64 ftello
+#endif
+
+namespace {
+
+class StdioFileReader : public FileReader
+{
+public:
+    explicit StdioFileReader(FILE* file) : m_file(file) {}
+    ~StdioFileReader() override { fclose(m_file); }
+
+    int read(uint8_t* buf, int size) override
+    {
+        const size_t length = fread(buf, 1, size, m_file);
+        if (length == 0 && ferror(m_file))
+        {
+            clearerr(m_file);
+            return -1;
+        }
+        return static_cast<int>(length);
+    }
+
+    int64_t seek(int64_t position) override
+    {
+        return (_fseeki64(m_file, position, SEEK_SET) == 0) ? _ftelli64(m_file) : -1;
+    }
+
+    int64_t tell() const override { return _ftelli64(m_file); }
+
+    int64_t size() const override
+    {
+        const auto current = _ftelli64(m_file);
+        if (_fseeki64(m_file, 0, SEEK_END) != 0)
+        {
+            return -1;
+        }
+        const int64_t result = _ftelli64(m_file);
+        _fseeki64(m_file, current, SEEK_SET);  // reset to the saved position
+        return result;
+    }
+
+private:
+    FILE* m_file;
+};
+
+} // namespace
+
+std::unique_ptr<FileReader> OpenFileReader(const PathType& path)
+{
+    if (auto direct = DirectFileReader::Open(path))
+    {
+        return direct;
+    }
+
+#ifdef USE_IO_URING
+    if (auto uring = UringFileReader::Open(path))
+    {
+        return uring;
+    }
+#endif
+
+    FILE* file =
+#ifdef _WIN32
+        _wfsopen(path.c_str(), L"rb", _SH_DENYNO);
+#else
+        fopen(path.c_str(), "rb");
+#endif
+    return WrapFileReader(file);
+}
+
+std::unique_ptr<FileReader> WrapFileReader(FILE* file)
+{
+    if (file == nullptr)
+    {
+        return nullptr;
+    }
+    return std::make_unique<StdioFileReader>(file);
+}
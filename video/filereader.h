@@ -0,0 +1,33 @@
+#pragma once
+
+#include "decoderinterface.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+// Byte source behind the custom AVIO context, the implementation is picked when the file is opened
+class FileReader
+{
+public:
+    virtual ~FileReader() = default;
+
+    // Up to size bytes from the current position, 0 at the end, negative on error.
+    // An error leaves the position as it was, so the read can be retried.
+    virtual int read(uint8_t* buf, int size) = 0;
+    // Absolute position, -1 if out of range
+    virtual int64_t seek(int64_t position) = 0;
+
+    virtual int64_t tell() const = 0;
+    virtual int64_t size() const = 0;
+
+    // Line for the decoder properties, empty if there is nothing to tell
+    virtual std::string describe() const { return std::string(); }
+};
+
+// Direct I/O for huge files, io_uring read-ahead where available, stdio otherwise; null on failure
+std::unique_ptr<FileReader> OpenFileReader(const PathType& path);
+
+// Takes ownership of the file
+std::unique_ptr<FileReader> WrapFileReader(FILE* file);
@@ -0,0 +1,223 @@
+#include "filesequence.h"
+
+#include "makeguard.h"
+#include "threadpolicy.h"
+#include "utf8.h"
+
+#include <boost/atomic.hpp>
+#include <boost/log/trivial.hpp>
+
+#include <algorithm>
+#include <string>
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+namespace {
+
+int InterruptionRequested(void* /*unused*/)
+{
+    return static_cast<int>(boost::this_thread::interruption_requested());
+}
+
+AVFormatContext* OpenSegment(const std::string& path, bool findStreamInfo)
+{
+    AVFormatContext* formatContext = avformat_alloc_context();
+    formatContext->interrupt_callback.callback = InterruptionRequested;
+    if (avformat_open_input(&formatContext, path.c_str(), nullptr, nullptr) != 0)
+    {
+        return nullptr;
+    }
+    if (findStreamInfo && avformat_find_stream_info(formatContext, nullptr) < 0)
+    {
+        avformat_close_input(&formatContext);
+    }
+    return formatContext;
+}
+
+// What the decoders are set up for, it has to stay the same across the timeline
+struct StreamFormat
+{
+    AVMediaType codecType;
+    AVCodecID codecId;
+    int format;
+    int width;
+    int height;
+    int sampleRate;
+    int channels;
+
+    bool operator==(const StreamFormat& other) const
+    {
+        return codecType == other.codecType && codecId == other.codecId && format == other.format
+            && width == other.width && height == other.height
+            && sampleRate == other.sampleRate && channels == other.channels;
+    }
+};
+
+bool IsComplete(const AVCodecParameters* codecpar)
+{
+    switch (codecpar->codec_type)
+    {
+    case AVMEDIA_TYPE_VIDEO:
+        return codecpar->width > 0 && codecpar->height > 0 && codecpar->format >= 0;
+    case AVMEDIA_TYPE_AUDIO:
+        return codecpar->sample_rate > 0 && codecpar->channels > 0 && codecpar->format >= 0;
+    default:
+        return true;
+    }
+}
+
+double ProbeSegment(const std::string& path, std::vector<StreamFormat>& streams)
+{
+    AVFormatContext* formatContext = OpenSegment(path, false);
+    if (formatContext == nullptr)
+    {
+        return -1;
+    }
+    auto formatContextGuard = MakeGuard(&formatContext, avformat_close_input);
+
+    // Most containers carry the duration and the stream parameters in the header, the rest need a look at the packets
+    bool complete = formatContext->duration != AV_NOPTS_VALUE;
+    for (unsigned int i = 0; complete && i < formatContext->nb_streams; ++i)
+    {
+        complete = IsComplete(formatContext->streams[i]->codecpar);
+    }
+    if (!complete && avformat_find_stream_info(formatContext, nullptr) < 0)
+    {
+        return -1;
+    }
+
+    streams.clear();
+    for (unsigned int i = 0; i < formatContext->nb_streams; ++i)
+    {
+        const AVCodecParameters* codecpar = formatContext->streams[i]->codecpar;
+        streams.push_back({ codecpar->codec_type, codecpar->codec_id, codecpar->format,
+            codecpar->width, codecpar->height, codecpar->sample_rate, codecpar->channels });
+    }
+
+    return (formatContext->duration != AV_NOPTS_VALUE)
+        ? formatContext->duration / static_cast<double>(AV_TIME_BASE) : -1;
+}
+
+// Brings the headers and the first packets of the next segment into the file cache, for the concat demuxer
+void PrefetchSegment(const std::string& path)
+{
+    ApplyThreadPolicy(THREAD_ROLE_BACKGROUND);
+    if (AVFormatContext* formatContext = OpenSegment(path, true))
+    {
+        avformat_close_input(&formatContext);
+    }
+}
+
+} // namespace
+
+FileSequence::~FileSequence()
+{
+    if (m_prefetchThread)
+    {
+        m_prefetchThread->interrupt();
+        m_prefetchThread->join();
+    }
+}
+
+bool FileSequence::init(const std::vector<PathType>& files)
+{
+    m_files = files;
+    m_durations.assign(files.size(), -1);
+    std::vector<std::vector<StreamFormat>> streams(files.size());
+
+    // Segments are probed side by side, opening is mostly waiting for the disk
+    boost::atomic<size_t> nextFile(0);
+    auto probe = [this, &nextFile, &streams] {
+        for (size_t i; (i = nextFile++) < m_files.size();)
+        {
+            m_durations[i] = ProbeSegment(ToUtf8(m_files[i]), streams[i]);
+        }
+    };
+
+    boost::thread_group probers;
+    const unsigned numThreads = std::min<unsigned>(
+        std::max(boost::thread::hardware_concurrency(), 1u), static_cast<unsigned>(files.size()));
+    for (unsigned i = 0; i < numThreads; ++i)
+    {
+        probers.create_thread(probe);
+    }
+    probers.join_all();
+
+    m_starts.assign(1, 0.);
+    for (size_t i = 0; i < m_files.size(); ++i)
+    {
+        if (m_durations[i] <= 0)
+        {
+            BOOST_LOG_TRIVIAL(error) << "Unable to get the duration of sequence segment " << i;
+            return false;
+        }
+        if (streams[i] != streams.front())
+        {
+            BOOST_LOG_TRIVIAL(info) << "Sequence segment " << i << " differs in streams from the first one";
+            return false;
+        }
+        m_starts.push_back(m_starts.back() + m_durations[i]);
+    }
+
+    m_prefetched = 0;
+    return !m_files.empty();
+}
+
+FILE* FileSequence::createScript() const
+{
+    FILE* script = tmpfile();
+    if (script == nullptr)
+    {
+        return nullptr;
+    }
+
+    fputs("ffconcat version 1.0\n", script);
+    for (size_t i = 0; i < m_files.size(); ++i)
+    {
+        // Single quotes are closed, escaped and reopened
+        std::string path;
+        for (char ch : ToUtf8(m_files[i]))
+        {
+            if (ch == '\'')
+            {
+                path += "'\\''";
+            }
+            else
+            {
+                path += ch;
+            }
+        }
+        // Known durations let the demuxer seek into any segment without opening the previous ones
+        fprintf(script, "file '%s'\nduration %.6f\n", path.c_str(), m_durations[i]);
+    }
+
+    fflush(script);
+    rewind(script);
+    return script;
+}
+
+void FileSequence::prefetch(double time)
+{
+    const auto it = std::upper_bound(m_starts.begin(), m_starts.end() - 1, time);
+    const size_t next = it - m_starts.begin();
+    if (next >= m_files.size() || next == m_prefetched || *it - time > PREFETCH_SECONDS)
+    {
+        return;
+    }
+
+    // Never hold the parse thread, a busy disk just means no prefetch this time
+    if (m_prefetchThread)
+    {
+        if (!m_prefetchThread->try_join_for(boost::chrono::milliseconds(0)))
+        {
+            return;
+        }
+        m_prefetchThread.reset();
+    }
+
+    m_prefetched = next;
+    m_prefetchThread = std::make_unique<boost::thread>(&PrefetchSegment, ToUtf8(m_files[next]));
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "decoderinterface.h"
+
+#include <boost/thread/thread.hpp>
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+// Chunked recordings played back as one continuous timeline through the concat demuxer
+class FileSequence
+{
+public:
+    enum { PREFETCH_SECONDS = 5 };
+
+    FileSequence() = default;
+    ~FileSequence();
+    FileSequence(const FileSequence&) = delete;
+    FileSequence& operator=(const FileSequence&) = delete;
+
+    // Probes segment durations, fails if any of the files cannot be opened or their streams differ in format
+    bool init(const std::vector<PathType>& files);
+
+    // ffconcat script in a temporary file, owned by the caller
+    FILE* createScript() const;
+
+    size_t size() const { return m_files.size(); }
+    double duration() const { return m_starts.empty() ? 0 : m_starts.back(); }
+
+    // Once the boundary is near, reads the headers and first packets of the segment following time in the
+    // background and throws them away. This only warms the OS file cache: the concat demuxer opens each
+    // segment itself and has no way to take over a format context opened elsewhere.
+    void prefetch(double time);
+
+private:
+    std::vector<PathType> m_files;
+    std::vector<double> m_durations;
+    std::vector<double> m_starts; // cumulative, one more than files
+
+    size_t m_prefetched = 0;
+    std::unique_ptr<boost::thread> m_prefetchThread;
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "primitivetimer.h"
+
 #include <boost/thread/thread.hpp>
 #include <deque>
 #include <type_traits>
@@ -15,6 +17,7 @@ public:
     template<typename T>
     bool push(const AVPacket& packet, T abortFunc)
     {
+        PrimitiveTimer timer(PRIMITIVE_PACKET_PUSH);
         bool wasEmpty;
         {
             boost::unique_lock<boost::mutex> locker(m_mutex);
@@ -25,6 +28,7 @@ public:
                     return false;
                 }
                 m_condVar.wait(locker);
+                timer.restart();
             }
             wasEmpty = m_queue.empty();
             enqueue(packet);
@@ -40,6 +44,7 @@ public:
     template<typename T = std::false_type>
     bool pop(AVPacket& packet, T abortFunc = T())
     {
+        PrimitiveTimer timer(PRIMITIVE_PACKET_POP);
         bool wasFull;
         {
             boost::unique_lock<boost::mutex> locker(m_mutex);
@@ -51,6 +56,7 @@ public:
                     return false;
                 }
                 m_condVar.wait(locker);
+                timer.restart();
             }
 
             wasFull = isPacketsQueueFull();
@@ -0,0 +1,180 @@
+#include "framebufferpool.h"
+
+#include <cstdint>
+
+extern "C"
+{
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+namespace {
+
+void FreeAligned(void* opaque, uint8_t* /*data*/)
+{
+    av_free(opaque);
+}
+
+// av_malloc() only guarantees what the build of libavutil was configured for
+AVBufferRef* AllocAligned(int size)
+{
+    auto* memory = static_cast<uint8_t*>(av_malloc(size + FrameBufferPool::ALIGNMENT));
+    if (memory == nullptr)
+    {
+        return nullptr;
+    }
+
+    auto* aligned = reinterpret_cast<uint8_t*>(
+        (reinterpret_cast<uintptr_t>(memory) + FrameBufferPool::ALIGNMENT - 1)
+            & ~uintptr_t(FrameBufferPool::ALIGNMENT - 1));
+
+    AVBufferRef* buffer = av_buffer_create(aligned, size, FreeAligned, memory, 0);
+    if (buffer == nullptr)
+    {
+        av_free(memory);
+    }
+    return buffer;
+}
+
+} // namespace
+
+FrameBufferPool::~FrameBufferPool()
+{
+    uninit();
+}
+
+bool FrameBufferPool::Attach(AVCodecContext* codecContext, const AVCodec* codec)
+{
+    if ((codec->capabilities & AV_CODEC_CAP_DR1) == 0
+        || codecContext->opaque != nullptr)
+    {
+        return false;
+    }
+
+    codecContext->opaque = new FrameBufferPool();
+    codecContext->get_buffer2 = GetBuffer2;
+    codecContext->thread_safe_callbacks = 1;
+    return true;
+}
+
+FrameBufferPool* FrameBufferPool::Get(AVCodecContext* codecContext)
+{
+    return (codecContext->get_buffer2 == GetBuffer2)
+        ? static_cast<FrameBufferPool*>(codecContext->opaque) : nullptr;
+}
+
+void FrameBufferPool::Release(AVCodecContext* codecContext)
+{
+    if (auto pool = Get(codecContext))
+    {
+        avcodec_close(codecContext);
+        delete pool;
+        codecContext->opaque = nullptr;
+    }
+}
+
+int FrameBufferPool::GetBuffer2(AVCodecContext* codecContext, AVFrame* frame, int flags)
+{
+    auto* pool = static_cast<FrameBufferPool*>(codecContext->opaque);
+    if (codecContext->codec_type == AVMEDIA_TYPE_VIDEO && pool->getBuffer(codecContext, frame) >= 0)
+    {
+        return 0;
+    }
+
+    return avcodec_default_get_buffer2(codecContext, frame, flags);
+}
+
+int FrameBufferPool::getBuffer(AVCodecContext* codecContext, AVFrame* frame)
+{
+    boost::lock_guard<boost::mutex> locker(m_mutex);
+
+    if ((frame->width != m_width || frame->height != m_height || frame->format != m_format)
+        && !configure(codecContext, frame))
+    {
+        return AVERROR(EINVAL);
+    }
+
+    for (int i = 0; i < AV_NUM_DATA_POINTERS && m_pools[i] != nullptr; ++i)
+    {
+        frame->buf[i] = av_buffer_pool_get(m_pools[i]);
+        if (frame->buf[i] == nullptr)
+        {
+            av_frame_unref(frame);
+            return AVERROR(ENOMEM);
+        }
+        frame->data[i] = frame->buf[i]->data;
+        frame->linesize[i] = m_linesize[i];
+    }
+    frame->extended_data = frame->data;
+
+    return 0;
+}
+
+bool FrameBufferPool::configure(AVCodecContext* codecContext, const AVFrame* frame)
+{
+    uninit();
+
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+    if (desc == nullptr
+        || (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM)) != 0)
+    {
+        return false;
+    }
+
+    // Padding the codec needs for its own SIMD and edge emulation
+    int width = frame->width;
+    int height = frame->height;
+    int linesizeAlign[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(codecContext, &width, &height, linesizeAlign);
+
+    if (av_image_fill_linesizes(m_linesize, static_cast<AVPixelFormat>(frame->format), width) < 0)
+    {
+        return false;
+    }
+    for (auto& linesize : m_linesize)
+    {
+        linesize = FFALIGN(linesize, ALIGNMENT);
+    }
+
+    uint8_t* data[4] = {};
+    const int totalSize = av_image_fill_pointers(
+        data, static_cast<AVPixelFormat>(frame->format), height, nullptr, m_linesize);
+    if (totalSize < 0)
+    {
+        return false;
+    }
+
+    const int numPlanes = av_pix_fmt_count_planes(static_cast<AVPixelFormat>(frame->format));
+    for (int i = 0; i < numPlanes; ++i)
+    {
+        const int planeSize = (i + 1 < numPlanes)
+            ? static_cast<int>(data[i + 1] - data[i])
+            : totalSize - static_cast<int>(data[i] - data[0]);
+
+        // Extra line plus slack: some decoders write one block past the bottom edge
+        m_pools[i] = av_buffer_pool_init(planeSize + m_linesize[i] + ALIGNMENT, AllocAligned);
+        if (m_pools[i] == nullptr)
+        {
+            uninit();
+            return false;
+        }
+    }
+
+    m_width = frame->width;
+    m_height = frame->height;
+    m_format = frame->format;
+
+    return true;
+}
+
+void FrameBufferPool::uninit()
+{
+    // Buffers still referenced by frames keep their pool alive until released
+    for (auto& pool : m_pools)
+    {
+        av_buffer_pool_uninit(&pool);
+    }
+    m_width = 0;
+    m_height = 0;
+    m_format = -1;
+}
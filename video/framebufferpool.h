@@ -0,0 +1,43 @@
+#pragma once
+
+#include <boost/thread/mutex.hpp>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+// Decoder output buffers with aligned, padded planes, recycled between frames
+class FrameBufferPool
+{
+public:
+    enum { ALIGNMENT = 64 };
+
+    FrameBufferPool() = default;
+    ~FrameBufferPool();
+    FrameBufferPool(const FrameBufferPool&) = delete;
+    FrameBufferPool& operator=(const FrameBufferPool&) = delete;
+
+    // Installs the pool into a software decoder context that supports direct rendering
+    static bool Attach(AVCodecContext* codecContext, const AVCodec* codec);
+    // Returns the pool owned by the context, if any
+    static FrameBufferPool* Get(AVCodecContext* codecContext);
+    // Closes the codec, whose frame threads may still take buffers, then frees the pool if there is one
+    static void Release(AVCodecContext* codecContext);
+
+private:
+    static int GetBuffer2(AVCodecContext* codecContext, AVFrame* frame, int flags);
+
+    int getBuffer(AVCodecContext* codecContext, AVFrame* frame);
+    bool configure(AVCodecContext* codecContext, const AVFrame* frame);
+    void uninit();
+
+    boost::mutex m_mutex;
+
+    int m_width = 0;
+    int m_height = 0;
+    int m_format = -1;
+
+    int m_linesize[AV_NUM_DATA_POINTERS] = {};
+    AVBufferPool* m_pools[AV_NUM_DATA_POINTERS] = {};
+};
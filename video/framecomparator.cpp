@@ -0,0 +1,572 @@
+#include "framecomparator.h"
+
+#include "makeguard.h"
+
+#include <boost/log/trivial.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+
+#include <emmintrin.h>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+namespace {
+
+const __m128i* AsM128(const uint8_t* p) { return reinterpret_cast<const __m128i*>(p); }
+
+inline int HorizontalSum(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+int64_t RowSquaredError(const uint8_t* reference, const uint8_t* distorted, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+
+    int i = 0;
+    for (; i + 16 <= width; i += 16)
+    {
+        const __m128i x = _mm_loadu_si128(AsM128(reference + i));
+        const __m128i y = _mm_loadu_si128(AsM128(distorted + i));
+        const __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(x, zero), _mm_unpacklo_epi8(y, zero));
+        const __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(x, zero), _mm_unpackhi_epi8(y, zero));
+        acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+    }
+
+    // Fits: a row of 8K pixels at most adds up to 8192 * 255^2
+    int64_t result = static_cast<unsigned>(HorizontalSum(acc));
+    for (; i < width; ++i)
+    {
+        const int diff = reference[i] - distorted[i];
+        result += diff * diff;
+    }
+    return result;
+}
+
+double SsimOf8x8(const uint8_t* reference, int referenceStride,
+    const uint8_t* distorted, int distortedStride)
+{
+    const double C1 = 0.01 * 255 * 0.01 * 255;
+    const double C2 = 0.03 * 255 * 0.03 * 255;
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i sumX = _mm_setzero_si128();
+    __m128i sumY = _mm_setzero_si128();
+    __m128i sumXX = _mm_setzero_si128();
+    __m128i sumYY = _mm_setzero_si128();
+    __m128i sumXY = _mm_setzero_si128();
+
+    for (int row = 0; row < 8; ++row)
+    {
+        const __m128i x = _mm_unpacklo_epi8(_mm_loadl_epi64(AsM128(reference + row * referenceStride)), zero);
+        const __m128i y = _mm_unpacklo_epi8(_mm_loadl_epi64(AsM128(distorted + row * distortedStride)), zero);
+        sumX = _mm_add_epi32(sumX, _mm_madd_epi16(x, ones));
+        sumY = _mm_add_epi32(sumY, _mm_madd_epi16(y, ones));
+        sumXX = _mm_add_epi32(sumXX, _mm_madd_epi16(x, x));
+        sumYY = _mm_add_epi32(sumYY, _mm_madd_epi16(y, y));
+        sumXY = _mm_add_epi32(sumXY, _mm_madd_epi16(x, y));
+    }
+
+    const double n = 64;
+    const double meanX = HorizontalSum(sumX) / n;
+    const double meanY = HorizontalSum(sumY) / n;
+    const double varianceX = HorizontalSum(sumXX) / n - meanX * meanX;
+    const double varianceY = HorizontalSum(sumYY) / n - meanY * meanY;
+    const double covariance = HorizontalSum(sumXY) / n - meanX * meanY;
+
+    return (2 * meanX * meanY + C1) * (2 * covariance + C2)
+        / ((meanX * meanX + meanY * meanY + C1) * (varianceX + varianceY + C2));
+}
+
+} // namespace
+
+// static
+double FrameComparator::Psnr(const uint8_t* reference, int referenceStride,
+    const uint8_t* distorted, int distortedStride, int width, int height)
+{
+    int64_t squaredError = 0;
+    for (int row = 0; row < height; ++row)
+    {
+        squaredError += RowSquaredError(
+            reference + row * referenceStride, distorted + row * distortedStride, width);
+    }
+    if (squaredError == 0)
+    {
+        return MAX_PSNR;
+    }
+    const double meanSquaredError = double(squaredError) / (double(width) * height);
+    return std::min<double>(MAX_PSNR, 10 * log10(255. * 255. / meanSquaredError));
+}
+
+// static
+double FrameComparator::BlockSsim(const uint8_t* reference, int referenceStride,
+    const uint8_t* distorted, int distortedStride, int width, int height)
+{
+    double sum = 0;
+    int numBlocks = 0;
+    for (int y = 0; y + 8 <= height; y += 8)
+    {
+        for (int x = 0; x + 8 <= width; x += 8)
+        {
+            sum += SsimOf8x8(reference + y * referenceStride + x, referenceStride,
+                distorted + y * distortedStride + x, distortedStride);
+            ++numBlocks;
+        }
+    }
+    return (numBlocks > 0) ? sum / numBlocks : 1.;
+}
+
+bool ComparisonSource::open(const std::string& url)
+{
+    if (avformat_open_input(&formatContext, url.c_str(), nullptr, nullptr) != 0
+        || avformat_find_stream_info(formatContext, nullptr) < 0)
+    {
+        BOOST_LOG_TRIVIAL(error) << "Unable to open comparison source " << url;
+        return false;
+    }
+
+    AVCodec* codec = nullptr;
+    streamIndex = av_find_best_stream(formatContext, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (streamIndex < 0 || codec == nullptr)
+    {
+        BOOST_LOG_TRIVIAL(error) << "No video in comparison source " << url;
+        return false;
+    }
+
+    const AVStream* stream = formatContext->streams[streamIndex];
+    codecContext = avcodec_alloc_context3(codec);
+    if (codecContext == nullptr
+        || avcodec_parameters_to_context(codecContext, stream->codecpar) < 0)
+    {
+        return false;
+    }
+
+    // Faster than real time is the point, let the codec use every core
+    codecContext->thread_count = 0;
+    if (avcodec_open2(codecContext, codec, nullptr) < 0)
+    {
+        return false;
+    }
+
+    timeBase = av_q2d(stream->time_base);
+    startTime = (stream->start_time != AV_NOPTS_VALUE) ? stream->start_time * timeBase : 0;
+    frame.reset(av_frame_alloc());
+    eof = false;
+    return true;
+}
+
+void ComparisonSource::close()
+{
+    avcodec_free_context(&codecContext);
+    avformat_close_input(&formatContext);
+    frame.reset();
+    streamIndex = -1;
+}
+
+bool ComparisonSource::decodeNext()
+{
+    while (!eof)
+    {
+        const int ret = avcodec_receive_frame(codecContext, frame.get());
+        if (ret == 0)
+        {
+            const int64_t stamp = frame->best_effort_timestamp;
+            time = (stamp != AV_NOPTS_VALUE)
+                ? stamp * timeBase - startTime
+                : time + av_q2d(codecContext->framerate.num != 0
+                    ? av_inv_q(codecContext->framerate) : AVRational{ 1, 25 });
+            return true;
+        }
+        if (ret == AVERROR_EOF)
+        {
+            eof = true;
+            break;
+        }
+
+        AVPacket packet;
+        if (av_read_frame(formatContext, &packet) < 0)
+        {
+            avcodec_send_packet(codecContext, nullptr); // drain
+            continue;
+        }
+        auto packetGuard = MakeGuard(&packet, av_packet_unref);
+        if (packet.stream_index == streamIndex)
+        {
+            avcodec_send_packet(codecContext, &packet);
+        }
+    }
+    return false;
+}
+
+bool ComparisonSource::seek(double seconds)
+{
+    const int64_t timestamp = static_cast<int64_t>((seconds + startTime) / timeBase);
+    if (av_seek_frame(formatContext, streamIndex, timestamp, AVSEEK_FLAG_BACKWARD) < 0)
+    {
+        return false;
+    }
+    avcodec_flush_buffers(codecContext);
+    av_frame_unref(frame.get());
+    time = seconds;
+    eof = false;
+    return true;
+}
+
+bool FrameComparator::open(const std::string& reference, const std::string& distorted)
+{
+    close();
+
+#if ( LIBAVFORMAT_VERSION_INT <= AV_VERSION_INT(58,9,100) )
+    avcodec_register_all();
+    av_register_all();
+#endif
+
+    if (!m_reference.open(reference) || !m_distorted.open(distorted))
+    {
+        close();
+        return false;
+    }
+
+    const AVStream* stream = m_reference.formatContext->streams[m_reference.streamIndex];
+    const double frameRate = (stream->avg_frame_rate.num != 0) ? av_q2d(stream->avg_frame_rate) : 25.;
+    m_tolerance = 0.5 / frameRate;
+
+    m_width = m_reference.codecContext->width;
+    m_height = m_reference.codecContext->height;
+    return m_width > 0 && m_height > 0;
+}
+
+void FrameComparator::close()
+{
+    m_reference.close();
+    m_distorted.close();
+    sws_freeContext(m_referenceConvert);
+    m_referenceConvert = nullptr;
+    sws_freeContext(m_distortedConvert);
+    m_distortedConvert = nullptr;
+}
+
+bool FrameComparator::toLuma(const AVFrame* frame, SwsContext*& convertContext, std::vector<uint8_t>& luma)
+{
+    // Both sources end up as 8 bit luma at the reference size, so differing encodes still line up
+    convertContext = sws_getCachedContext(convertContext,
+        frame->width, frame->height, static_cast<AVPixelFormat>(frame->format),
+        m_width, m_height, AV_PIX_FMT_GRAY8, SWS_BICUBIC, nullptr, nullptr, nullptr);
+    if (convertContext == nullptr)
+    {
+        return false;
+    }
+
+    luma.resize(size_t(m_width) * m_height);
+    uint8_t* data[4] = { luma.data() };
+    int linesize[4] = { m_width };
+    return sws_scale(convertContext, frame->data, frame->linesize, 0, frame->height, data, linesize) > 0;
+}
+
+bool FrameComparator::nextPair(FramePair& pair)
+{
+    while (m_reference.decodeNext())
+    {
+        // One clock for both: the distorted source catches up with the reference, never the other way
+        while (m_distorted.time < m_reference.time - m_tolerance || !m_distorted.frame->buf[0])
+        {
+            if (!m_distorted.decodeNext())
+            {
+                return false;
+            }
+        }
+
+        if (m_distorted.time > m_reference.time + m_tolerance)
+        {
+            continue; // dropped in the distorted encode
+        }
+
+        pair.time = m_reference.time;
+        if (!toLuma(m_reference.frame.get(), m_referenceConvert, pair.reference)
+            || !toLuma(m_distorted.frame.get(), m_distortedConvert, pair.distorted))
+        {
+            return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+bool FrameComparator::next(FrameMetrics& metrics)
+{
+    FramePair pair;
+    if (!nextPair(pair))
+    {
+        return false;
+    }
+
+    metrics.time = pair.time;
+    metrics.psnr = Psnr(pair.reference.data(), m_width, pair.distorted.data(), m_width, m_width, m_height);
+    metrics.blockSsim = BlockSsim(pair.reference.data(), m_width, pair.distorted.data(), m_width, m_width, m_height);
+    return true;
+}
+
+bool FrameComparator::writeCsv(const PathType& csvFile)
+{
+    FILE* out =
+#ifdef _WIN32
+        _wfopen(csvFile.c_str(), L"w");
+#else
+        fopen(csvFile.c_str(), "w");
+#endif
+    if (out == nullptr)
+    {
+        return false;
+    }
+    auto fileGuard = MakeGuard(out, fclose);
+
+    fputs("time,psnr_y,block_ssim_8x8_y\n", out);
+
+    enum { MAX_PENDING_PAIRS = 4 };
+
+    boost::mutex mutex;
+    boost::condition_variable condVar;
+    std::deque<FramePair> pending;
+    bool finished = false;
+
+    // Decoding goes on here while the previous pairs are measured
+    boost::thread worker([&] {
+        for (;;)
+        {
+            FramePair pair;
+            {
+                boost::unique_lock<boost::mutex> locker(mutex);
+                condVar.wait(locker, [&] { return !pending.empty() || finished; });
+                if (pending.empty())
+                {
+                    return;
+                }
+                pair = std::move(pending.front());
+                pending.pop_front();
+            }
+            condVar.notify_all();
+
+            fprintf(out, "%.6f,%.4f,%.6f\n", pair.time,
+                Psnr(pair.reference.data(), m_width, pair.distorted.data(), m_width, m_width, m_height),
+                BlockSsim(pair.reference.data(), m_width, pair.distorted.data(), m_width, m_width, m_height));
+        }
+    });
+
+    for (FramePair pair; nextPair(pair);)
+    {
+        boost::unique_lock<boost::mutex> locker(mutex);
+        condVar.wait(locker, [&] { return pending.size() < MAX_PENDING_PAIRS; });
+        pending.push_back(std::move(pair));
+        condVar.notify_all();
+    }
+
+    {
+        boost::lock_guard<boost::mutex> locker(mutex);
+        finished = true;
+    }
+    condVar.notify_all();
+    worker.join();
+
+    return ferror(out) == 0;
+}
+
+bool SplitWipe::open(const std::string& url)
+{
+    close();
+
+    if (!m_source.open(url))
+    {
+        m_source.close();
+        return false;
+    }
+
+    const AVStream* stream = m_source.formatContext->streams[m_source.streamIndex];
+    const double frameRate = (stream->avg_frame_rate.num != 0) ? av_q2d(stream->avg_frame_rate) : 25.;
+    m_tolerance = 0.5 / frameRate;
+
+    m_closing = false;
+    m_format = -1;
+    m_time = 0;
+    m_seekTime = -1;
+    m_thread = std::make_unique<boost::thread>(&SplitWipe::run, this);
+    return true;
+}
+
+void SplitWipe::close()
+{
+    if (m_thread)
+    {
+        {
+            boost::lock_guard<boost::mutex> locker(m_mutex);
+            m_closing = true;
+        }
+        m_condVar.notify_all();
+        m_thread->join();
+        m_thread.reset();
+    }
+
+    m_source.close();
+    sws_freeContext(m_convertContext);
+    m_convertContext = nullptr;
+    m_frames.clear();
+    m_current.image.reset();
+    m_composed.free();
+}
+
+void SplitWipe::setPosition(double position)
+{
+    boost::lock_guard<boost::mutex> locker(m_mutex);
+    m_position = std::min(std::max(position, 0.), 1.);
+}
+
+void SplitWipe::run()
+{
+    for (;;)
+    {
+        double seekTime;
+        double presentedTime;
+        int format;
+        int width;
+        int height;
+        unsigned int generation;
+        {
+            boost::unique_lock<boost::mutex> locker(m_mutex);
+            m_condVar.wait(locker, [this] {
+                return m_closing || m_seekTime >= 0
+                    || m_format >= 0 && m_frames.size() < MAX_AHEAD && !m_source.eof;
+            });
+            if (m_closing)
+            {
+                return;
+            }
+            seekTime = m_seekTime;
+            m_seekTime = -1;
+            presentedTime = m_time;
+            format = m_format;
+            width = m_width;
+            height = m_height;
+            generation = m_generation;
+        }
+
+        if (seekTime >= 0)
+        {
+            m_source.seek(seekTime);
+            continue;
+        }
+
+        // Frames already passed are not worth converting, the source catches up
+        if (!m_source.decodeNext() || m_source.time < presentedTime - m_tolerance)
+        {
+            continue;
+        }
+
+        const AVFrame* decoded = m_source.frame.get();
+        m_convertContext = sws_getCachedContext(m_convertContext,
+            decoded->width, decoded->height, static_cast<AVPixelFormat>(decoded->format),
+            width, height, static_cast<AVPixelFormat>(format), SWS_BICUBIC, nullptr, nullptr, nullptr);
+        if (m_convertContext == nullptr)
+        {
+            continue;
+        }
+
+        ConvertedFrame converted{ m_source.time, AVFramePtr(av_frame_alloc()) };
+        converted.image->format = format;
+        converted.image->width = width;
+        converted.image->height = height;
+        if (av_frame_get_buffer(converted.image.get(), 64) < 0
+            || sws_scale(m_convertContext, decoded->data, decoded->linesize, 0, decoded->height,
+                converted.image->data, converted.image->linesize) <= 0)
+        {
+            continue;
+        }
+
+        boost::lock_guard<boost::mutex> locker(m_mutex);
+        if (generation == m_generation)
+        {
+            m_frames.push_back(std::move(converted));
+        }
+    }
+}
+
+AVFrame* SplitWipe::compose(const AVFrame* frame, double time)
+{
+    const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+    if (descriptor == nullptr
+        || (descriptor->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM)))
+    {
+        return nullptr;
+    }
+
+    double position;
+    {
+        boost::lock_guard<boost::mutex> locker(m_mutex);
+        const bool formatChanged = frame->format != m_format
+            || frame->width != m_width || frame->height != m_height;
+        // Seeks and loops of the presented source are followed, playback speed is not a concern
+        if (formatChanged || time < m_time - m_tolerance || time > m_time + SEEK_DISTANCE)
+        {
+            m_format = frame->format;
+            m_width = frame->width;
+            m_height = frame->height;
+            m_seekTime = std::max(time, 0.);
+            m_frames.clear();
+            ++m_generation;
+            m_current.image.reset();
+        }
+        m_time = time;
+
+        // The latest frame due, it stays up until the next one is
+        while (!m_frames.empty() && m_frames.front().time <= time + m_tolerance)
+        {
+            m_current = std::move(m_frames.front());
+            m_frames.pop_front();
+        }
+        position = m_position;
+    }
+    m_condVar.notify_all();
+
+    if (!m_current.image)
+    {
+        return nullptr;
+    }
+
+    m_composed.realloc(static_cast<AVPixelFormat>(frame->format), frame->width, frame->height);
+    AVFrame* composed = m_composed.m_image.get();
+    const AVFrame* wipe = m_current.image.get();
+
+    int rowSizes[4] = {};
+    av_image_fill_linesizes(rowSizes, static_cast<AVPixelFormat>(frame->format), frame->width);
+    const int split = static_cast<int>(position * frame->width) & ~1; // chroma pairs stay whole
+    for (int plane = 0; plane < av_pix_fmt_count_planes(static_cast<AVPixelFormat>(frame->format)); ++plane)
+    {
+        const int rows = (plane == 1 || plane == 2)
+            ? AV_CEIL_RSHIFT(frame->height, descriptor->log2_chroma_h) : frame->height;
+        const int rowSize = rowSizes[plane];
+        const int splitSize = static_cast<int>(int64_t(rowSize) * split / frame->width);
+        for (int row = 0; row < rows; ++row)
+        {
+            uint8_t* target = composed->data[plane] + row * composed->linesize[plane];
+            memcpy(target, frame->data[plane] + row * frame->linesize[plane], splitSize);
+            memcpy(target + splitSize, wipe->data[plane] + row * wipe->linesize[plane] + splitSize,
+                rowSize - splitSize);
+        }
+    }
+    composed->sample_aspect_ratio = frame->sample_aspect_ratio;
+    return composed;
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "decoderinterface.h"
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+#include "videoframe.h"
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct AVFormatContext;
+struct AVCodecContext;
+struct SwsContext;
+
+// Luma quality of one distorted frame against the reference frame shown at the same time
+struct FrameMetrics
+{
+    double time;        // seconds from the start of the reference
+    double psnr;        // dB, capped for identical frames
+    double blockSsim;   // SSIM of non-overlapping 8x8 blocks, averaged; not the Gaussian windowed SSIM
+};
+
+// Video stream of a file or URL decoded frame by frame
+struct ComparisonSource
+{
+    AVFormatContext* formatContext = nullptr;
+    AVCodecContext* codecContext = nullptr;
+    int streamIndex = -1;
+    double timeBase = 0;
+    double startTime = 0;
+    AVFramePtr frame;
+    double time = 0; // seconds from the start of the stream
+    bool eof = false;
+
+    bool open(const std::string& url);
+    void close();
+    bool decodeNext();
+    // To the keyframe at or before seconds from the start
+    bool seek(double seconds);
+};
+
+// Decodes a reference and a distorted source in lockstep by pts, as fast as decoding allows
+class FrameComparator
+{
+public:
+    enum { MAX_PSNR = 100 };
+
+    FrameComparator() = default;
+    ~FrameComparator() { close(); }
+    FrameComparator(const FrameComparator&) = delete;
+    FrameComparator& operator=(const FrameComparator&) = delete;
+
+    // UTF-8 file names or URLs
+    bool open(const std::string& reference, const std::string& distorted);
+    void close();
+
+    // Metrics of the next reference frame that has a distorted counterpart, false at the end
+    bool next(FrameMetrics& metrics);
+
+    // Compares everything into a "time,psnr_y,block_ssim_8x8_y" CSV, metrics are computed on a worker thread
+    bool writeCsv(const PathType& csvFile);
+
+    // Luma planes of equal size
+    static double Psnr(const uint8_t* reference, int referenceStride,
+        const uint8_t* distorted, int distortedStride, int width, int height);
+    static double BlockSsim(const uint8_t* reference, int referenceStride,
+        const uint8_t* distorted, int distortedStride, int width, int height);
+
+private:
+    // Luma planes of a matched frame pair, scaled to the reference size
+    struct FramePair
+    {
+        double time;
+        std::vector<uint8_t> reference;
+        std::vector<uint8_t> distorted;
+    };
+
+    bool nextPair(FramePair& pair);
+    bool toLuma(const AVFrame* frame, SwsContext*& convertContext, std::vector<uint8_t>& luma);
+
+    ComparisonSource m_reference;
+    ComparisonSource m_distorted;
+    double m_tolerance = 0; // half a reference frame
+
+    int m_width = 0;
+    int m_height = 0;
+    SwsContext* m_referenceConvert = nullptr;
+    SwsContext* m_distortedConvert = nullptr;
+};
+
+// Second source of a split wipe, shown right of the wipe in place of the frames presented. It follows
+// their presentation time, decoding ahead and converting to their format on a worker thread of its own.
+class SplitWipe
+{
+public:
+    SplitWipe() = default;
+    ~SplitWipe() { close(); }
+    SplitWipe(const SplitWipe&) = delete;
+    SplitWipe& operator=(const SplitWipe&) = delete;
+
+    // UTF-8 file name or URL
+    bool open(const std::string& url);
+    void close();
+
+    // 0 to 1, the left edge of the second source
+    void setPosition(double position);
+
+    // A copy of frame with the second source at time right of the wipe, valid until the next call.
+    // Null if there is nothing to show for the time, then frame is presented as it is.
+    AVFrame* compose(const AVFrame* frame, double time);
+
+private:
+    enum { MAX_AHEAD = 4 };
+    // Further ahead the second source seeks rather than decodes its way there
+    enum { SEEK_DISTANCE = 2 };
+
+    struct ConvertedFrame
+    {
+        double time;
+        AVFramePtr image;
+    };
+
+    void run();
+
+    ComparisonSource m_source;
+    SwsContext* m_convertContext = nullptr; // worker thread only
+    double m_tolerance = 0; // half a frame of the second source
+
+    boost::mutex m_mutex;
+    boost::condition_variable m_condVar;
+    std::deque<ConvertedFrame> m_frames; // ahead of the presented time
+    ConvertedFrame m_current{}; // shown, display thread only
+    int m_format = -1; // of the presented frames
+    int m_width = 0;
+    int m_height = 0;
+    double m_time = 0; // presented last
+    double m_seekTime = -1; // set when the presented time left what is decoded
+    unsigned int m_generation = 0; // of the frames, counts seeks
+    double m_position = 0.5;
+    bool m_closing = false;
+    std::unique_ptr<boost::thread> m_thread;
+
+    VideoFrame m_composed;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "videoframe.h"
+
+#include <boost/thread/thread.hpp>
+#include <deque>
+#include <type_traits>
+#include <utility>
+
+// Bounded queue of decoded frames passed between pipeline stages
+template<size_t MAX_FRAMES>
+class FrameQueue
+{
+public:
+    FrameQueue() {}
+    FrameQueue(const FrameQueue&) = delete;
+    FrameQueue& operator=(const FrameQueue&) = delete;
+
+    template<typename T>
+    bool push(AVFramePtr& frame, T abortFunc)
+    {
+        bool wasEmpty;
+        {
+            boost::unique_lock<boost::mutex> locker(m_mutex);
+            while (m_queue.size() >= MAX_FRAMES)
+            {
+                if (abortFunc())
+                {
+                    return false;
+                }
+                m_condVar.wait(locker);
+            }
+            wasEmpty = m_queue.empty();
+            m_queue.push_back(std::move(frame));
+        }
+        if (wasEmpty)
+        {
+            m_condVar.notify_all();
+        }
+
+        return true;
+    }
+
+    template<typename T = std::false_type>
+    bool pop(AVFramePtr& frame, T abortFunc = T())
+    {
+        bool wasFull;
+        {
+            boost::unique_lock<boost::mutex> locker(m_mutex);
+
+            while (m_queue.empty())
+            {
+                if (abortFunc())
+                {
+                    return false;
+                }
+                m_condVar.wait(locker);
+            }
+
+            wasFull = m_queue.size() >= MAX_FRAMES;
+            frame = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        if (wasFull)
+        {
+            m_condVar.notify_all();
+        }
+
+        return true;
+    }
+
+    void clear()
+    {
+        std::deque<AVFramePtr>().swap(m_queue);
+    }
+
+    bool empty()
+    {
+        boost::lock_guard<boost::mutex> locker(m_mutex);
+        return m_queue.empty();
+    }
+
+    void notify()
+    {
+        m_condVar.notify_all();
+    }
+
+private:
+    std::deque<AVFramePtr> m_queue;
+
+    boost::mutex m_mutex;
+    boost::condition_variable m_condVar;
+};
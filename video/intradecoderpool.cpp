@@ -0,0 +1,215 @@
+#include "intradecoderpool.h"
+
+#include "framebufferpool.h"
+#include "makeguard.h"
+#include "threadpolicy.h"
+
+#include <boost/log/trivial.hpp>
+
+#include <algorithm>
+#include <functional>
+
+extern "C"
+{
+#include <libavutil/imgutils.h>
+}
+
+// static
+bool IntraDecoderPool::IsIntraOnly(const AVCodecParameters* codecpar)
+{
+    const AVCodecDescriptor* descriptor = avcodec_descriptor_get(codecpar->codec_id);
+    return descriptor != nullptr && (descriptor->props & AV_CODEC_PROP_INTRA_ONLY) != 0;
+}
+
+bool IntraDecoderPool::open(const AVCodecParameters* codecpar, unsigned numWorkers, size_t frameBudget)
+{
+    close();
+
+    int frameSize = av_image_get_buffer_size(static_cast<AVPixelFormat>(codecpar->format),
+        codecpar->width, codecpar->height, FrameBufferPool::ALIGNMENT);
+    if (frameSize <= 0)
+    {
+        frameSize = codecpar->width * codecpar->height * 4;
+    }
+    m_maxInFlight = std::min<size_t>(numWorkers * MAX_IN_FLIGHT_PER_WORKER,
+        std::max<size_t>(numWorkers, frameBudget / std::max(frameSize, 1)));
+
+    AVCodec* codec = avcodec_find_decoder(codecpar->codec_id);
+    if (codec == nullptr)
+    {
+        return false;
+    }
+
+    auto closeGuard = MakeGuard(this, std::mem_fn(&IntraDecoderPool::close));
+
+    for (unsigned i = 0; i < numWorkers; ++i)
+    {
+        AVCodecContext* codecContext = avcodec_alloc_context3(nullptr);
+        if (codecContext == nullptr)
+        {
+            return false;
+        }
+        m_contexts.push_back(codecContext);
+
+        if (avcodec_parameters_to_context(codecContext, codecpar) < 0)
+        {
+            return false;
+        }
+
+        // Parallelism comes from the pool, each context works on a whole frame
+        codecContext->thread_count = 1;
+        codecContext->flags2 |= AV_CODEC_FLAG2_FAST;
+        FrameBufferPool::Attach(codecContext, codec);
+
+        if (avcodec_open2(codecContext, codec, nullptr) < 0)
+        {
+            BOOST_LOG_TRIVIAL(error) << "Unable to open intra-only decoder context";
+            return false;
+        }
+    }
+
+    m_stopping = false;
+    for (auto codecContext : m_contexts)
+    {
+        m_workers.create_thread([this, codecContext] { workerRunnable(codecContext); });
+    }
+
+    closeGuard.release();
+    return true;
+}
+
+void IntraDecoderPool::close()
+{
+    {
+        boost::lock_guard<boost::mutex> locker(m_mutex);
+        m_stopping = true;
+    }
+    m_jobsCV.notify_all();
+    m_workers.join_all();
+
+    for (auto& codecContext : m_contexts)
+    {
+        FrameBufferPool::Release(codecContext);
+        avcodec_free_context(&codecContext);
+    }
+    m_contexts.clear();
+
+    flush();
+}
+
+void IntraDecoderPool::send(const AVPacket& packet)
+{
+    Job job{};
+    if (av_packet_ref(&job.packet, &packet) < 0)
+    {
+        return;
+    }
+    {
+        boost::lock_guard<boost::mutex> locker(m_mutex);
+        job.sequence = m_nextSequence++;
+        m_jobs.push_back(job);
+    }
+    m_jobsCV.notify_one();
+}
+
+bool IntraDecoderPool::receive(AVFramePtr& frame, bool wait)
+{
+    boost::unique_lock<boost::mutex> locker(m_mutex);
+    while (m_nextOutput != m_nextSequence)
+    {
+        auto it = m_results.find(m_nextOutput);
+        if (it == m_results.end())
+        {
+            if (!wait)
+            {
+                return false;
+            }
+            m_resultsCV.wait(locker);
+            continue;
+        }
+
+        ++m_nextOutput;
+        frame = std::move(it->second);
+        m_results.erase(it);
+        if (frame)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void IntraDecoderPool::flush()
+{
+    boost::lock_guard<boost::mutex> locker(m_mutex);
+    for (auto& job : m_jobs)
+    {
+        av_packet_unref(&job.packet);
+    }
+    m_jobs.clear();
+    m_results.clear();
+
+    // Jobs being decoded right now are discarded as they come back
+    m_nextOutput = m_nextSequence;
+}
+
+void IntraDecoderPool::setDiscard(AVDiscard skipLoopFilter, AVDiscard skipFrame)
+{
+    m_skipLoopFilter = skipLoopFilter;
+    m_skipFrame = skipFrame;
+}
+
+bool IntraDecoderPool::full()
+{
+    boost::lock_guard<boost::mutex> locker(m_mutex);
+    return m_nextSequence - m_nextOutput >= m_maxInFlight;
+}
+
+bool IntraDecoderPool::empty()
+{
+    boost::lock_guard<boost::mutex> locker(m_mutex);
+    return m_nextSequence == m_nextOutput;
+}
+
+void IntraDecoderPool::workerRunnable(AVCodecContext* codecContext)
+{
+    ApplyThreadPolicy(THREAD_ROLE_DECODE);
+
+    for (;;)
+    {
+        Job job;
+        {
+            boost::unique_lock<boost::mutex> locker(m_mutex);
+            while (m_jobs.empty() && !m_stopping)
+            {
+                m_jobsCV.wait(locker);
+            }
+            if (m_stopping)
+            {
+                return;
+            }
+            job = m_jobs.front();
+            m_jobs.pop_front();
+        }
+
+        codecContext->skip_loop_filter = m_skipLoopFilter;
+        codecContext->skip_frame = m_skipFrame;
+
+        AVFramePtr frame(av_frame_alloc());
+        const int ret = avcodec_send_packet(codecContext, &job.packet);
+        av_packet_unref(&job.packet);
+        if (ret < 0 || avcodec_receive_frame(codecContext, frame.get()) < 0)
+        {
+            frame.reset();
+        }
+
+        {
+            boost::lock_guard<boost::mutex> locker(m_mutex);
+            if (job.sequence >= m_nextOutput)
+            {
+                m_results[job.sequence] = std::move(frame);
+            }
+        }
+        m_resultsCV.notify_all();
+    }
+}
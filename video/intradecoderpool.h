@@ -0,0 +1,76 @@
+#pragma once
+
+#include "videoframe.h"
+
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <vector>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+// Decodes independent frames of intra-only codecs on several codec contexts at once.
+// Frames come out in packet order, which is presentation order for these codecs.
+class IntraDecoderPool
+{
+public:
+    // One being decoded and one waiting, so that a worker never idles between frames
+    enum { MAX_IN_FLIGHT_PER_WORKER = 2 };
+
+    IntraDecoderPool() = default;
+    ~IntraDecoderPool() { close(); }
+    IntraDecoderPool(const IntraDecoderPool&) = delete;
+    IntraDecoderPool& operator=(const IntraDecoderPool&) = delete;
+
+    static bool IsIntraOnly(const AVCodecParameters* codecpar);
+
+    // Frames decoded ahead are limited by frameBudget bytes, but never below one per worker
+    bool open(const AVCodecParameters* codecpar, unsigned numWorkers, size_t frameBudget);
+    void close();
+
+    size_t numWorkers() const { return m_contexts.size(); }
+    size_t maxInFlight() const { return m_maxInFlight; }
+
+    void send(const AVPacket& packet);
+    // With wait set blocks until the next frame in order is decoded; false if nothing is pending
+    bool receive(AVFramePtr& frame, bool wait);
+    // Drops everything in flight
+    void flush();
+
+    // Taken up by each worker before its next frame
+    void setDiscard(AVDiscard skipLoopFilter, AVDiscard skipFrame);
+
+    bool full();
+    bool empty();
+
+private:
+    void workerRunnable(AVCodecContext* codecContext);
+
+    struct Job
+    {
+        AVPacket packet;
+        uint64_t sequence;
+    };
+
+    std::vector<AVCodecContext*> m_contexts;
+    boost::thread_group m_workers;
+
+    boost::mutex m_mutex;
+    boost::condition_variable m_jobsCV;
+    boost::condition_variable m_resultsCV;
+    std::deque<Job> m_jobs;
+    std::map<uint64_t, AVFramePtr> m_results; // null for packets that failed to decode
+    uint64_t m_nextSequence = 0;
+    uint64_t m_nextOutput = 0;
+    size_t m_maxInFlight = 0;
+    bool m_stopping = false;
+
+    boost::atomic<AVDiscard> m_skipLoopFilter{ AVDISCARD_DEFAULT };
+    boost::atomic<AVDiscard> m_skipFrame{ AVDISCARD_DEFAULT };
+};
@@ -0,0 +1,44 @@
+#include "loopcache.h"
+
+void LoopCache::clear()
+{
+    for (AVPacket& packet : m_packets)
+    {
+        av_packet_unref(&packet);
+    }
+    std::vector<AVPacket>().swap(m_packets);
+    m_bytes = 0;
+    m_position = 0;
+}
+
+bool LoopCache::add(const AVPacket& packet)
+{
+    if (m_bytes + packet.size > MAX_BYTES)
+    {
+        clear();
+        return false;
+    }
+
+    AVPacket copy;
+    av_init_packet(&copy);
+    if (av_packet_ref(&copy, &packet) < 0)
+    {
+        clear();
+        return false;
+    }
+
+    m_packets.push_back(copy);
+    m_bytes += packet.size;
+    return true;
+}
+
+bool LoopCache::next(AVPacket& packet)
+{
+    if (m_position >= m_packets.size())
+    {
+        return false;
+    }
+
+    av_init_packet(&packet);
+    return av_packet_ref(&packet, &m_packets[m_position++]) >= 0;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+// Compressed packets of one loop lap, replayed without touching the demuxer
+class LoopCache
+{
+public:
+    enum { MAX_BYTES = 256 * 1024 * 1024 };
+
+    LoopCache() = default;
+    ~LoopCache() { clear(); }
+    LoopCache(const LoopCache&) = delete;
+    LoopCache& operator=(const LoopCache&) = delete;
+
+    void clear();
+
+    // Keeps a reference to the packet; fails once the lap does not fit the budget
+    bool add(const AVPacket& packet);
+
+    void rewind() { m_position = 0; }
+    // Hands out a new reference to the next packet of the lap
+    bool next(AVPacket& packet);
+
+    bool empty() const { return m_packets.empty(); }
+
+private:
+    std::vector<AVPacket> m_packets;
+    size_t m_bytes = 0;
+    size_t m_position = 0;
+};
@@ -0,0 +1,68 @@
+#include "packethistory.h"
+
+void PacketHistory::clear()
+{
+    for (Entry& entry : m_entries)
+    {
+        av_packet_unref(&entry.packet);
+    }
+    m_entries.clear();
+    m_cursor = 0;
+    m_bytes = 0;
+}
+
+void PacketHistory::add(const AVPacket& packet, double time, bool seekPoint)
+{
+    Entry entry{};
+    av_init_packet(&entry.packet);
+    if (av_packet_ref(&entry.packet, &packet) < 0)
+    {
+        clear(); // a hole would break replay
+        return;
+    }
+    entry.time = time;
+    entry.seekPoint = seekPoint;
+
+    m_entries.push_back(entry);
+    m_bytes += packet.size;
+
+    while (!m_entries.empty()
+        && (m_bytes > MAX_BYTES || m_entries.front().time < time - MAX_SECONDS))
+    {
+        m_bytes -= m_entries.front().packet.size;
+        av_packet_unref(&m_entries.front().packet);
+        m_entries.pop_front();
+    }
+
+    m_cursor = m_entries.size();
+}
+
+bool PacketHistory::seek(double time)
+{
+    if (m_entries.empty() || time > m_entries.back().time)
+    {
+        return false;
+    }
+
+    for (size_t i = m_entries.size(); i-- > 0;)
+    {
+        if (m_entries[i].seekPoint && m_entries[i].time <= time)
+        {
+            m_cursor = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool PacketHistory::next(AVPacket& packet)
+{
+    if (m_cursor >= m_entries.size())
+    {
+        return false;
+    }
+
+    av_init_packet(&packet);
+    return av_packet_ref(&packet, &m_entries[m_cursor++].packet) >= 0;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+// Recently demuxed packets, so that short seeks back are served from memory
+class PacketHistory
+{
+public:
+    enum
+    {
+        MAX_BYTES = 64 * 1024 * 1024,
+        MAX_SECONDS = 30,
+    };
+
+    PacketHistory() = default;
+    ~PacketHistory() { clear(); }
+    PacketHistory(const PacketHistory&) = delete;
+    PacketHistory& operator=(const PacketHistory&) = delete;
+
+    void clear();
+
+    // Must only be called with packets that follow the last one, i.e. when not replaying
+    void add(const AVPacket& packet, double time, bool seekPoint);
+
+    // Positions replay at the latest seek point not after time, if the history covers it
+    bool seek(double time);
+    bool isReplaying() const { return m_cursor < m_entries.size(); }
+    bool next(AVPacket& packet);
+
+private:
+    struct Entry
+    {
+        AVPacket packet;
+        double time;
+        bool seekPoint;
+    };
+
+    std::deque<Entry> m_entries;
+    size_t m_cursor = 0;
+    size_t m_bytes = 0;
+};
@@ -1,7 +1,10 @@
 #include "ffmpegdecoder.h"
 #include "makeguard.h"
+#include "steadytime.h"
 
 #include <algorithm>
+#include <functional>
+#include <limits>
 #include <memory>
 
 namespace {
@@ -20,16 +23,34 @@ bool isSeekable(AVFormatContext* formatContext)
 void FFmpegDecoder::parseRunnable()
 {
     CHANNEL_LOG(ffmpeg_threads) << "Parse thread started";
+    ApplyThreadPolicy(THREAD_ROLE_DEMUX);
     AVPacket packet;
     enum { UNSET, SET, REPORTED } eof = UNSET;
 
     // detect real framesize
     fixDuration();
 
+    startTimeshift();
+
+    m_position.update([](PlaybackPosition& position) { position.frame = position.start; });
     if (m_decoderListener != nullptr)
     {
-        m_decoderListener->fileLoaded(m_startTime, m_duration + m_startTime);
-        m_decoderListener->changedFramePosition(m_startTime, m_startTime, m_duration + m_startTime);
+        const auto position = m_position.get();
+        m_decoderListener->fileLoaded(position.start, position.total);
+        m_decoderListener->changedFramePosition(position.start, position.start, position.total);
+    }
+
+    auto deinitializeThread = MakeGuard(
+        m_audioOnly ? m_audioPlayer.get() : nullptr,
+        std::mem_fn(&IAudioPlayer::DeinitializeThread));
+    if (m_audioOnly)
+    {
+        // Audio is decoded and written right here
+        ApplyThreadPolicy(THREAD_ROLE_AUDIO);
+        m_audioPlayer->InitializeThread();
+        m_audioOnlyCpuBase = GetThreadCpuTime();
+        m_audioOnlyCpuTime = m_audioOnlyCpuBase.load();
+        m_audioOnlyStartTime = GetSteadyTime();
     }
 
     startAudioThread();
@@ -46,6 +67,10 @@ void FFmpegDecoder::parseRunnable()
         if (seekDuration != AV_NOPTS_VALUE)
         {
             resetDecoding(seekDuration, false);
+            if (m_audioOnly)
+            {
+                m_controlMonitor.end(CONTROL_SEEK);
+            }
         }
         seekDuration = m_videoResetDuration.exchange(AV_NOPTS_VALUE);
         if (seekDuration != AV_NOPTS_VALUE)
@@ -53,9 +78,41 @@ void FFmpegDecoder::parseRunnable()
             if (!resetDecoding(seekDuration, true)) {
                 return;
             }
+            m_controlMonitor.end(CONTROL_VIDEO_RESET);
+        }
+
+        if (m_loopChanged.exchange(false))
+        {
+            handleLoopRangeChange();
+        }
+
+        if (m_timeshift)
+        {
+            updateTimeshiftWindow();
+        }
+
+        int readStatus;
+        if (m_loopState == LOOP_REPLAYING)
+        {
+            readStatus = readLoopPacket(packet);
+        }
+        else
+        {
+            readStatus = readPacket(packet);
+            if (m_loopState == LOOP_CACHING)
+            {
+                if (readStatus == AVERROR_EOF)
+                {
+                    startLoopReplay(); // the range ends with the file
+                    continue;
+                }
+                if (readStatus >= 0 && !cacheLoopPacket(packet))
+                {
+                    continue;
+                }
+            }
         }
 
-        const int readStatus = av_read_frame(m_formatContext, &packet);
         if (readStatus >= 0)
         {
             dispatchPacket(packet);
@@ -79,7 +136,26 @@ void FFmpegDecoder::parseRunnable()
                 eof = SET;
             }
 
-            this_thread::sleep_for(chrono::milliseconds(1));
+            if (eof != UNSET)
+            {
+                flushAudioBatch();
+
+                // Nothing more to read until a seek or a loop range change. Until the decoders and
+                // the display have drained the queues the end of the stream is checked for every
+                // millisecond, so that it is reported without delay.
+                const int waitMs = (m_audioOnly || eof == REPORTED) ? EOF_WAIT_MS : 1;
+                unique_lock<mutex> locker(m_parseMutex);
+                m_parseCV.wait_for(locker, chrono::milliseconds(waitMs),
+                    [this] { return isSeekRequested() || m_loopChanged; });
+                if (m_audioOnly)
+                {
+                    countWakeup();
+                }
+            }
+            else
+            {
+                this_thread::sleep_for(chrono::milliseconds(1));
+            }
         }
 
         // Continue packet reading
@@ -88,6 +164,232 @@ void FFmpegDecoder::parseRunnable()
     CHANNEL_LOG(ffmpeg_threads) << "Decoding ended";
 }
 
+int FFmpegDecoder::readPacket(AVPacket& packet)
+{
+    if (m_timeshift)
+    {
+        return m_timeshift->read(packet);
+    }
+
+    // After a seek back the history is replayed first, the demuxer then goes on where it stopped
+    if (m_packetHistory.isReplaying() && m_packetHistory.next(packet))
+    {
+        return 0;
+    }
+
+    const int readStatus = av_read_frame(m_formatContext, &packet);
+    if (readStatus >= 0)
+    {
+        const int64_t stamp = (packet.dts != AV_NOPTS_VALUE) ? packet.dts : packet.pts;
+        if (stamp != AV_NOPTS_VALUE)
+        {
+            const double time = stamp * av_q2d(m_formatContext->streams[packet.stream_index]->time_base);
+            m_packetHistory.add(packet, time, isSeekPoint(packet));
+            if (m_fileSequence)
+            {
+                m_fileSequence->prefetch((m_formatContext->start_time != AV_NOPTS_VALUE)
+                    ? time - m_formatContext->start_time / static_cast<double>(AV_TIME_BASE) : time);
+            }
+        }
+        else
+        {
+            m_packetHistory.clear();
+        }
+    }
+    return readStatus;
+}
+
+bool FFmpegDecoder::isSeekPoint(const AVPacket& packet) const
+{
+    return (m_videoStreamNumber >= 0)
+        ? packet.stream_index == m_videoStreamNumber && (packet.flags & AV_PKT_FLAG_KEY) != 0
+        : packet.stream_index == m_audioStreamNumber;
+}
+
+void FFmpegDecoder::startTimeshift()
+{
+    // Only live streams, files and seekable URLs are better off without it
+    if (m_ioCtx || isSeekable(m_formatContext))
+    {
+        return;
+    }
+
+    auto timeshift = std::make_unique<TimeshiftBuffer>(TIMESHIFT_CAPACITY);
+    if (!timeshift->open())
+    {
+        return; // play it live then
+    }
+
+    m_timeshift = std::move(timeshift);
+    boost::lock_guard<boost::mutex> locker(m_threadsMutex);
+    m_timeshiftThread = std::make_unique<boost::thread>(&FFmpegDecoder::timeshiftRunnable, this);
+
+    CHANNEL_LOG(ffmpeg_opening) << "Timeshift enabled";
+}
+
+void FFmpegDecoder::timeshiftRunnable()
+{
+    CHANNEL_LOG(ffmpeg_threads) << "Timeshift thread started";
+    ApplyThreadPolicy(THREAD_ROLE_BACKGROUND);
+
+    const AVStream* timeStream = (m_videoStream != nullptr) ? m_videoStream : m_audioStream;
+    int64_t time = m_position.get().start;
+
+    for (;;)
+    {
+        if (boost::this_thread::interruption_requested())
+        {
+            return;
+        }
+
+        AVPacket packet;
+        const int readStatus = av_read_frame(m_formatContext, &packet);
+        if (readStatus >= 0)
+        {
+            auto guard = MakeGuard(&packet, av_packet_unref);
+
+            // Streams are interleaved loosely, the others take the time of the time stream packet before them
+            const int64_t stamp = (packet.dts != AV_NOPTS_VALUE) ? packet.dts : packet.pts;
+            if (packet.stream_index == timeStream->index && stamp != AV_NOPTS_VALUE)
+            {
+                time = stamp;
+            }
+
+            m_timeshift->write(packet, time, isSeekPoint(packet));
+        }
+        else if (readStatus == AVERROR_EOF)
+        {
+            m_timeshift->finish();
+            CHANNEL_LOG(ffmpeg_threads) << "Timeshift recording ended";
+            return;
+        }
+        else
+        {
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+        }
+    }
+}
+
+void FFmpegDecoder::updateTimeshiftWindow()
+{
+    // Position and percent seeks are relative to what has been recorded
+    int64_t first;
+    int64_t last;
+    if (m_timeshift->getWindow(first, last))
+    {
+        m_position.update([first, last](PlaybackPosition& position) {
+            position.start = first;
+            position.total = last;
+        });
+    }
+}
+
+int FFmpegDecoder::readLoopPacket(AVPacket& packet)
+{
+    if (!m_loopCache.next(packet))
+    {
+        dispatchLoopMarker();
+        m_loopCache.rewind();
+        if (!m_loopCache.next(packet))
+        {
+            return AVERROR(EAGAIN);
+        }
+    }
+    return 0;
+}
+
+bool FFmpegDecoder::cacheLoopPacket(AVPacket& packet)
+{
+    const AVRational timeBase = m_formatContext->streams[packet.stream_index]->time_base;
+    const int64_t pts = (packet.pts != AV_NOPTS_VALUE) ? packet.pts : packet.dts;
+    const int64_t dts = (packet.dts != AV_NOPTS_VALUE) ? packet.dts : packet.pts;
+
+    // Nothing decoded after a video packet with dts past the end is shown in the lap
+    const bool lapEnd = (m_videoStreamNumber >= 0)
+        ? packet.stream_index == m_videoStreamNumber
+            && dts != AV_NOPTS_VALUE && dts * av_q2d(timeBase) > m_loopEnd
+        : packet.stream_index == m_audioStreamNumber
+            && pts != AV_NOPTS_VALUE && pts * av_q2d(timeBase) > m_loopEnd;
+    if (lapEnd)
+    {
+        av_packet_unref(&packet);
+        startLoopReplay();
+        return false;
+    }
+
+    if (!m_loopCache.add(packet))
+    {
+        CHANNEL_LOG(ffmpeg_seek) << "Loop range does not fit the cache, falling back to seeking";
+        m_loopState = LOOP_TOO_LARGE;
+        // Restarted decoders do not clip frames to the range, so the document sees its end again
+        av_packet_unref(&packet);
+        resetDecoding(m_currentTime, false);
+        return false;
+    }
+
+    if (packet.stream_index == m_audioStreamNumber && pts != AV_NOPTS_VALUE)
+    {
+        const double start = pts * av_q2d(timeBase);
+        const double end = (pts + packet.duration) * av_q2d(timeBase);
+        if (isInLoopRange(start, end))
+        {
+            m_loopAudioStart = std::min(m_loopAudioStart, start);
+            m_loopAudioEnd = std::max(m_loopAudioEnd, end);
+        }
+    }
+
+    return true;
+}
+
+void FFmpegDecoder::startLoopReplay()
+{
+    if (m_loopCache.empty())
+    {
+        m_loopState = LOOP_IDLE;
+        return;
+    }
+
+    // Laps follow the audio actually played, so that audio sync never has to step in
+    m_loopPeriod = (m_loopAudioEnd > m_loopAudioStart)
+        ? m_loopAudioEnd - m_loopAudioStart : m_loopEnd - m_loopStart;
+
+    CHANNEL_LOG(ffmpeg_seek) << "Loop cached, period " << m_loopPeriod;
+
+    m_loopState = LOOP_REPLAYING;
+    m_loopCache.rewind();
+    dispatchLoopMarker();
+}
+
+void FFmpegDecoder::dispatchLoopMarker()
+{
+    for (const int streamNumber : { m_videoStreamNumber, int(m_audioStreamNumber) })
+    {
+        if (streamNumber >= 0)
+        {
+            AVPacket marker;
+            av_init_packet(&marker);
+            marker.data = nullptr;
+            marker.size = 0;
+            marker.stream_index = streamNumber;
+            dispatchPacket(marker);
+        }
+    }
+}
+
+void FFmpegDecoder::handleLoopRangeChange()
+{
+    const bool wasLooping = m_loopState != LOOP_IDLE;
+
+    m_loopCache.clear();
+    m_loopState = LOOP_IDLE;
+
+    // Decoders drop frames outside the old range and the demuxer may be past it
+    if (wasLooping)
+    {
+        resetDecoding(m_currentTime, false);
+    }
+}
+
 void FFmpegDecoder::dispatchPacket(AVPacket& packet)
 {
     auto guard = MakeGuard(&packet, av_packet_unref);
@@ -112,6 +414,11 @@ void FFmpegDecoder::dispatchPacket(AVPacket& packet)
     else if (std::find(m_audioIndices.begin(), m_audioIndices.end(), packet.stream_index) 
         != m_audioIndices.end())
     { 
+        if (m_audioOnly)
+        {
+            processAudioPacket(packet, m_audioOnlyContext);
+            return; // guard frees packet
+        }
         if (!m_audioPacketsQueue.push(packet, seekLambda))
         {
             return; // guard frees packet
@@ -139,8 +446,16 @@ void FFmpegDecoder::dispatchPacket(AVPacket& packet)
 
 void FFmpegDecoder::startAudioThread()
 {
-    if (m_audioStreamNumber >= 0)
+    if (m_audioOnly)
+    {
+        // Decoded on the parse thread, starting over as a new audio thread would
+        m_audioOnlyContext = AudioParseContext();
+        m_audioBatch.clear();
+        m_audioLoopOffset = 0;
+    }
+    else if (m_audioStreamNumber >= 0)
     {
+        boost::lock_guard<boost::mutex> locker(m_threadsMutex);
         m_mainAudioThread = std::make_unique<boost::thread>(&FFmpegDecoder::audioParseRunnable, this);
     }
 }
@@ -149,7 +464,11 @@ void FFmpegDecoder::startVideoThread()
 {
     if (m_videoStreamNumber >= 0)
     {
-        m_mainVideoThread = std::make_unique<boost::thread>(&FFmpegDecoder::videoParseRunnable, this);
+        {
+            boost::lock_guard<boost::mutex> locker(m_threadsMutex);
+            m_mainVideoThread = std::make_unique<boost::thread>(&FFmpegDecoder::videoParseRunnable, this);
+        }
+        startVideoFilterThread();
     }
 }
 
@@ -159,7 +478,55 @@ bool FFmpegDecoder::resetDecoding(int64_t seekDuration, bool resetVideo)
 
     const bool hasVideo = m_mainVideoThread != nullptr;
 
-    if (isSeekable(m_formatContext)
+    bool replayLoop = false;
+    if (m_loopState != LOOP_TOO_LARGE)
+    {
+        if (isLoopStart(seekDuration))
+        {
+            if (m_loopState == LOOP_CACHED || m_loopState == LOOP_REPLAYING)
+            {
+                replayLoop = true; // the demuxer is not needed at all
+            }
+            else
+            {
+                m_loopCache.clear();
+                m_loopState = LOOP_CACHING;
+                m_loopAudioStart = std::numeric_limits<double>::max();
+                m_loopAudioEnd = std::numeric_limits<double>::lowest();
+            }
+        }
+        else if (m_loopState == LOOP_REPLAYING)
+        {
+            m_loopState = LOOP_CACHED;
+        }
+        else if (m_loopState == LOOP_CACHING)
+        {
+            m_loopCache.clear();
+            m_loopState = LOOP_IDLE;
+        }
+    }
+
+    const AVStream* timeStream = hasVideo ? m_videoStream : m_audioStream;
+    const bool historySeek = !replayLoop && !m_timeshift
+        && m_packetHistory.seek(seekDuration * av_q2d(timeStream->time_base));
+
+    if (replayLoop)
+    {
+        CHANNEL_LOG(ffmpeg_seek) << "Replaying cached loop";
+    }
+    else if (historySeek)
+    {
+        CHANNEL_LOG(ffmpeg_seek) << "Seeking within packet history";
+    }
+    else if (m_timeshift)
+    {
+        if (!m_timeshift->seek(seekDuration))
+        {
+            CHANNEL_LOG(ffmpeg_seek) << "Seek failed";
+            return false;
+        }
+    }
+    else if (isSeekable(m_formatContext)
         && avformat_seek_file(m_formatContext, 
                            hasVideo ? m_videoStreamNumber : m_audioStreamNumber,
                            0, seekDuration, seekDuration, AVSEEK_FLAG_FRAME) < 0
@@ -171,11 +538,20 @@ bool FFmpegDecoder::resetDecoding(int64_t seekDuration, bool resetVideo)
         return false;
     }
 
+    if (!replayLoop && !historySeek)
+    {
+        m_packetHistory.clear(); // no longer continuous with the demuxer position
+    }
+
     const bool hasAudio = m_mainAudioThread != nullptr;
 
     if (hasVideo)
     {
         m_mainVideoThread->interrupt();
+        if (m_mainVideoFilterThread)
+        {
+            m_mainVideoFilterThread->interrupt();
+        }
     }
     if (hasAudio)
     {
@@ -185,6 +561,12 @@ bool FFmpegDecoder::resetDecoding(int64_t seekDuration, bool resetVideo)
     if (hasVideo)
     {
         m_mainVideoThread->join();
+        if (m_mainVideoFilterThread)
+        {
+            m_mainVideoFilterThread->join();
+            boost::lock_guard<boost::mutex> locker(m_threadsMutex);
+            m_mainVideoFilterThread.reset();
+        }
     }
     if (hasAudio)
     {
@@ -194,9 +576,14 @@ bool FFmpegDecoder::resetDecoding(int64_t seekDuration, bool resetVideo)
     // Reset stuff
     m_videoPacketsQueue.clear();
     m_audioPacketsQueue.clear();
+    m_videoFilterQueue.clear();
+    freeVideoFilter();
 
-    m_mainDisplayThread->interrupt();
-    m_mainDisplayThread->join();
+    if (m_mainDisplayThread)
+    {
+        m_mainDisplayThread->interrupt();
+        m_mainDisplayThread->join();
+    }
 
     // Free videoFrames
     {
@@ -204,6 +591,8 @@ bool FFmpegDecoder::resetDecoding(int64_t seekDuration, bool resetVideo)
         m_videoFramesQueue.clear();
         m_frameDisplayingRequested = false;
         ++m_generation;
+        // Armed before the threads restart, the first frame they present may come at once
+        m_seekLatencyPending = !m_audioOnly && m_seekRequestTime != 0;
     }
 
     m_videoResetting = false;
@@ -215,15 +604,22 @@ bool FFmpegDecoder::resetDecoding(int64_t seekDuration, bool resetVideo)
         return false;
     }
 
-    m_mainDisplayThread = std::make_unique<boost::thread>(&FFmpegDecoder::displayRunnable, this);
+    if (!m_audioOnly)
+    {
+        boost::lock_guard<boost::mutex> locker(m_threadsMutex);
+        m_mainDisplayThread = std::make_unique<boost::thread>(&FFmpegDecoder::displayRunnable, this);
+    }
 
     if (hasVideo)
     {
-        if (m_videoCodecContext != nullptr) {
+        if (m_intraDecoderPool) {
+            m_intraDecoderPool->flush();
+        }
+        else if (m_videoCodecContext != nullptr) {
             avcodec_flush_buffers(m_videoCodecContext);
         }
     }
-    if (hasAudio)
+    if (hasAudio || m_audioOnly)
     {
         if (m_audioCodecContext != nullptr) {
             avcodec_flush_buffers(m_audioCodecContext);
@@ -231,9 +627,11 @@ bool FFmpegDecoder::resetDecoding(int64_t seekDuration, bool resetVideo)
         m_audioPlayer->WaveOutReset();
     }
 
+    m_position.update([seekDuration](PlaybackPosition& position) { position.frame = seekDuration; });
     if (m_decoderListener != nullptr)
     {
-        m_decoderListener->changedFramePosition(m_startTime, seekDuration, m_duration + m_startTime);
+        const auto position = m_position.get();
+        m_decoderListener->changedFramePosition(position.start, seekDuration, position.total);
     }
 
     seekWhilePaused();
@@ -242,14 +640,31 @@ bool FFmpegDecoder::resetDecoding(int64_t seekDuration, bool resetVideo)
     startAudioThread();
     startVideoThread();
 
+    if (replayLoop)
+    {
+        m_loopState = LOOP_REPLAYING;
+        m_loopCache.rewind();
+    }
+    if (m_loopState == LOOP_CACHING || m_loopState == LOOP_REPLAYING)
+    {
+        dispatchLoopMarker();
+    }
+
     return true;
 }
 
 void FFmpegDecoder::fixDuration()
 {
-    if (m_duration <= 0)
+    const auto current = m_position.get();
+    if (current.total <= current.start)
     {
-        m_duration = 0;
+        int64_t duration = 0;
+        const auto publish = [this, &duration] {
+            m_position.update([duration](PlaybackPosition& position) {
+                position.total = position.start + duration;
+            });
+        };
+        publish();
         if (!isSeekable(m_formatContext))
         {
             return;
@@ -262,11 +677,11 @@ void FFmpegDecoder::fixDuration()
             {
                 if (packet.pts != AV_NOPTS_VALUE)
                 {
-                    m_duration = packet.pts;
+                    duration = packet.pts;
                 }
                 else if (packet.dts != AV_NOPTS_VALUE)
                 {
-                    m_duration = packet.dts;
+                    duration = packet.dts;
                 }
             }
             av_packet_unref(&packet);
@@ -277,6 +692,7 @@ void FFmpegDecoder::fixDuration()
                 return;
             }
         }
+        publish();
 
         if (avformat_seek_file(m_formatContext, m_videoStreamNumber, 0, 0, 0,
                                AVSEEK_FLAG_FRAME) < 0)
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "decoderinterface.h"
+
+#include <boost/atomic.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
+
+// Start, position and total published as one unit: a seqlock over atomic fields. Writers take turns,
+// a reader only retries when it overlapped a write and never sees parts of two updates.
+class PositionSnapshot
+{
+public:
+    PlaybackPosition get() const
+    {
+        for (;;)
+        {
+            const unsigned sequence = m_sequence.load(boost::memory_order_acquire);
+            const PlaybackPosition result = load();
+            boost::atomic_thread_fence(boost::memory_order_acquire);
+            if ((sequence & 1) == 0 && m_sequence.load(boost::memory_order_relaxed) == sequence)
+            {
+                return result;
+            }
+        }
+    }
+
+    // change(PlaybackPosition&) edits the current values
+    template<typename F>
+    void update(F change)
+    {
+        boost::lock_guard<boost::mutex> locker(m_writeMutex);
+        PlaybackPosition position = load();
+        change(position);
+
+        const unsigned sequence = m_sequence.load(boost::memory_order_relaxed);
+        m_sequence.store(sequence + 1, boost::memory_order_relaxed);
+        boost::atomic_thread_fence(boost::memory_order_release);
+        m_start.store(position.start, boost::memory_order_relaxed);
+        m_frame.store(position.frame, boost::memory_order_relaxed);
+        m_total.store(position.total, boost::memory_order_relaxed);
+        m_timeBase.store(position.timeBase, boost::memory_order_relaxed);
+        m_sequence.store(sequence + 2, boost::memory_order_release);
+    }
+
+private:
+    PlaybackPosition load() const
+    {
+        return {
+            m_start.load(boost::memory_order_relaxed),
+            m_frame.load(boost::memory_order_relaxed),
+            m_total.load(boost::memory_order_relaxed),
+            m_timeBase.load(boost::memory_order_relaxed)
+        };
+    }
+
+    boost::mutex m_writeMutex;
+    boost::atomic<unsigned> m_sequence{ 0 };
+    boost::atomic<long long> m_start{ 0 };
+    boost::atomic<long long> m_frame{ 0 };
+    boost::atomic<long long> m_total{ 0 };
+    boost::atomic<double> m_timeBase{ 0. };
+};
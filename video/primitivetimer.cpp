@@ -0,0 +1,85 @@
+#include "primitivetimer.h"
+
+#include <boost/atomic.hpp>
+
+#include <cstdio>
+
+namespace {
+
+const char* const PRIMITIVE_NAMES[PRIMITIVES] = {
+    "packet_push",
+    "packet_pop",
+    "frame_handoff",
+    "frame_to_image",
+    "copy_and_convert",
+    "pitch_shift",
+};
+
+// A cache line each, threads timing different primitives do not contend
+struct alignas(64) PrimitiveStats
+{
+    boost::atomic_int64_t calls{ 0 };
+    boost::atomic_int64_t totalNs{ 0 };
+    boost::atomic_int64_t maxNs{ 0 };
+};
+
+PrimitiveStats s_stats[PRIMITIVES];
+
+} // namespace
+
+void RecordPrimitive(Primitive primitive, PrimitiveClock::duration elapsed)
+{
+    const int64_t ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(elapsed).count();
+
+    PrimitiveStats& stats = s_stats[primitive];
+    ++stats.calls;
+    stats.totalNs += ns;
+
+    int64_t maxNs = stats.maxNs;
+    while (ns > maxNs && !stats.maxNs.compare_exchange_weak(maxNs, ns))
+    {
+    }
+}
+
+double PrimitiveSeconds(Primitive primitive)
+{
+    return s_stats[primitive].totalNs / 1e9;
+}
+
+std::string DescribePrimitives()
+{
+    std::string result;
+    for (int i = 0; i < PRIMITIVES; ++i)
+    {
+        const int64_t calls = s_stats[i].calls;
+        if (calls == 0)
+        {
+            continue;
+        }
+
+        char buffer[100];
+        snprintf(buffer, sizeof(buffer), "%s%s %.1f us",
+            result.empty() ? "Primitives: " : ", ",
+            PRIMITIVE_NAMES[i], s_stats[i].totalNs / 1000. / calls);
+        result += buffer;
+    }
+    return result;
+}
+
+std::string PrimitivesToJson()
+{
+    std::string result = "{\"primitives\": [";
+    for (int i = 0; i < PRIMITIVES; ++i)
+    {
+        const int64_t calls = s_stats[i].calls;
+
+        char buffer[200];
+        snprintf(buffer, sizeof(buffer),
+            "%s\n  {\"name\": \"%s\", \"calls\": %lld, \"mean_us\": %.3f, \"max_us\": %.3f}",
+            (i == 0) ? "" : ",", PRIMITIVE_NAMES[i], static_cast<long long>(calls),
+            (calls > 0) ? s_stats[i].totalNs / 1000. / calls : 0., s_stats[i].maxNs / 1000.);
+        result += buffer;
+    }
+    result += "\n]}\n";
+    return result;
+}
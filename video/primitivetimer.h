@@ -0,0 +1,69 @@
+#pragma once
+
+#include <boost/chrono.hpp>
+
+#include <string>
+
+// Costs two clock reads per timed call, on paths as hot as every packet queued
+//#define PRIMITIVE_TIMING
+
+// Building blocks of the pipeline timed in production, process wide
+enum Primitive
+{
+    PRIMITIVE_PACKET_PUSH,      // FQueue::push() short of waiting for room
+    PRIMITIVE_PACKET_POP,       // FQueue::pop() short of waiting for data
+    PRIMITIVE_FRAME_HANDOFF,    // decoded frame queued to display thread awake
+    PRIMITIVE_FRAME_TO_IMAGE,
+    PRIMITIVE_COPY_AND_CONVERT, // a whole frame
+    PRIMITIVE_PITCH_SHIFT,      // a channel of a buffer
+    PRIMITIVES
+};
+
+typedef boost::chrono::high_resolution_clock PrimitiveClock;
+
+void RecordPrimitive(Primitive primitive, PrimitiveClock::duration elapsed);
+
+#ifdef PRIMITIVE_TIMING
+
+// Times the enclosing scope
+class PrimitiveTimer
+{
+public:
+    explicit PrimitiveTimer(Primitive primitive)
+        : m_primitive(primitive), m_startTime(PrimitiveClock::now()) {}
+    ~PrimitiveTimer() { RecordPrimitive(m_primitive, PrimitiveClock::now() - m_startTime); }
+
+    PrimitiveTimer(const PrimitiveTimer&) = delete;
+    PrimitiveTimer& operator=(const PrimitiveTimer&) = delete;
+
+    // Starts over, e.g. after a wait that is not to be counted
+    void restart() { m_startTime = PrimitiveClock::now(); }
+
+private:
+    Primitive m_primitive;
+    PrimitiveClock::time_point m_startTime;
+};
+
+#else
+
+class PrimitiveTimer
+{
+public:
+    explicit PrimitiveTimer(Primitive) {}
+
+    PrimitiveTimer(const PrimitiveTimer&) = delete;
+    PrimitiveTimer& operator=(const PrimitiveTimer&) = delete;
+
+    void restart() {}
+};
+
+#endif // PRIMITIVE_TIMING
+
+// Total time recorded so far
+double PrimitiveSeconds(Primitive primitive);
+
+// Empty until something has been timed
+std::string DescribePrimitives();
+
+// {"primitives": [{"name": ..., "calls": ..., "mean_us": ..., "max_us": ...}, ...]}
+std::string PrimitivesToJson();
@@ -0,0 +1,28 @@
+#pragma once
+
+// The bounds checked formatting of the Microsoft CRT, on top of the standard one elsewhere
+#ifndef _MSC_VER
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+
+template<size_t size, typename... Args>
+inline int sprintf_s(char (&buffer)[size], const char* format, Args... args)
+{
+    return snprintf(buffer, size, format, args...);
+}
+
+template<typename... Args>
+inline int sprintf_s(char* buffer, size_t size, const char* format, Args... args)
+{
+    return snprintf(buffer, size, format, args...);
+}
+
+template<size_t size>
+inline int vsprintf_s(char (&buffer)[size], const char* format, va_list args)
+{
+    return vsnprintf(buffer, size, format, args);
+}
+
+#endif
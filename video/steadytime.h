@@ -0,0 +1,10 @@
+#pragma once
+
+#include <boost/chrono.hpp>
+
+// Seconds on the steady clock, for real time intervals whatever clock paces playback
+inline double GetSteadyTime()
+{
+    return boost::chrono::duration<double>(
+        boost::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,260 @@
+#include "streamanalyzer.h"
+
+#include "makeguard.h"
+#include "securecrt.h"
+
+#include <boost/log/trivial.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <numeric>
+#include <utility>
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+namespace {
+
+enum { LONG_GOP_SECONDS = 10 };
+enum { BITRATE_PEAK_RATIO = 4 };
+
+typedef std::pair<std::string, int64_t> CacheKey; // url and size, so that a rewritten file is scanned again
+
+boost::mutex s_cacheMutex;
+std::map<CacheKey, std::shared_ptr<const StreamAnalysis>> s_cache;
+std::deque<CacheKey> s_cacheOrder; // oldest first
+
+int InterruptionRequested(void* /*unused*/)
+{
+    return static_cast<int>(boost::this_thread::interruption_requested());
+}
+
+double Percentile(std::vector<double> values, double p)
+{
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, size_t(p * values.size()))];
+}
+
+struct StreamState
+{
+    double lastDts = 0;
+    bool hasDts = false;
+    double lastKeyframe = -1;
+    double maxPts = 0;
+    bool hasPts = false;
+};
+
+void Scan(AVFormatContext* formatContext, StreamAnalysis& analysis)
+{
+    std::vector<StreamState> states;
+    int videoStream = -1;
+    double firstTime = 0;
+    double lastTime = 0;
+    bool hasTime = false;
+
+    AVPacket packet;
+    av_init_packet(&packet);
+    packet.data = nullptr;
+    packet.size = 0;
+
+    while (av_read_frame(formatContext, &packet) >= 0)
+    {
+        auto packetGuard = MakeGuard(&packet, av_packet_unref);
+
+        // Some containers only reveal their streams as packets arrive
+        if (states.size() < formatContext->nb_streams)
+        {
+            states.resize(formatContext->nb_streams);
+        }
+        const AVStream* stream = formatContext->streams[packet.stream_index];
+        if (videoStream < 0 && stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO
+            && !(stream->disposition & AV_DISPOSITION_ATTACHED_PIC))
+        {
+            videoStream = packet.stream_index;
+        }
+
+        ++analysis.packets;
+        analysis.bytes += packet.size;
+
+        const int64_t timestamp = (packet.dts != AV_NOPTS_VALUE) ? packet.dts : packet.pts;
+        if (timestamp == AV_NOPTS_VALUE)
+        {
+            continue;
+        }
+
+        const double timeBase = av_q2d(stream->time_base);
+        const double time = timestamp * timeBase;
+        StreamState& state = states[packet.stream_index];
+
+        // Subtitle and data streams are sparse by nature
+        const bool continuous = stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO
+            || stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO;
+        if (continuous && state.hasDts
+            && (time < state.lastDts || time - state.lastDts > StreamAnalyzer::DISCONTINUITY_SECONDS))
+        {
+            analysis.discontinuities.push_back(time);
+        }
+        state.lastDts = time;
+        state.hasDts = true;
+
+        if (!hasTime)
+        {
+            firstTime = lastTime = time;
+            hasTime = true;
+        }
+        lastTime = std::max(lastTime, time);
+
+        const double second = time - firstTime;
+        if (second >= 0)
+        {
+            const size_t bucket = static_cast<size_t>(second);
+            if (analysis.bitrate.size() <= bucket)
+            {
+                analysis.bitrate.resize(bucket + 1);
+            }
+            analysis.bitrate[bucket] += packet.size * 8.;
+        }
+
+        if (packet.stream_index != videoStream)
+        {
+            continue;
+        }
+
+        ++analysis.videoPackets;
+
+        if (packet.pts != AV_NOPTS_VALUE)
+        {
+            const double pts = packet.pts * timeBase;
+            if (state.hasPts && pts < state.maxPts)
+            {
+                ++analysis.reorderedPackets;
+            }
+            state.maxPts = state.hasPts ? std::max(state.maxPts, pts) : pts;
+            state.hasPts = true;
+        }
+
+        if (packet.flags & AV_PKT_FLAG_KEY)
+        {
+            if (state.lastKeyframe >= 0 && time > state.lastKeyframe)
+            {
+                analysis.keyframeIntervals.push_back(time - state.lastKeyframe);
+            }
+            state.lastKeyframe = time;
+        }
+    }
+
+    analysis.duration = lastTime - firstTime;
+}
+
+} // namespace
+
+std::vector<std::string> StreamAnalysis::describe() const
+{
+    std::vector<std::string> result;
+    char buffer[1000];
+
+    if (!keyframeIntervals.empty())
+    {
+        sprintf_s(buffer, sizeof(buffer) / sizeof(buffer[0]),
+            "Keyframe interval: min %.2f s, median %.2f s, max %.2f s",
+            *std::min_element(keyframeIntervals.begin(), keyframeIntervals.end()),
+            Percentile(keyframeIntervals, 0.5),
+            *std::max_element(keyframeIntervals.begin(), keyframeIntervals.end()));
+        result.push_back(buffer);
+    }
+
+    if (videoPackets > 0)
+    {
+        sprintf_s(buffer, sizeof(buffer) / sizeof(buffer[0]),
+            "Reordered frames: %.1f%%", reorderedPackets * 100. / videoPackets);
+        result.push_back(buffer);
+    }
+
+    double average = 0;
+    double peak = 0;
+    if (duration > 0 && !bitrate.empty())
+    {
+        average = bytes * 8. / duration;
+        peak = *std::max_element(bitrate.begin(), bitrate.end());
+        sprintf_s(buffer, sizeof(buffer) / sizeof(buffer[0]),
+            "Bitrate: average %.0f kbit/s, p95 %.0f kbit/s, peak %.0f kbit/s",
+            average / 1000., Percentile(bitrate, 0.95) / 1000., peak / 1000.);
+        result.push_back(buffer);
+    }
+
+    if (!discontinuities.empty())
+    {
+        sprintf_s(buffer, sizeof(buffer) / sizeof(buffer[0]),
+            "Timestamp discontinuities: %u, first at %.2f s",
+            static_cast<unsigned>(discontinuities.size()), discontinuities.front());
+        result.push_back(buffer);
+    }
+
+    if (videoPackets > 0 && keyframeIntervals.empty() && duration > LONG_GOP_SECONDS)
+    {
+        result.push_back("Warning: a single keyframe, seeking will decode from the start");
+    }
+    else if (!keyframeIntervals.empty()
+        && *std::max_element(keyframeIntervals.begin(), keyframeIntervals.end()) > LONG_GOP_SECONDS)
+    {
+        result.push_back("Warning: keyframes far apart, seeking will be slow");
+    }
+    if (average > 0 && peak > average * BITRATE_PEAK_RATIO)
+    {
+        result.push_back("Warning: bitrate peaks well above average, playback may stutter");
+    }
+    if (!discontinuities.empty())
+    {
+        result.push_back("Warning: timestamps jump, seeking and A/V sync may misbehave");
+    }
+
+    return result;
+}
+
+// static
+std::shared_ptr<const StreamAnalysis> StreamAnalyzer::Analyze(const std::string& url)
+{
+    AVFormatContext* formatContext = avformat_alloc_context();
+    formatContext->interrupt_callback.callback = InterruptionRequested;
+    if (avformat_open_input(&formatContext, url.c_str(), nullptr, nullptr) != 0)
+    {
+        BOOST_LOG_TRIVIAL(error) << "Unable to open " << url << " for analysis";
+        return nullptr;
+    }
+    auto formatContextGuard = MakeGuard(&formatContext, avformat_close_input);
+
+    const CacheKey key(url, (formatContext->pb != nullptr) ? avio_size(formatContext->pb) : -1);
+    {
+        boost::lock_guard<boost::mutex> locker(s_cacheMutex);
+        auto it = s_cache.find(key);
+        if (it != s_cache.end())
+        {
+            return it->second;
+        }
+    }
+
+    auto analysis = std::make_shared<StreamAnalysis>();
+    Scan(formatContext, *analysis);
+    if (boost::this_thread::interruption_requested())
+    {
+        return nullptr; // cut short, nothing to keep
+    }
+
+    boost::lock_guard<boost::mutex> locker(s_cacheMutex);
+    if (s_cache.emplace(key, analysis).second)
+    {
+        s_cacheOrder.push_back(key);
+        if (s_cacheOrder.size() > MAX_CACHED)
+        {
+            s_cache.erase(s_cacheOrder.front());
+            s_cacheOrder.pop_front();
+        }
+    }
+    return analysis;
+}
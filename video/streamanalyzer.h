@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// What the packets of a file tell without decoding them
+struct StreamAnalysis
+{
+    double duration = 0;        // seconds spanned by the packets
+    int64_t packets = 0;
+    int64_t bytes = 0;
+
+    std::vector<double> keyframeIntervals;  // seconds between consecutive video keyframes
+    int64_t videoPackets = 0;
+    int64_t reorderedPackets = 0;           // presented before an earlier decoded one, B-frames as a rule
+
+    std::vector<double> bitrate;            // bits per second, second by second, all streams
+    std::vector<double> discontinuities;    // times where an audio or video dts jumps back or leaps ahead
+
+    // Summary and warnings for files that will seek badly or stutter
+    std::vector<std::string> describe() const;
+};
+
+// Scans at the speed the packets can be read, results are kept per file
+class StreamAnalyzer
+{
+public:
+    enum { DISCONTINUITY_SECONDS = 2 };
+    enum { MAX_CACHED = 64 };
+
+    // UTF-8 file name or URL, null if it cannot be read or the thread is interrupted
+    static std::shared_ptr<const StreamAnalysis> Analyze(const std::string& url);
+};
@@ -0,0 +1,50 @@
+#include "subtitlecache.h"
+
+#include <boost/functional/hash.hpp>
+
+size_t SubtitleCache::KeyHash::operator()(const Key& key) const
+{
+    size_t seed = 0;
+    boost::hash_combine(seed, key.text);
+    boost::hash_combine(seed, key.style);
+    boost::hash_combine(seed, key.width);
+    boost::hash_combine(seed, key.height);
+    return seed;
+}
+
+std::shared_ptr<const SubtitleBitmap> SubtitleCache::get(const Key& key)
+{
+    auto it = m_index.find(key);
+    if (it != m_index.end())
+    {
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        return it->second->second;
+    }
+
+    auto bitmap = std::make_shared<SubtitleBitmap>();
+    if (!m_rasterizer(key, *bitmap))
+    {
+        return nullptr;
+    }
+
+    m_entries.emplace_front(key, bitmap);
+    m_index.emplace(key, m_entries.begin());
+    m_bytes += bitmap->alpha.size();
+
+    // The entry just added stays even if it alone exceeds the limit
+    while (m_bytes > MAX_BYTES && m_entries.size() > 1)
+    {
+        m_bytes -= m_entries.back().second->alpha.size();
+        m_index.erase(m_entries.back().first);
+        m_entries.pop_back();
+    }
+
+    return bitmap;
+}
+
+void SubtitleCache::clear()
+{
+    m_index.clear();
+    m_entries.clear();
+    m_bytes = 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A cue rendered once: 8 bit coverage, rows of width bytes
+struct SubtitleBitmap
+{
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> alpha;
+};
+
+// Rasterized cues kept for as long as they are shown and a while after, least recently used go first
+class SubtitleCache
+{
+public:
+    enum { MAX_BYTES = 32 * 1024 * 1024 };
+
+    struct Key
+    {
+        std::string text; // UTF-8
+        std::string style;
+        int width;        // output size
+        int height;
+
+        bool operator==(const Key& other) const
+        {
+            return width == other.width && height == other.height
+                && text == other.text && style == other.style;
+        }
+    };
+
+    typedef std::function<bool(const Key& key, SubtitleBitmap& bitmap)> Rasterizer;
+
+    explicit SubtitleCache(Rasterizer rasterizer) : m_rasterizer(std::move(rasterizer)) {}
+    SubtitleCache(const SubtitleCache&) = delete;
+    SubtitleCache& operator=(const SubtitleCache&) = delete;
+
+    // Rasterizes on a miss, returns null if that fails
+    std::shared_ptr<const SubtitleBitmap> get(const Key& key);
+    void clear();
+
+    size_t bytes() const { return m_bytes; }
+
+private:
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const;
+    };
+
+    typedef std::list<std::pair<Key, std::shared_ptr<const SubtitleBitmap>>> Entries;
+
+    Rasterizer m_rasterizer;
+    Entries m_entries; // most recently used first
+    std::unordered_map<Key, Entries::iterator, KeyHash> m_index;
+    size_t m_bytes = 0;
+};
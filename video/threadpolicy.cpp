@@ -0,0 +1,255 @@
+#include "threadpolicy.h"
+
+#include <boost/atomic.hpp>
+#include <boost/log/trivial.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <tlhelp32.h>
+#elif defined(__linux__)
+#include <dirent.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+boost::atomic<uint64_t> affinityMasks[THREAD_ROLE_COUNT];
+boost::atomic_bool failureReported[THREAD_ROLE_COUNT]; // threads restart on every seek
+
+#ifdef _WIN32
+
+// MMCSS registration of the audio thread by the audio player comes on top of this
+const int threadPriorities[THREAD_ROLE_COUNT] =
+{
+    THREAD_PRIORITY_TIME_CRITICAL,
+    THREAD_PRIORITY_ABOVE_NORMAL,
+    THREAD_PRIORITY_NORMAL,
+    THREAD_PRIORITY_BELOW_NORMAL,
+    THREAD_PRIORITY_LOWEST,
+};
+
+#elif defined(__linux__)
+
+struct SchedulingPolicy
+{
+    int policy;
+    int priority;
+    int niceness; // used when real-time scheduling is not permitted
+};
+
+const SchedulingPolicy schedulingPolicies[THREAD_ROLE_COUNT] =
+{
+    { SCHED_FIFO, 10, -10 },
+    { SCHED_FIFO, 5, -5 },
+    { SCHED_OTHER, 0, 0 },
+    { SCHED_BATCH, 0, 5 },
+    { SCHED_IDLE, 0, 19 },
+};
+
+#endif
+
+#ifdef _WIN32
+
+bool ApplyPolicy(ThreadRole role, HANDLE thread)
+{
+    bool result = true;
+    const uint64_t cpuMask = affinityMasks[role];
+    if (!SetThreadPriority(thread, threadPriorities[role]))
+    {
+        result = false;
+    }
+    if (cpuMask != 0 && SetThreadAffinityMask(thread, static_cast<DWORD_PTR>(cpuMask)) == 0)
+    {
+        result = false;
+    }
+    return result;
+}
+
+#elif defined(__linux__)
+
+// Scheduling calls take thread ids on Linux
+bool ApplyPolicy(ThreadRole role, pid_t thread)
+{
+    bool result = true;
+    const uint64_t cpuMask = affinityMasks[role];
+    const SchedulingPolicy& policy = schedulingPolicies[role];
+
+    sched_param param{};
+    param.sched_priority = policy.priority;
+    const bool realTime = sched_setscheduler(thread, policy.policy, &param) == 0;
+
+    // Niceness is per thread on Linux; lowering it may need privileges as well
+    if (!realTime || policy.policy != SCHED_FIFO)
+    {
+        if (!realTime)
+        {
+            param.sched_priority = 0;
+            sched_setscheduler(thread, SCHED_OTHER, &param);
+        }
+        if (setpriority(PRIO_PROCESS, static_cast<id_t>(thread), policy.niceness) != 0)
+        {
+            result = false;
+        }
+    }
+
+    if (cpuMask != 0)
+    {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        for (int i = 0; i < 64; ++i)
+        {
+            if ((cpuMask >> i) & 1)
+            {
+                CPU_SET(i, &cpuSet);
+            }
+        }
+        if (sched_setaffinity(thread, sizeof(cpuSet), &cpuSet) != 0)
+        {
+            result = false;
+        }
+    }
+    return result;
+}
+
+#endif
+
+void ReportFailure(ThreadRole role)
+{
+    if (!failureReported[role].exchange(true))
+    {
+        BOOST_LOG_TRIVIAL(warning) << "Unable to fully apply the scheduling policy of thread role " << role;
+    }
+}
+
+// Ids of the threads of this process
+std::vector<uint64_t> GetProcessThreads()
+{
+    std::vector<uint64_t> result;
+#ifdef _WIN32
+    const HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+    if (snapshot == INVALID_HANDLE_VALUE)
+    {
+        return result;
+    }
+    const DWORD processId = GetCurrentProcessId();
+    THREADENTRY32 entry{};
+    entry.dwSize = sizeof(entry);
+    for (BOOL ok = Thread32First(snapshot, &entry); ok; ok = Thread32Next(snapshot, &entry))
+    {
+        if (entry.th32OwnerProcessID == processId)
+        {
+            result.push_back(entry.th32ThreadID);
+        }
+    }
+    CloseHandle(snapshot);
+#elif defined(__linux__)
+    if (DIR* tasks = opendir("/proc/self/task"))
+    {
+        while (const dirent* entry = readdir(tasks))
+        {
+            if (entry->d_name[0] != '.')
+            {
+                result.push_back(strtoull(entry->d_name, nullptr, 10));
+            }
+        }
+        closedir(tasks);
+    }
+#endif
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+} // namespace
+
+void SetThreadRoleAffinity(ThreadRole role, uint64_t cpuMask)
+{
+    affinityMasks[role] = cpuMask;
+}
+
+bool ApplyThreadPolicy(ThreadRole role)
+{
+    const bool result =
+#ifdef _WIN32
+        ApplyPolicy(role, GetCurrentThread());
+#elif defined(__linux__)
+        ApplyPolicy(role, static_cast<pid_t>(syscall(SYS_gettid)));
+#else
+        false;
+#endif
+
+    if (!result)
+    {
+        ReportFailure(role);
+    }
+    return result;
+}
+
+ThreadPolicyForNewThreads::ThreadPolicyForNewThreads(ThreadRole role)
+    : m_role(role)
+    , m_threads(GetProcessThreads())
+{
+}
+
+ThreadPolicyForNewThreads::~ThreadPolicyForNewThreads()
+{
+    bool result = true;
+    for (uint64_t thread : GetProcessThreads())
+    {
+        if (std::binary_search(m_threads.begin(), m_threads.end(), thread))
+        {
+            continue;
+        }
+#ifdef _WIN32
+        const HANDLE handle = OpenThread(THREAD_SET_INFORMATION | THREAD_QUERY_INFORMATION,
+            FALSE, static_cast<DWORD>(thread));
+        if (handle == nullptr)
+        {
+            result = false;
+            continue;
+        }
+        result = ApplyPolicy(m_role, handle) && result;
+        CloseHandle(handle);
+#elif defined(__linux__)
+        result = ApplyPolicy(m_role, static_cast<pid_t>(thread)) && result;
+#else
+        result = false;
+#endif
+    }
+
+    if (!result)
+    {
+        ReportFailure(m_role);
+    }
+}
+
+double GetThreadCpuTime()
+{
+#ifdef _WIN32
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (!GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime))
+    {
+        return 0;
+    }
+    const auto ticks = [](const FILETIME& time) {
+        return (uint64_t(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+    };
+    return (ticks(kernelTime) + ticks(userTime)) / 10000000.; // 100 ns units
+#elif defined(__linux__)
+    timespec time{};
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0)
+    {
+        return 0;
+    }
+    return time.tv_sec + time.tv_nsec / 1000000000.;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Scheduling classes of the decoder threads, from the most to the least latency sensitive
+enum ThreadRole
+{
+    THREAD_ROLE_AUDIO,      // real-time where permitted
+    THREAD_ROLE_DISPLAY,    // elevated
+    THREAD_ROLE_DEMUX,      // normal
+    THREAD_ROLE_DECODE,     // batch, gives way to the above
+    THREAD_ROLE_BACKGROUND, // idle
+
+    THREAD_ROLE_COUNT
+};
+
+// Pins threads of the role started afterwards to the cores set in cpuMask, 0 lifts the pinning.
+// Buffers are allocated by the threads that fill them, so pinned threads get NUMA local memory.
+void SetThreadRoleAffinity(ThreadRole role, uint64_t cpuMask);
+
+// Applies the priority and affinity of the role to the calling thread
+bool ApplyThreadPolicy(ThreadRole role);
+
+// Applies the role to the threads started while it lives, such as the frame threads libavcodec starts
+// in avcodec_open2(). Threads started elsewhere in the process meanwhile get it as well.
+class ThreadPolicyForNewThreads
+{
+public:
+    explicit ThreadPolicyForNewThreads(ThreadRole role);
+    ~ThreadPolicyForNewThreads();
+
+    ThreadPolicyForNewThreads(const ThreadPolicyForNewThreads&) = delete;
+    ThreadPolicyForNewThreads& operator=(const ThreadPolicyForNewThreads&) = delete;
+
+private:
+    ThreadRole m_role;
+    std::vector<uint64_t> m_threads; // sorted
+};
+
+// CPU time consumed so far by the calling thread, in seconds
+double GetThreadCpuTime();
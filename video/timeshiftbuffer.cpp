@@ -0,0 +1,229 @@
+#include "timeshiftbuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <boost/log/trivial.hpp>
+
+TimeshiftBuffer::TimeshiftBuffer(int64_t capacity)
+    : m_capacity(capacity)
+{
+    m_pending.reserve(WRITE_BATCH_SIZE);
+}
+
+TimeshiftBuffer::~TimeshiftBuffer()
+{
+    if (m_file != nullptr)
+    {
+        fclose(m_file);
+    }
+}
+
+bool TimeshiftBuffer::open()
+{
+    m_file = tmpfile(); // removed by the system once closed
+    if (m_file == nullptr)
+    {
+        BOOST_LOG_TRIVIAL(error) << "Unable to create timeshift file";
+        return false;
+    }
+
+    // Reserve the whole ring up front so recording never grows the file
+    if (fseek(m_file, static_cast<long>(m_capacity - 1), SEEK_SET) != 0
+        || fputc(0, m_file) == EOF || fflush(m_file) != 0)
+    {
+        BOOST_LOG_TRIVIAL(error) << "Unable to preallocate timeshift file";
+        fclose(m_file);
+        m_file = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+void TimeshiftBuffer::write(const AVPacket& packet, int64_t time, bool seekPoint)
+{
+    if (packet.size <= 0 || packet.size > m_capacity)
+    {
+        return;
+    }
+
+    {
+        boost::lock_guard<boost::mutex> locker(m_mutex);
+
+        int64_t offset = m_pendingOffset + m_pending.size();
+        if (offset + packet.size > m_capacity)
+        {
+            // Records never straddle the end of the ring
+            flush();
+
+            // What the previous lap left past this point goes first, the overlap check would stop at it
+            while (!m_index.empty() && m_index.front().offset >= offset)
+            {
+                m_index.pop_front();
+                ++m_firstSeq;
+            }
+
+            m_pendingOffset = 0;
+            offset = 0;
+        }
+
+        evict(offset, packet.size);
+
+        if (!m_index.empty())
+        {
+            time = std::max(time, m_index.back().time);
+        }
+        m_index.push_back({ offset, packet.size, packet.stream_index, packet.flags,
+            packet.pts, packet.dts, packet.duration, time, seekPoint });
+
+        if (packet.size > WRITE_BATCH_SIZE)
+        {
+            // Too big to batch, goes to the file as is
+            flush();
+            writeFile(offset, packet.data, packet.size);
+            m_pendingOffset = offset + packet.size;
+            m_pendingSeq = m_firstSeq + m_index.size();
+        }
+        else
+        {
+            m_pending.insert(m_pending.end(), packet.data, packet.data + packet.size);
+
+            if (m_pending.size() >= WRITE_BATCH_SIZE)
+            {
+                flush();
+            }
+        }
+    }
+    m_condVar.notify_all();
+}
+
+void TimeshiftBuffer::finish()
+{
+    {
+        boost::lock_guard<boost::mutex> locker(m_mutex);
+        flush();
+        m_finished = true;
+    }
+    m_condVar.notify_all();
+}
+
+int TimeshiftBuffer::read(AVPacket& packet)
+{
+    boost::unique_lock<boost::mutex> locker(m_mutex);
+
+    const int64_t endSeq = m_firstSeq + m_index.size();
+    if (m_readSeq >= endSeq)
+    {
+        if (m_finished)
+        {
+            return AVERROR_EOF;
+        }
+        m_condVar.wait_for(locker, boost::chrono::milliseconds(10));
+        return AVERROR(EAGAIN);
+    }
+
+    if (m_readSeq < m_firstSeq)
+    {
+        // Playback fell out of the window, continue from its oldest part
+        m_readSeq = m_firstSeq;
+    }
+
+    const Entry& entry = m_index[static_cast<size_t>(m_readSeq - m_firstSeq)];
+
+    if (av_new_packet(&packet, entry.size) < 0)
+    {
+        return AVERROR(ENOMEM);
+    }
+
+    if (m_readSeq >= m_pendingSeq)
+    {
+        memcpy(packet.data, m_pending.data() + (entry.offset - m_pendingOffset), entry.size);
+    }
+    else if (fseek(m_file, static_cast<long>(entry.offset), SEEK_SET) != 0
+        || fread(packet.data, 1, entry.size, m_file) != static_cast<size_t>(entry.size))
+    {
+        av_packet_unref(&packet);
+        return AVERROR(EIO);
+    }
+
+    packet.stream_index = entry.streamIndex;
+    packet.flags = entry.flags;
+    packet.pts = entry.pts;
+    packet.dts = entry.dts;
+    packet.duration = entry.duration;
+
+    ++m_readSeq;
+
+    return 0;
+}
+
+bool TimeshiftBuffer::seek(int64_t time)
+{
+    boost::lock_guard<boost::mutex> locker(m_mutex);
+
+    // Latest seek point not after the target
+    auto it = std::upper_bound(m_index.begin(), m_index.end(), time,
+        [](int64_t t, const Entry& entry) { return t < entry.time; });
+    while (it != m_index.begin())
+    {
+        --it;
+        if (it->seekPoint)
+        {
+            m_readSeq = m_firstSeq + (it - m_index.begin());
+            return true;
+        }
+    }
+
+    // Before the window: start from the oldest seek point
+    it = std::find_if(m_index.begin(), m_index.end(), [](const Entry& entry) { return entry.seekPoint; });
+    if (it == m_index.end())
+    {
+        return false;
+    }
+    m_readSeq = m_firstSeq + (it - m_index.begin());
+    return true;
+}
+
+bool TimeshiftBuffer::getWindow(int64_t& first, int64_t& last)
+{
+    boost::lock_guard<boost::mutex> locker(m_mutex);
+    if (m_index.empty())
+    {
+        return false;
+    }
+    first = m_index.front().time;
+    last = m_index.back().time;
+    return true;
+}
+
+void TimeshiftBuffer::flush()
+{
+    if (!m_pending.empty())
+    {
+        writeFile(m_pendingOffset, m_pending.data(), m_pending.size());
+        m_pendingOffset += m_pending.size();
+        m_pending.clear();
+    }
+    m_pendingSeq = m_firstSeq + m_index.size();
+}
+
+void TimeshiftBuffer::writeFile(int64_t offset, const uint8_t* data, size_t size)
+{
+    if (fseek(m_file, static_cast<long>(offset), SEEK_SET) != 0
+        || fwrite(data, 1, size, m_file) != size)
+    {
+        BOOST_LOG_TRIVIAL(error) << "Timeshift file write failed";
+    }
+}
+
+void TimeshiftBuffer::evict(int64_t offset, int64_t size)
+{
+    while (!m_index.empty()
+        && m_index.front().offset < offset + size
+        && m_index.front().offset + m_index.front().size > offset)
+    {
+        m_index.pop_front();
+        ++m_firstSeq;
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <boost/thread/thread.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <vector>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+// Packets of a live stream spooled into a preallocated ring file, so playback can lag behind recording
+class TimeshiftBuffer
+{
+public:
+    explicit TimeshiftBuffer(int64_t capacity);
+    ~TimeshiftBuffer();
+    TimeshiftBuffer(const TimeshiftBuffer&) = delete;
+    TimeshiftBuffer& operator=(const TimeshiftBuffer&) = delete;
+
+    bool open();
+
+    // Recording side; time is in units of the decoder's time stream. It is kept from going back,
+    // seek() searches the index by it.
+    void write(const AVPacket& packet, int64_t time, bool seekPoint);
+    void finish();
+
+    // Playback side: returns 0, AVERROR(EAGAIN) or AVERROR_EOF
+    int read(AVPacket& packet);
+    bool seek(int64_t time);
+
+    bool getWindow(int64_t& first, int64_t& last);
+
+private:
+    struct Entry
+    {
+        int64_t offset;
+        int size;
+        int streamIndex;
+        int flags;
+        int64_t pts;
+        int64_t dts;
+        int64_t duration;
+        int64_t time;
+        bool seekPoint;
+    };
+
+    void flush();
+    void writeFile(int64_t offset, const uint8_t* data, size_t size);
+    void evict(int64_t offset, int64_t size);
+
+    enum { WRITE_BATCH_SIZE = 1024 * 1024 };
+
+    const int64_t m_capacity;
+    FILE* m_file = nullptr;
+
+    boost::mutex m_mutex;
+    boost::condition_variable m_condVar;
+
+    std::deque<Entry> m_index;
+    int64_t m_firstSeq = 0; // sequence number of m_index.front()
+    int64_t m_readSeq = 0;
+    bool m_finished = false;
+
+    // Records not yet on disk, they follow m_pendingOffset contiguously
+    std::vector<uint8_t> m_pending;
+    int64_t m_pendingOffset = 0;
+    int64_t m_pendingSeq = 0;
+};
@@ -0,0 +1,200 @@
+#include "timesource.h"
+
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+
+namespace {
+
+// How soon a waiter notices it is due or its predicate holds; the simulated timeline does not depend on it
+const auto SIMULATED_POLL_INTERVAL = boost::chrono::milliseconds(1);
+
+class SystemTimeSource : public ITimeSource
+{
+public:
+    TimePoint now() override
+    {
+        return boost::chrono::high_resolution_clock::now();
+    }
+
+    void sleepFor(Duration duration) override
+    {
+        boost::this_thread::sleep_for(duration);
+    }
+
+    bool waitFor(boost::condition_variable& condVar, boost::unique_lock<boost::mutex>& locker,
+        Duration timeout, const std::function<bool()>& predicate) override
+    {
+        if (timeout == Duration::max())
+        {
+            condVar.wait(locker, predicate);
+            return true;
+        }
+        return condVar.wait_for(locker, timeout, predicate);
+    }
+};
+
+} // namespace
+
+std::shared_ptr<ITimeSource> GetSystemTimeSource()
+{
+    static const auto timeSource = std::make_shared<SystemTimeSource>();
+    return timeSource;
+}
+
+ITimeSource::TimePoint SimulatedTimeSource::now()
+{
+    return TimePoint(m_time.load());
+}
+
+void SimulatedTimeSource::sleepFor(Duration duration)
+{
+    boost::this_thread::interruption_point();
+    if (duration <= Duration::zero())
+    {
+        return;
+    }
+
+    Waiter waiter{ m_time.load() + duration, nullptr, 0, false };
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    enter(waiter);
+    try
+    {
+        while (!waiter.released)
+        {
+            m_condVar.wait(lock);
+        }
+    }
+    catch (const boost::thread_interrupted&)
+    {
+        leave(waiter);
+        throw;
+    }
+}
+
+bool SimulatedTimeSource::waitFor(boost::condition_variable& condVar, boost::unique_lock<boost::mutex>& locker,
+    Duration timeout, const std::function<bool()>& predicate)
+{
+    if (predicate())
+    {
+        return true;
+    }
+
+    // The predicate is checked holding the locker, so whoever changes its state either did it before
+    // or arrives here afterwards, making it checked once more before the clock moves
+    Waiter waiter{ (timeout == Duration::max()) ? timeout : m_time.load() + timeout, &condVar, 0, false };
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        enter(waiter);
+    }
+    try
+    {
+        for (;;)
+        {
+            condVar.wait_for(locker, SIMULATED_POLL_INTERVAL);
+            const bool satisfied = predicate();
+
+            boost::lock_guard<boost::mutex> lock(m_mutex);
+            if (waiter.released || satisfied)
+            {
+                leave(waiter);
+                return satisfied;
+            }
+            waiter.checkedEpoch = m_epoch;
+            tryAdvance();
+        }
+    }
+    catch (const boost::thread_interrupted&)
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        leave(waiter);
+        throw;
+    }
+}
+
+void SimulatedTimeSource::setParticipants(int participants)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_participants = participants;
+}
+
+void SimulatedTimeSource::advance(Duration duration)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_time = m_time.load() + duration;
+    releaseDue();
+}
+
+void SimulatedTimeSource::enter(Waiter& waiter)
+{
+    m_waiters.push_back(&waiter);
+    waiter.checkedEpoch = ++m_epoch;
+    for (Waiter* other : m_waiters)
+    {
+        if (other->condVar != nullptr && other != &waiter)
+        {
+            other->condVar->notify_all();
+        }
+    }
+    tryAdvance();
+}
+
+void SimulatedTimeSource::leave(Waiter& waiter)
+{
+    if (!waiter.released)
+    {
+        m_waiters.erase(std::find(m_waiters.begin(), m_waiters.end(), &waiter));
+        waiter.released = true;
+    }
+}
+
+void SimulatedTimeSource::tryAdvance()
+{
+    if (static_cast<int>(m_waiters.size()) < m_participants)
+    {
+        return;
+    }
+
+    Duration next = Duration::max();
+    for (const Waiter* waiter : m_waiters)
+    {
+        if (waiter->condVar != nullptr && waiter->checkedEpoch != m_epoch)
+        {
+            return; // its predicate may hold by now
+        }
+        next = std::min(next, waiter->deadline);
+    }
+    if (next == Duration::max())
+    {
+        return; // all wait for each other, no amount of time helps
+    }
+
+    if (next > m_time.load())
+    {
+        m_time = next;
+    }
+    releaseDue();
+}
+
+void SimulatedTimeSource::releaseDue()
+{
+    // Released ones count as running right away, the clock cannot move on before they have had their turn
+    const Duration time = m_time.load();
+    for (auto it = m_waiters.begin(); it != m_waiters.end();)
+    {
+        Waiter* waiter = *it;
+        if (waiter->deadline > time)
+        {
+            ++it;
+            continue;
+        }
+        waiter->released = true;
+        it = m_waiters.erase(it);
+        if (waiter->condVar != nullptr)
+        {
+            waiter->condVar->notify_all();
+        }
+    }
+    m_condVar.notify_all();
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Clock and sleeping the playback pacing goes through
+struct ITimeSource
+{
+    typedef boost::chrono::high_resolution_clock::duration Duration;
+    typedef boost::chrono::high_resolution_clock::time_point TimePoint;
+
+    virtual ~ITimeSource() = default;
+
+    virtual TimePoint now() = 0;
+    // Interruption point, like boost::this_thread::sleep_for()
+    virtual void sleepFor(Duration duration) = 0;
+    // Returns the predicate; Duration::max() waits for it without a timeout
+    virtual bool waitFor(boost::condition_variable& condVar, boost::unique_lock<boost::mutex>& locker,
+        Duration timeout, const std::function<bool()>& predicate) = 0;
+};
+
+// Real time, shared by default
+std::shared_ptr<ITimeSource> GetSystemTimeSource();
+
+// Time stands still while any of the participants runs. Once all of them wait in here it jumps straight to the
+// earliest wake up time, so pacing logic runs as fast as the CPU allows and sees the same timeline on every run.
+// A participant blocked elsewhere, on a queue say, holds the clock until it comes back.
+class SimulatedTimeSource : public ITimeSource
+{
+public:
+    // The threads pacing playback, plus whoever drives the simulation by sleeping in it
+    explicit SimulatedTimeSource(int participants = 1) : m_participants(participants) {}
+
+    TimePoint now() override;
+    void sleepFor(Duration duration) override;
+    bool waitFor(boost::condition_variable& condVar, boost::unique_lock<boost::mutex>& locker,
+        Duration timeout, const std::function<bool()>& predicate) override;
+
+    // Before the participants start waiting
+    void setParticipants(int participants);
+
+    // Moves the clock on regardless of the participants
+    void advance(Duration duration);
+
+private:
+    struct Waiter
+    {
+        Duration deadline;
+        boost::condition_variable* condVar; // of waitFor(), to have the predicate checked again
+        unsigned int checkedEpoch;          // predicate found false with nobody arriving since
+        bool released;
+    };
+
+    void enter(Waiter& waiter);
+    void leave(Waiter& waiter);
+    void tryAdvance();
+    void releaseDue();
+
+    boost::mutex m_mutex;
+    boost::condition_variable m_condVar;
+    std::vector<Waiter*> m_waiters;
+    int m_participants;
+    unsigned int m_epoch = 0; // bumped on every arrival, state the predicates depend on may have changed
+    boost::atomic<Duration> m_time{ Duration::zero() }; // since the epoch of the simulation
+};
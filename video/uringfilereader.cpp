@@ -0,0 +1,282 @@
+#include "uringfilereader.h"
+
+#ifdef USE_IO_URING
+
+#include <boost/log/trivial.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Completions of cancel requests carry this instead of a slot index
+const uintptr_t CANCEL_TAG = ~uintptr_t();
+
+} // namespace
+
+// static
+std::unique_ptr<UringFileReader> UringFileReader::Open(const PathType& path)
+{
+    std::unique_ptr<UringFileReader> result(new UringFileReader());
+
+    result->m_fd = open(path.c_str(), O_RDONLY);
+    if (result->m_fd < 0)
+    {
+        return nullptr;
+    }
+
+    struct stat status;
+    if (fstat(result->m_fd, &status) != 0)
+    {
+        return nullptr;
+    }
+    result->m_size = status.st_size;
+
+    // Room for a cancel next to every read
+    if (io_uring_queue_init(QUEUE_DEPTH * 2, &result->m_ring, 0) != 0)
+    {
+        return nullptr;
+    }
+    result->m_ringInitialized = true;
+
+    for (auto& slot : result->m_slots)
+    {
+        slot.data = static_cast<uint8_t*>(malloc(CHUNK_SIZE));
+        if (slot.data == nullptr)
+        {
+            return nullptr;
+        }
+    }
+
+    result->fill();
+    return result;
+}
+
+UringFileReader::~UringFileReader()
+{
+    if (m_ringInitialized)
+    {
+        // The kernel writes into the buffers until the reads complete
+        restart(m_size);
+        while (std::any_of(std::begin(m_slots), std::end(m_slots),
+            [](const Slot& slot) { return slot.inFlight; }))
+        {
+            reap(true);
+        }
+        io_uring_queue_exit(&m_ring);
+    }
+
+    for (auto& slot : m_slots)
+    {
+        free(slot.data);
+    }
+
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+    }
+}
+
+int UringFileReader::read(uint8_t* buf, int size)
+{
+    for (;;)
+    {
+        if (m_position >= m_size)
+        {
+            return 0;
+        }
+
+        Slot* slot = find(m_position);
+        if (slot == nullptr)
+        {
+            restart(m_position);
+            continue;
+        }
+        if (slot->inFlight)
+        {
+            reap(true);
+            continue;
+        }
+        if (slot->length < 0)
+        {
+            BOOST_LOG_TRIVIAL(error) << "io_uring read failed at " << slot->offset
+                << ": " << strerror(-slot->length);
+            slot->offset = -1; // requested again by the next read
+            return -1;
+        }
+        if (slot->length == 0)
+        {
+            // The file got shorter since it was opened, requesting it again would not get further
+            m_size = m_position;
+            return 0;
+        }
+
+        const int64_t offsetInChunk = m_position - slot->offset;
+        const int length = static_cast<int>(std::min<int64_t>(size, slot->length - offsetInChunk));
+        memcpy(buf, slot->data + offsetInChunk, length);
+        m_position += length;
+
+        reap(false);
+        fill();
+        return length;
+    }
+}
+
+int64_t UringFileReader::seek(int64_t position)
+{
+    if (position < 0 || position > m_size)
+    {
+        return -1;
+    }
+    m_position = position;
+
+    // Requests for where the demuxer no longer goes only hold up the queue
+    if (position < m_size && find(position) == nullptr)
+    {
+        restart(position);
+    }
+    return position;
+}
+
+std::string UringFileReader::describe() const
+{
+    char buffer[100];
+    snprintf(buffer, sizeof(buffer), "io_uring: %d x %d KB ahead, %lld reads, %lld restarts",
+        int(QUEUE_DEPTH), int(CHUNK_SIZE / 1024), static_cast<long long>(m_reads),
+        static_cast<long long>(m_restarts));
+    return buffer;
+}
+
+UringFileReader::Slot* UringFileReader::find(int64_t position)
+{
+    for (auto& slot : m_slots)
+    {
+        if (slot.stale || slot.offset < 0 || position < slot.offset)
+        {
+            continue;
+        }
+        // A short read leaves a gap that no request covers; an empty one marks the end of the file
+        const int64_t end = slot.offset + (slot.inFlight ? CHUNK_SIZE : slot.length);
+        if (position < end || !slot.inFlight && slot.length == 0 && position == slot.offset)
+        {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+UringFileReader::Slot* UringFileReader::freeSlot()
+{
+    for (auto& slot : m_slots)
+    {
+        if (!slot.inFlight && (slot.offset < 0 || slot.offset + std::max(slot.length, 0) <= m_position))
+        {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+void UringFileReader::fill()
+{
+    bool submitted = false;
+    while (m_readAheadOffset < m_size)
+    {
+        Slot* slot = freeSlot();
+        io_uring_sqe* sqe = (slot != nullptr) ? io_uring_get_sqe(&m_ring) : nullptr;
+        if (sqe == nullptr)
+        {
+            break;
+        }
+
+        io_uring_prep_read(sqe, m_fd, slot->data, CHUNK_SIZE, m_readAheadOffset);
+        io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(static_cast<uintptr_t>(slot - m_slots)));
+
+        slot->offset = m_readAheadOffset;
+        slot->length = 0;
+        slot->inFlight = true;
+        m_readAheadOffset += CHUNK_SIZE;
+        ++m_reads;
+        submitted = true;
+    }
+
+    if (submitted)
+    {
+        io_uring_submit(&m_ring);
+    }
+}
+
+void UringFileReader::restart(int64_t position)
+{
+    ++m_restarts;
+
+    for (auto& slot : m_slots)
+    {
+        if (slot.inFlight)
+        {
+            if (!slot.stale)
+            {
+                slot.stale = true;
+                if (io_uring_sqe* sqe = io_uring_get_sqe(&m_ring))
+                {
+                    io_uring_prep_cancel(sqe, reinterpret_cast<void*>(static_cast<uintptr_t>(&slot - m_slots)), 0);
+                    io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(CANCEL_TAG));
+                }
+            }
+        }
+        else
+        {
+            slot.offset = -1;
+        }
+    }
+    io_uring_submit(&m_ring);
+
+    m_readAheadOffset = position;
+    if (position >= m_size)
+    {
+        return;
+    }
+
+    // The chunk at the position has to be requested before read() looks for it again
+    while (freeSlot() == nullptr)
+    {
+        reap(true);
+    }
+    fill();
+}
+
+void UringFileReader::reap(bool wait)
+{
+    io_uring_cqe* cqe = nullptr;
+    int ret = wait ? io_uring_wait_cqe(&m_ring, &cqe) : io_uring_peek_cqe(&m_ring, &cqe);
+    while (ret == 0 && cqe != nullptr)
+    {
+        const auto tag = reinterpret_cast<uintptr_t>(io_uring_cqe_get_data(cqe));
+        if (tag != CANCEL_TAG && tag < QUEUE_DEPTH)
+        {
+            Slot& slot = m_slots[tag];
+            slot.inFlight = false;
+            if (slot.stale)
+            {
+                slot.stale = false;
+                slot.offset = -1;
+            }
+            else
+            {
+                slot.length = cqe->res;
+            }
+        }
+        io_uring_cqe_seen(&m_ring, cqe);
+
+        ret = io_uring_peek_cqe(&m_ring, &cqe);
+    }
+}
+
+#endif // USE_IO_URING
@@ -0,0 +1,73 @@
+#pragma once
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<liburing.h>)
+#define USE_IO_URING
+#endif
+#endif
+
+#ifdef USE_IO_URING
+
+#include "filereader.h"
+
+#include <liburing.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Keeps QUEUE_DEPTH reads in flight ahead of the demuxer, a seek out of reach cancels them
+class UringFileReader : public FileReader
+{
+public:
+    enum { QUEUE_DEPTH = 8 };
+    enum { CHUNK_SIZE = 256 * 1024 };
+
+    // Null if the kernel has no io_uring
+    static std::unique_ptr<UringFileReader> Open(const PathType& path);
+
+    ~UringFileReader() override;
+    UringFileReader(const UringFileReader&) = delete;
+    UringFileReader& operator=(const UringFileReader&) = delete;
+
+    int read(uint8_t* buf, int size) override;
+    int64_t seek(int64_t position) override;
+
+    int64_t tell() const override { return m_position; }
+    int64_t size() const override { return m_size; }
+
+    std::string describe() const override;
+
+private:
+    struct Slot
+    {
+        uint8_t* data = nullptr;
+        int64_t offset = -1; // -1 when free
+        int length = 0;      // result of the read once completed
+        bool inFlight = false;
+        bool stale = false;  // cancelled, freed on completion
+    };
+
+    UringFileReader() = default;
+
+    Slot* find(int64_t position);
+    Slot* freeSlot();
+    void fill();
+    void restart(int64_t position);
+    void reap(bool wait);
+
+    int m_fd = -1;
+    io_uring m_ring;
+    bool m_ringInitialized = false;
+
+    int64_t m_size = 0;
+    int64_t m_position = 0;
+    int64_t m_readAheadOffset = 0; // next chunk to request
+
+    Slot m_slots[QUEUE_DEPTH];
+
+    int64_t m_reads = 0;
+    int64_t m_restarts = 0;
+};
+
+#endif // USE_IO_URING
@@ -0,0 +1,20 @@
+#include "utf8.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+std::string ToUtf8(const PathType& path)
+{
+#ifdef _WIN32
+    const int size = WideCharToMultiByte(
+        CP_UTF8, 0, path.c_str(), static_cast<int>(path.size()), nullptr, 0, nullptr, nullptr);
+    std::string result(size, '\0');
+    WideCharToMultiByte(
+        CP_UTF8, 0, path.c_str(), static_cast<int>(path.size()), &result[0], size, nullptr, nullptr);
+    return result;
+#else
+    return path;
+#endif
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "decoderinterface.h"
+
+#include <string>
+
+// The file protocol takes UTF-8 names on every platform
+std::string ToUtf8(const PathType& path);
@@ -0,0 +1,251 @@
+#include "ffmpegdecoder.h"
+#include "makeguard.h"
+#include "interlockedadd.h"
+
+#include <boost/log/trivial.hpp>
+
+#include <cmath>
+#include <cstdio>
+
+extern "C"
+{
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavutil/opt.h>
+}
+
+void FFmpegDecoder::videoFilterRunnable()
+{
+    CHANNEL_LOG(ffmpeg_threads) << "Video filter thread started";
+    ApplyThreadPolicy(THREAD_ROLE_DECODE);
+
+    VideoParseContext context{};
+
+    for (;;)
+    {
+        if (m_isPaused && !m_isVideoSeekingWhilePaused)
+        {
+            boost::unique_lock<boost::mutex> locker(m_isPausedMutex);
+            while (m_isPaused && !m_isVideoSeekingWhilePaused)
+            {
+                m_isPausedCV.wait(locker);
+            }
+        }
+
+        for (;;)
+        {
+            AVFramePtr frame;
+            if (!m_videoFilterQueue.pop(frame,
+                [this] { return m_isPaused && !m_isVideoSeekingWhilePaused; }))
+            {
+                break;
+            }
+
+            if (frame->data[0] == nullptr)
+            {
+                // Loop marker passed on by the decoding thread
+                drainVideoFilter(context);
+                startLoopLap(context);
+                continue;
+            }
+
+            if (!filterVideoFrame(frame, context)
+                || m_isPaused && !m_isVideoSeekingWhilePaused)
+            {
+                break;
+            }
+        }
+    }
+}
+
+bool FFmpegDecoder::filterVideoFrame(
+    AVFramePtr& frame,
+    VideoParseContext& context)
+{
+    if (!configureVideoFilter(frame.get()))
+    {
+        // Show it as is rather than lose the picture
+        const double pts = (frame->pts != AV_NOPTS_VALUE)
+            ? frame->pts * av_q2d(m_videoStream->time_base) : 0;
+        frame->best_effort_timestamp = frame->pts;
+        return handleVideoFrame(frame, pts, context);
+    }
+
+    const auto startTime = boost::chrono::high_resolution_clock::now();
+    const int ret = av_buffersrc_add_frame_flags(m_videoFilterSource, frame.get(), 0);
+    InterlockedAdd(m_videoFilterTime, boost::chrono::duration_cast<boost::chrono::microseconds>(
+        boost::chrono::high_resolution_clock::now() - startTime).count() / 1000000.);
+
+    if (ret < 0)
+    {
+        BOOST_LOG_TRIVIAL(error) << "av_buffersrc_add_frame_flags() failed";
+        return true;
+    }
+
+    return receiveFilteredFrames(context);
+}
+
+bool FFmpegDecoder::receiveFilteredFrames(VideoParseContext& context)
+{
+    const AVRational timeBase = av_buffersink_get_time_base(m_videoFilterSink);
+
+    for (;;)
+    {
+        const auto startTime = boost::chrono::high_resolution_clock::now();
+
+        AVFramePtr filtered(av_frame_alloc());
+        const int ret = av_buffersink_get_frame(m_videoFilterSink, filtered.get());
+
+        // Time spent displaying frames is not the graph's
+        InterlockedAdd(m_videoFilterTime, boost::chrono::duration_cast<boost::chrono::microseconds>(
+            boost::chrono::high_resolution_clock::now() - startTime).count() / 1000000.);
+
+        if (ret < 0)
+        {
+            return true; // AVERROR(EAGAIN) or AVERROR_EOF
+        }
+
+        ++m_videoFilterFrames;
+
+        double pts = 0;
+        if (filtered->pts != AV_NOPTS_VALUE)
+        {
+            pts = filtered->pts * av_q2d(timeBase);
+            filtered->best_effort_timestamp
+                = av_rescale_q(filtered->pts, timeBase, m_videoStream->time_base);
+        }
+        else
+        {
+            filtered->best_effort_timestamp = AV_NOPTS_VALUE;
+        }
+
+        if (!handleVideoFrame(filtered, pts, context))
+        {
+            return false;
+        }
+    }
+}
+
+void FFmpegDecoder::drainVideoFilter(VideoParseContext& context)
+{
+    if (m_videoFilterGraph == nullptr)
+    {
+        return;
+    }
+
+    // A graph that has seen EOF cannot be fed again, the next frame builds a new one
+    if (av_buffersrc_add_frame_flags(m_videoFilterSource, nullptr, 0) >= 0)
+    {
+        receiveFilteredFrames(context);
+    }
+    freeVideoFilter();
+}
+
+bool FFmpegDecoder::configureVideoFilter(const AVFrame* frame)
+{
+    if ((m_videoFilterGraph != nullptr || m_videoFilterFailed)
+        && frame->width == m_videoFilterInput.width
+        && frame->height == m_videoFilterInput.height
+        && frame->format == m_videoFilterInput.format
+        && av_cmp_q(frame->sample_aspect_ratio, m_videoFilterInput.sampleAspectRatio) == 0)
+    {
+        // A graph that failed to build for this input is not parsed again frame after frame
+        return !m_videoFilterFailed;
+    }
+
+    // Only the graph is rebuilt on input change, decoding goes on undisturbed
+    if (m_videoFilterGraph != nullptr)
+    {
+        CHANNEL_LOG(ffmpeg_opening) << "Reconfiguring video filter graph for "
+            << frame->width << 'x' << frame->height;
+    }
+
+    freeVideoFilter();
+
+    m_videoFilterInput = { frame->width, frame->height, frame->format, frame->sample_aspect_ratio };
+    m_videoFilterFailed = true; // until the graph is up
+
+    m_videoFilterGraph = avfilter_graph_alloc();
+    if (m_videoFilterGraph == nullptr)
+    {
+        return false;
+    }
+
+    auto graphGuard = MakeGuard(this, std::mem_fn(&FFmpegDecoder::freeVideoFilter));
+
+    const AVRational sampleAspectRatio = (frame->sample_aspect_ratio.num != 0)
+        ? frame->sample_aspect_ratio : AVRational{ 1, 1 };
+
+    char args[512];
+    snprintf(args, sizeof(args),
+        "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d",
+        frame->width, frame->height, frame->format,
+        m_videoStream->time_base.num, m_videoStream->time_base.den,
+        sampleAspectRatio.num, sampleAspectRatio.den);
+
+    if (avfilter_graph_create_filter(&m_videoFilterSource, avfilter_get_by_name("buffer"),
+            "in", args, nullptr, m_videoFilterGraph) < 0
+        || avfilter_graph_create_filter(&m_videoFilterSink, avfilter_get_by_name("buffersink"),
+            "out", nullptr, nullptr, m_videoFilterGraph) < 0)
+    {
+        BOOST_LOG_TRIVIAL(error) << "Unable to create video filter graph endpoints";
+        return false;
+    }
+
+    // Let the graph do the pixel format conversion as well
+    const AVPixelFormat pixelFormats[] = { m_pixelFormat, AV_PIX_FMT_NONE };
+    if (av_opt_set_int_list(m_videoFilterSink, "pix_fmts", pixelFormats,
+            AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN) < 0)
+    {
+        return false;
+    }
+
+    AVFilterInOut* outputs = avfilter_inout_alloc();
+    AVFilterInOut* inputs = avfilter_inout_alloc();
+    auto outputsGuard = MakeGuard(&outputs, avfilter_inout_free);
+    auto inputsGuard = MakeGuard(&inputs, avfilter_inout_free);
+    if (outputs == nullptr || inputs == nullptr)
+    {
+        return false;
+    }
+
+    outputs->name = av_strdup("in");
+    outputs->filter_ctx = m_videoFilterSource;
+    outputs->pad_idx = 0;
+    outputs->next = nullptr;
+
+    inputs->name = av_strdup("out");
+    inputs->filter_ctx = m_videoFilterSink;
+    inputs->pad_idx = 0;
+    inputs->next = nullptr;
+
+    if (avfilter_graph_parse_ptr(m_videoFilterGraph, m_videoFilterGraphDescription.c_str(),
+            &inputs, &outputs, nullptr) < 0
+        || avfilter_graph_config(m_videoFilterGraph, nullptr) < 0)
+    {
+        BOOST_LOG_TRIVIAL(error) << "Unable to configure video filter graph \""
+            << m_videoFilterGraphDescription << '"';
+        return false;
+    }
+
+    graphGuard.release();
+    m_videoFilterFailed = false;
+
+    return true;
+}
+
+void FFmpegDecoder::freeVideoFilter()
+{
+    avfilter_graph_free(&m_videoFilterGraph);
+    m_videoFilterSource = nullptr;
+    m_videoFilterSink = nullptr;
+}
+
+void FFmpegDecoder::startVideoFilterThread()
+{
+    if (m_videoStreamNumber >= 0 && !m_videoFilterGraphDescription.empty())
+    {
+        boost::lock_guard<boost::mutex> locker(m_threadsMutex);
+        m_mainVideoFilterThread = std::make_unique<boost::thread>(&FFmpegDecoder::videoFilterRunnable, this);
+    }
+}
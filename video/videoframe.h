@@ -2,6 +2,8 @@
 
 #include <memory>
 
+struct SwsContext;
+
 struct AVFrameDeleter
 {
     void operator()(AVFrame *frame) const { av_frame_free(&frame); };
@@ -35,7 +37,14 @@ struct VideoFrame
             m_image->format = pix_fmt;
             m_image->width = width;
             m_image->height = height;
-            av_frame_get_buffer(m_image.get(), 16);
+            av_frame_get_buffer(m_image.get(), 64);
         }
     }
 };
+
+// Hands the decoded frame over if it is in the wanted format already, converts it into videoFrameData otherwise
+bool frameToImage(
+    VideoFrame& videoFrameData,
+    AVFramePtr& videoFrame,
+    SwsContext*& imageCovertContext,
+    AVPixelFormat pixelFormat);
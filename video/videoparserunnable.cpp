@@ -1,12 +1,11 @@
 #include "ffmpegdecoder.h"
 #include "makeguard.h"
 #include "interlockedadd.h"
+#include "steadytime.h"
 
 #include <boost/log/trivial.hpp>
 #include <tuple>
 
-namespace {
-
 bool frameToImage(
     VideoFrame& videoFrameData, 
     AVFramePtr& m_videoFrame,
@@ -53,18 +52,10 @@ bool frameToImage(
     return true;
 }
 
-
-} // namespace
-
-struct FFmpegDecoder::VideoParseContext
-{
-    bool initialized = false;
-    int numSkipped = 0;
-};
-
 void FFmpegDecoder::videoParseRunnable()
 {
     CHANNEL_LOG(ffmpeg_threads) << "Video thread started";
+    ApplyThreadPolicy(THREAD_ROLE_DECODE);
     m_videoStartClock = VIDEO_START_CLOCK_NOT_INITIALIZED;
     double videoClock = 0; // pts of last decoded frame / predicted pts of next decoded frame
 
@@ -74,6 +65,7 @@ void FFmpegDecoder::videoParseRunnable()
     {
         if (m_isPaused && !m_isVideoSeekingWhilePaused)
         {
+            m_controlMonitor.end(CONTROL_PAUSE);
             boost::unique_lock<boost::mutex> locker(m_isPausedMutex);
             while (m_isPaused && !m_isVideoSeekingWhilePaused)
             {
@@ -92,6 +84,23 @@ void FFmpegDecoder::videoParseRunnable()
 
             auto packetGuard = MakeGuard(&packet, av_packet_unref);
 
+            if (IsLoopMarker(packet))
+            {
+                // Drain the previous lap, then start over as if freshly opened
+                handleVideoPacket(packet, videoClock, context);
+                if (!m_intraDecoderPool)
+                {
+                    avcodec_flush_buffers(m_videoCodecContext);
+                }
+                if (m_mainVideoFilterThread)
+                {
+                    AVFramePtr marker(av_frame_alloc());
+                    m_videoFilterQueue.push(marker, [] { return false; });
+                }
+                startLoopLap(context);
+                continue;
+            }
+
             if (!handleVideoPacket(packet, videoClock, context)
                 || m_isPaused && !m_isVideoSeekingWhilePaused)
             {
@@ -106,31 +115,62 @@ bool FFmpegDecoder::handleVideoPacket(
     double& videoClock,
     VideoParseContext& context)
 {
+    if (m_intraDecoderPool)
+    {
+        return handleIntraVideoPacket(packet, videoClock, context);
+    }
+
+    applyDecodeQuality(context);
+
+    const auto decodeTime = [this](boost::chrono::high_resolution_clock::time_point startTime)
+    {
+        InterlockedAdd(m_videoDecodeTime, boost::chrono::duration_cast<boost::chrono::microseconds>(
+            boost::chrono::high_resolution_clock::now() - startTime).count() / 1000000.);
+    };
+
+    auto startTime = boost::chrono::high_resolution_clock::now();
     const int ret = avcodec_send_packet(m_videoCodecContext, &packet);
+    decodeTime(startTime);
     if (ret < 0) {
         return false;
     }
 
-    AVFramePtr videoFrame(av_frame_alloc());
-    while (avcodec_receive_frame(m_videoCodecContext, videoFrame.get()) == 0)
+    if (!context.frame)
     {
-		const int64_t duration_stamp = videoFrame->best_effort_timestamp;
-
-        // compute the exact PTS for the picture if it is omitted in the stream
-        // pts1 is the dts of the pkt / pts of the frame
-        if (duration_stamp != AV_NOPTS_VALUE)
-        {
-            videoClock = duration_stamp * av_q2d(m_videoStream->time_base);
+        context.frame.reset(av_frame_alloc());
+    }
+    AVFramePtr& videoFrame = context.frame;
+    for (;;)
+    {
+        startTime = boost::chrono::high_resolution_clock::now();
+        const bool received = avcodec_receive_frame(m_videoCodecContext, videoFrame.get()) == 0;
+        decodeTime(startTime);
+        if (!received || !handleDecodedFrame(videoFrame, videoClock, context)) {
+            break;
         }
-        const double pts = videoClock;
+    }
+
+    return true;
+}
 
-        // update video clock for next frame
-        // for MPEG2, the frame can be repeated, so we update the clock accordingly
-        const double frameDelay = av_q2d(m_videoCodecContext->time_base) *
-            (1. + videoFrame->repeat_pict * 0.5);
-        videoClock += frameDelay;
+bool FFmpegDecoder::handleIntraVideoPacket(
+    const AVPacket& packet,
+    double& videoClock,
+    VideoParseContext& context)
+{
+    // An empty packet drains the pool
+    const bool draining = packet.data == nullptr;
+    if (!draining)
+    {
+        m_intraDecoderPool->send(packet);
+    }
 
-        if (!handleVideoFrame(videoFrame, pts, context)) {
+    // Keep the workers busy, only wait for output once enough is in flight or no more input is at hand
+    AVFramePtr videoFrame;
+    while (m_intraDecoderPool->receive(videoFrame,
+        draining || m_intraDecoderPool->full() || m_videoPacketsQueue.empty()))
+    {
+        if (!handleDecodedFrame(videoFrame, videoClock, context)) {
             break;
         }
     }
@@ -138,20 +178,66 @@ bool FFmpegDecoder::handleVideoPacket(
     return true;
 }
 
+bool FFmpegDecoder::handleDecodedFrame(
+    AVFramePtr& videoFrame,
+    double& videoClock,
+    VideoParseContext& context)
+{
+    const int64_t duration_stamp = videoFrame->best_effort_timestamp;
+
+    // compute the exact PTS for the picture if it is omitted in the stream
+    // pts1 is the dts of the pkt / pts of the frame
+    if (duration_stamp != AV_NOPTS_VALUE)
+    {
+        videoClock = duration_stamp * av_q2d(m_videoStream->time_base);
+    }
+    const double pts = videoClock;
+
+    // update video clock for next frame
+    // for MPEG2, the frame can be repeated, so we update the clock accordingly
+    const double frameDelay = av_q2d(m_videoCodecContext->time_base) *
+        (1. + videoFrame->repeat_pict * 0.5);
+    videoClock += frameDelay;
+
+    if (m_mainVideoFilterThread)
+    {
+        // Hardware surfaces cannot be fed to filters
+        handleDirect3dData(videoFrame.get(), false);
+        videoFrame->pts = (duration_stamp != AV_NOPTS_VALUE)
+            ? duration_stamp : int64_t(pts / av_q2d(m_videoStream->time_base) + 0.5);
+
+        AVFramePtr filterFrame(av_frame_alloc());
+        av_frame_move_ref(filterFrame.get(), videoFrame.get());
+        return m_videoFilterQueue.push(filterFrame,
+            [this] { return m_isPaused && !m_isVideoSeekingWhilePaused; });
+    }
+
+    return handleVideoFrame(videoFrame, pts, context);
+}
+
 bool FFmpegDecoder::handleVideoFrame(
     AVFramePtr& videoFrame,
     double pts,
     VideoParseContext& context)
 {
     enum { MAX_SKIPPED_TILL_REDRAW = 5 };
-    enum { SKIP_LOOP_FILTER_THRESHOLD = 50 };
     const double MAX_DELAY = 0.2;
 
     const int64_t duration_stamp = videoFrame->best_effort_timestamp;
 
-    boost::posix_time::time_duration td(boost::posix_time::pos_infin);
+    if (context.looping)
+    {
+        if (!isInLoopRange(pts, pts))
+        {
+            return true;
+        }
+        pts += context.loopOffset;
+    }
+
+    ITimeSource::Duration td = ITimeSource::Duration::max();
     bool inNextFrame = false;
-    const bool haveVideoPackets = !m_videoPacketsQueue.empty();
+    const bool haveVideoPackets = !m_videoPacketsQueue.empty()
+        || m_mainVideoFilterThread && !m_videoFilterQueue.empty();
 
     {
         boost::lock_guard<boost::mutex> locker(m_isPausedMutex);
@@ -174,18 +260,10 @@ bool FFmpegDecoder::handleVideoFrame(
                 }
 
                 ++context.numSkipped;
-                if (context.numSkipped == SKIP_LOOP_FILTER_THRESHOLD)
-                {
-                    if (m_videoCodecContext->skip_loop_filter != AVDISCARD_ALL)
-                    {
-                        // https://trac.kodi.tv/ticket/4943
-                        CHANNEL_LOG(ffmpeg_sync) << "skip_loop_filter = AVDISCARD_ALL";
-                        m_videoCodecContext->skip_loop_filter = AVDISCARD_ALL;
-                    }
-                }
                 if ((context.numSkipped % MAX_SKIPPED_TILL_REDRAW) != 0)
                 {
                     CHANNEL_LOG(ffmpeg_sync) << "Hard skip frame";
+                    reportDecodeLoad(context, true);
 
                     // pause
                     return !(m_isPaused && !m_isVideoSeekingWhilePaused);
@@ -195,18 +273,19 @@ bool FFmpegDecoder::handleVideoFrame(
             {
                 const auto speed = getSpeedRational();
                 context.numSkipped = 0;
-                td = boost::posix_time::milliseconds(
+                td = boost::chrono::milliseconds(
                     int((m_videoStartClock + pts - curTime) * 1000.  * speed.denominator / speed.numerator) + 1);
             }
         }
     }
 
     context.initialized = true;
+    reportDecodeLoad(context, false);
 
     {
         boost::unique_lock<boost::mutex> locker(m_videoFramesMutex);
 
-        if (!m_videoFramesCV.timed_wait(locker, td, [this]
+        if (!m_timeSource->waitFor(m_videoFramesCV, locker, td, [this]
         {
             return m_isPaused && !m_isVideoSeekingWhilePaused ||
                 m_videoFramesQueue.canPush();
@@ -233,10 +312,17 @@ bool FFmpegDecoder::handleVideoFrame(
     }
 
     VideoFrame& current_frame = m_videoFramesQueue.back();
-    handleDirect3dData(videoFrame.get());
-    if (!frameToImage(current_frame, videoFrame, m_imageCovertContext, m_pixelFormat))
+    handleDirect3dData(videoFrame.get(), m_allowDirect3dData);
+    if (m_autoCrop && videoFrame->format != AV_PIX_FMT_DXVA2_VLD)
     {
-        return true;
+        m_cropDetector.apply(videoFrame.get());
+    }
+    {
+        PrimitiveTimer timer(PRIMITIVE_FRAME_TO_IMAGE);
+        if (!frameToImage(current_frame, videoFrame, m_imageCovertContext, m_pixelFormat))
+        {
+            return true;
+        }
     }
 
     current_frame.m_pts = pts;
@@ -245,8 +331,72 @@ bool FFmpegDecoder::handleVideoFrame(
     {
         boost::lock_guard<boost::mutex> locker(m_videoFramesMutex);
         m_videoFramesQueue.pushBack();
+#ifdef PRIMITIVE_TIMING
+        m_frameHandoffTime = PrimitiveClock::now();
+#endif
     }
     m_videoFramesCV.notify_all();
 
     return true;
 }
+
+void FFmpegDecoder::reportDecodeLoad(VideoParseContext& context, bool skipped)
+{
+    // Real time like the decode time it is set against, whatever clock paces playback
+    const double now = GetSteadyTime();
+    const double elapsed = now - context.reportStart;
+
+    // A window spanning a pause or a stall says nothing about the load
+    if (context.reportStart == 0 || elapsed > GOVERNOR_REPORT_MS * 4 / 1000.)
+    {
+        context.reportStart = now;
+        context.reportDecodeTime = m_videoDecodeTime;
+        context.reportFrames = 0;
+        context.reportSkipped = 0;
+    }
+
+    ++context.reportFrames;
+    if (skipped)
+    {
+        ++context.reportSkipped;
+    }
+
+    if (elapsed < GOVERNOR_REPORT_MS / 1000.)
+    {
+        return;
+    }
+
+    const double load = (m_videoDecodeTime - context.reportDecodeTime) / elapsed;
+    const double lag = double(context.reportSkipped) / context.reportFrames;
+    m_decodeQuality = DecodeGovernor::Instance().report(m_governorId, load, lag);
+
+    context.reportStart = now;
+    context.reportDecodeTime = m_videoDecodeTime;
+    context.reportFrames = 0;
+    context.reportSkipped = 0;
+}
+
+void FFmpegDecoder::applyDecodeQuality(VideoParseContext& context)
+{
+    const int quality = m_decodeQuality;
+    if (quality == context.decodeQuality)
+    {
+        return;
+    }
+
+    CHANNEL_LOG(ffmpeg_sync) << "Decode quality: " << DecodeQualityName(quality);
+
+    // https://trac.kodi.tv/ticket/4943
+    const AVDiscard skipLoopFilter = (quality >= DECODE_QUALITY_NO_LOOP_FILTER)
+        ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+    const AVDiscard skipFrame = (quality >= DECODE_QUALITY_KEYFRAMES_ONLY) ? AVDISCARD_NONKEY
+        : (quality >= DECODE_QUALITY_NO_NONREF) ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    m_videoCodecContext->skip_loop_filter = skipLoopFilter;
+    m_videoCodecContext->skip_frame = skipFrame;
+    if (m_intraDecoderPool)
+    {
+        m_intraDecoderPool->setDiscard(skipLoopFilter, skipFrame);
+    }
+
+    context.decodeQuality = quality;
+}